@@ -1,5 +1,5 @@
 //////////////////////////////////////////////////
-//gl2d.h				1.6.1
+//gl2d.h				1.7.0
 //Copyright(c) 2020 - 2024 Luta Vlad
 //https://github.com/meemknight/gl2d
 //
@@ -28,13 +28,15 @@
 
 #pragma once
 
-//enable simd functions
+//enable simd functions, the instruction set (sse4.1, avx2 or neon) is chosen at runtime
 //set GL2D_SIMD to 0 if it doesn't work on your platform
-#ifdef _WIN32
+#ifndef GL2D_SIMD
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
 #define GL2D_SIMD 1
 #else
 #define GL2D_SIMD 0
 #endif
+#endif
 
 //if you are not using visual studio make shure you link to "Opengl32.lib"
 
@@ -51,14 +53,25 @@
 #define GL2D_OPNEGL_SHADER_VERSION "#version 330"
 #define GL2D_OPNEGL_SHADER_PRECISION "precision highp float;"
 
+//how many textures the default shader can use in one draw call,
+//it is also clamped to GL_MAX_TEXTURE_IMAGE_UNITS at runtime.
+#define GL2D_MAX_TEXTURE_SLOTS 16
+
 //this is the default capacity of the renderer
 #define GL2D_DefaultTextureCoords (glm::vec4{ 0, 1, 1, 0 })
 
+//measures the gpu time of the rest of the scope
+#define GL2D_GPU_ZONE_CONCAT2(a, b) a##b
+#define GL2D_GPU_ZONE_CONCAT(a, b) GL2D_GPU_ZONE_CONCAT2(a, b)
+#define GL2D_GPU_ZONE(name) ::gl2d::GpuZone GL2D_GPU_ZONE_CONCAT(gl2dGpuZone, __LINE__)(name)
+
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <functional>
 #include <random>
 #include <stb_image/stb_image.h>
 #include <stb_truetype/stb_truetype.h>
+#include <string>
 #include <vector>
 
 namespace gl2d
@@ -93,12 +106,28 @@ namespace gl2d
 	{
 		GLuint id = 0;
 		int u_sampler = 0;
+		int u_viewProjection = -1;
+		int u_instanced = -1;
+		int u_textures = -1;
+		int u_depthScale = -1;
 
-		void bind() { glUseProgram(id); };
+		void bind();
 
-		void clear() { glDeleteProgram(id); *this = {}; }
+		void clear();
 	};
 
+	//The vertex positions are in world space (pixels).
+	//A custom vertex shader has to transform them using "uniform mat3 u_viewProjection"
+	//which contains the camera and the window metrics.
+	//If the renderer uses instancedRendering the vertex shader also has to handle "uniform bool u_instanced",
+	//(see the default vertex shader), shaders created with createShader do that.
+	//If the fragment shader has "uniform sampler2D u_textures[GL2D_MAX_TEXTURE_SLOTS]" the renderer
+	//binds more textures for a draw call and passes the slot in "flat in int v_textureSlot",
+	//else it uses u_sampler and draws each texture separately.
+	//For Renderer2D::opaquePass the vertex shader has to set the depth like the default one does
+	//with "uniform float u_depthScale" and the depth attributes.
+	//The high 4 bits of quad_textureSlot and instance_textureSlot are the shape of renderCircle, renderRing
+	//and renderRoundedRect, the low 4 bits are the texture slot.
 	ShaderProgram createShaderProgram(const char *vertex, const char *fragment);
 
 	ShaderProgram createShaderFromFile(const char *filePath);
@@ -125,6 +154,9 @@ namespace gl2d
 		glm::vec4 fontGetGlyphTextureCoords(const Font font, const char c);
 
 		glm::vec2 convertPoint(const Camera &c, const glm::vec2 &p, float windowW, float windowH);
+
+		//the matrix that goes from world space to screen coordonates (-1, 1), used by the vertex shader
+		glm::mat3 computeViewProjection(const Camera &c, float windowW, float windowH);
 	}
 
 	///////////////////// COLOR ///////////////////
@@ -162,14 +194,29 @@ namespace gl2d
 	{
 		GLuint id = 0;
 
+		//set when the texture is created or resized by the library so it doesn't have to be queried from gl.
+		//A copy of a FrameBuffer texture made before FrameBuffer::resize keeps the old values.
+		//If they are 0 (the id was set by hand) GetSize and getMemorySize read them from gl.
+		int width = 0;
+		int height = 0;
+		GLenum internalFormat = 0;
+		int mipLevels = 0;
+		size_t gpuMemorySize = 0; //all the mip levels, in bytes
+
+		//every pixel has an alpha of 255, set by createFromBuffer. Used by Renderer2D::opaquePass
+		bool opaque = false;
+
 		Texture() {};
 		explicit Texture(const char* file, bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED,
 			bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS)
 			{ loadFromFile(file, pixelated, useMipMaps); }
 
-		//returns the texture dimensions
+		//returns the texture dimensions, without any gl call if the texture was created by the library
 		glm::ivec2 GetSize();
 
+		//used internally, sets the cached size, format and memory size
+		void setMetadata(int width, int height, GLenum internalFormat, bool mipMaps);
+
 		//Note: This function expects a buffer of bytes in GL_RGBA format
 		void createFromBuffer(const char* image_data, const int width,
 			const int height, bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED, bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS);
@@ -201,7 +248,8 @@ namespace gl2d
 
 		//returns how much memory does the texture take (bytes),
 		//used for allocating your buffer when using readTextureData
-		//you can also optionally get the width and the height of the texture using outSize
+		//you can also optionally get the width and the height of the texture using outSize.
+		//It is the RGBA size of one mip level, the memory used on the gpu is gpuMemorySize
 		size_t getMemorySize(int mipLevel = 0, glm::ivec2 *outSize = 0);
 
 		//reads the texture data back into RAM, you need to specify
@@ -269,6 +317,161 @@ namespace gl2d
 		}
 	};
 
+	//a texture and the texture coordonates of an image inside it,
+	//can be drawn directly with renderRectangle
+	struct Sprite
+	{
+		Texture texture = {};
+		glm::vec4 textureCoords = GL2D_DefaultTextureCoords;
+	};
+
+	//Packs images into a few big textures (pages) at runtime so they can be drawn
+	//with the same texture instead of one texture for each image.
+	//It uses a skyline packer and extrudes the edges of every image so filtering doesn't bleed.
+	//A full page is grown up to maxPageSize, after that a new page is added.
+	//add returns an id, use get to get the sprite.
+	//The texture coordonates change when a page grows so get the sprites again after adding images.
+	struct DynamicAtlas
+	{
+		DynamicAtlas() {};
+
+		void create(int pageSize = 512, int maxPageSize = 4096, int extrude = 1,
+			bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED, bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS);
+
+		//Note: This function expects a buffer of bytes in GL_RGBA format, the same as Texture::createFromBuffer
+		//returns -1 on fail
+		int addFromBuffer(const char *image_data, const int width, const int height);
+
+		//returns -1 on fail
+		int addFromFileData(const unsigned char *image_file_data, const size_t image_file_size);
+
+		//returns -1 on fail
+		int addFromFile(const char *fileName);
+
+		//The sprite is a copy of the page texture and the texture coordonates at the time of the call.
+		//Any add can grow the page, that changes the texture coordonates of every sprite on it,
+		//so call get again after adding images, don't keep the sprites across adds.
+		Sprite get(int id);
+
+		//frees the pages, the sprites become invalid
+		void cleanup();
+
+		struct SkylineNode
+		{
+			int x = 0;
+			int y = 0;
+			int w = 0;
+		};
+
+		struct Page
+		{
+			Texture texture = {};
+			glm::ivec2 size = {};
+			glm::ivec2 textureSize = {}; //the size that was uploaded, used to know if the page grew
+			std::vector<SkylineNode> skyline;
+			std::vector<unsigned char> pixels; //RGBA, kept so the page can grow
+		};
+
+		//position and size in pixels, without the extruded edges
+		struct Entry
+		{
+			int page = 0;
+			glm::ivec4 rect = {};
+		};
+
+		std::vector<Page> pages;
+		std::vector<Entry> entries;
+
+		int pageSize = 512;
+		int maxPageSize = 4096;
+		int extrude = 1;
+		bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED;
+		bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS;
+	};
+
+#pragma endregion
+
+#pragma region TextureManager
+
+	//Keeps the textures under a gpu memory budget.
+	//The textures are added with their source (a file or a generator function) and are loaded when they are first used.
+	//When the budget is exceeded the least recently used textures are freed and loaded again the next time they are used.
+	//Until a texture is loaded get returns the placeholder.
+	//add returns an id, use get every frame the texture is drawn.
+	struct TextureManager
+	{
+		TextureManager() {};
+
+		//feel free to delete this lines but you probably don't want to copy the manager from a place to another
+		TextureManager(TextureManager &other) = delete;
+		TextureManager operator=(TextureManager &other) = delete;
+
+		//in bytes, the textures used in the current frame are never freed even if they exceed it
+		size_t budget = 256 * 1024 * 1024;
+
+		//how many textures update loads, 0 means all of them
+		int loadsPerFrame = 1;
+
+		//returned by get while a texture isn't loaded, if it has no id the default white texture is used
+		Texture placeholder = {};
+
+		int addFromFile(const char *fileName, const char *category = "",
+			bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED, bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS);
+
+		//the generator is called every time the texture has to be loaded, it has to return a new texture
+		int addFromGenerator(std::function<Texture()> generator, const char *category = "");
+
+		//marks the texture as used in this frame, if it isn't loaded it is queued and the placeholder is returned.
+		//Don't keep the returned texture between frames, it can be freed by update.
+		Texture get(int id);
+
+		//loads the texture now if it isn't loaded, for the textures that have to be ready (loading screens)
+		void load(int id);
+
+		//frees the texture, it will be loaded again the next time it is used
+		void unload(int id);
+
+		bool isLoaded(int id);
+
+		//call once every frame after the last flush (or before rendering anything).
+		//It loads the queued textures and frees the least recently used ones if the budget is exceeded.
+		void update();
+
+		//the gpu memory of the loaded textures, in bytes
+		size_t getUsedMemory();
+
+		struct CategoryUsage
+		{
+			std::string name;
+			size_t bytes = 0;
+			int loaded = 0;
+			int count = 0;
+		};
+
+		std::vector<CategoryUsage> getCategoryUsage();
+
+		//frees all the textures, the ids become invalid
+		void cleanup();
+
+		struct Entry
+		{
+			std::string fileName;
+			std::function<Texture()> generator;
+			std::string category;
+			bool pixelated = GL2D_DEFAULT_TEXTURE_LOAD_MODE_PIXELATED;
+			bool useMipMaps = GL2D_DEFAULT_TEXTURE_LOAD_MODE_USE_MIPMAPS;
+			bool queued = false;
+			bool failed = false; //not loaded again so the error isn't reported every frame
+			Texture texture = {};
+			unsigned long long lastUsedFrame = 0;
+		};
+
+		std::vector<Entry> entries;
+		std::vector<int> loadQueue;
+		unsigned long long frame = 1;
+		size_t usedMemory = 0;
+	};
+
 #pragma endregion
 
 
@@ -345,12 +548,13 @@ namespace gl2d
 	struct FrameBuffer
 	{
 		FrameBuffer() {};
-		explicit FrameBuffer(unsigned int w, unsigned int h) { create(w, h); };
+		explicit FrameBuffer(unsigned int w, unsigned int h, bool depth = false) { create(w, h, depth); };
 
 		unsigned int fbo = 0;
 		Texture texture = {};
+		unsigned int depthTexture = 0; //only if created with depth, needed by Renderer2D::opaquePass
 
-		void create(unsigned int w, unsigned int h);
+		void create(unsigned int w, unsigned int h, bool depth = false);
 		void resize(unsigned int w, unsigned int h);
 
 		//clears resources
@@ -363,54 +567,193 @@ namespace gl2d
 
 	enum Renderer2DBufferType
 	{
-		quadPositions,
-		quadColors,
-		texturePositions,
+		quadIndices,
 
 		bufferSize
 	};
 
-	struct Renderer2D
+	//Used internally to upload the vertices and instances every flush without
+	//reallocating the buffer. It is a ring buffer that is mapped persistently if glBufferStorage
+	//is available, else every upload is mapped with GL_MAP_UNSYNCHRONIZED_BIT.
+	//Regions that can still be used by the gpu are guarded with fences.
+	struct Renderer2DStreamBuffer
 	{
-		Renderer2D() {};
+		GLuint buffer = 0;
+		size_t size = 0;
+		size_t cursor = 0;
+		char *persistentData = nullptr;
 
-		//feel free to delete this lines but you probably don't want to copy the renderer from a place to another
-		Renderer2D(Renderer2D &other) = delete;
-		Renderer2D(Renderer2D &&other) = delete;
-		Renderer2D operator=(Renderer2D other) = delete;
-		Renderer2D operator=(Renderer2D &other) = delete;
-		Renderer2D operator=(Renderer2D &&other) = delete;
+		struct LockedRegion
+		{
+			GLsync fence = 0;
+			size_t begin = 0;
+			size_t end = 0;
+		};
+		std::vector<LockedRegion> lockedRegions;
 
-		//creates the renderer
-		//fbo is the default frame buffer, 0 means drawing to the screen.
-		//Quad count is the reserved quad capacity for drawing.
-		//If the capacity is exceded it will be extended but this will cost performance.
-		void create(GLuint fbo = 0, size_t quadCount = 1'000);
+		void create(size_t size);
+
+		//grows the buffer so size bytes can be uploaded without wrapping,
+		//call it before uploading data that is used together.
+		void ensureCapacity(size_t size);
+
+		//writes the data and returns its offset in the buffer,
+		//grows the buffer if needed so the buffer id can change.
+		size_t upload(const void *data, size_t size);
+
+		//writes two blocks next to each other, used when both are read by the same draw calls
+		//so they are never split by wrapping around. Returns the offset of the first one.
+		size_t upload(const void *first, size_t firstSize, const void *second, size_t secondSize, size_t &secondOffset);
+
+		//call this after the draw calls that read this region were issued
+		void lockRegion(size_t offset, size_t size);
 
-		//Clears the object alocated resources but
-		//does not clear resources allocated by user like textures, fonts and fbos!
 		void cleanup();
+	};
 
-		GLuint defaultFBO = 0;
+	//the vertex format used by the renderer.
+	//All the attributes are interleaved in one buffer.
+	//Colors are stored as RGBA8 and texture coordonates as 16 bit normalized values
+	//so they will be clamped to [0, 1].
+	struct Renderer2DVertex
+	{
+		glm::vec2 position = {};
+		GLubyte color[4] = {};
+		GLushort texturePosition[2] = {};
+		GLubyte textureSlot = 0; //set when flushing, the high 4 bits are the shape (renderCircle, renderRing, renderRoundedRect)
+		GLubyte depth[3] = {}; //24 bit submission index, set when flushing with opaquePass
+	};
 
-		GLuint buffers[Renderer2DBufferType::bufferSize] = {};
-		GLuint vao = {};
+	//used by instancedRendering, one for each quad.
+	//The corners and the rotation are computed in the vertex shader.
+	struct Renderer2DInstance
+	{
+		glm::vec4 rect = {}; //world space
+		glm::vec2 origin = {}; //world space
+		float rotation = 0; //radians
+		GLubyte color[4] = {};
+		GLushort textureCoords[4] = {};
+		GLubyte textureSlot = 0; //set when flushing, the high 4 bits are the shape like for the vertices
+		GLubyte depth[3] = {}; //24 bit submission index, set when flushing with opaquePass
+	};
 
-		//4 elements each component
-		std::vector<glm::vec2>spritePositions;
-		std::vector<glm::vec4>spriteColors;
-		std::vector<glm::vec2>texturePositions;
-		std::vector<Texture>spriteTextures;
-		
-		//glm::vec2 spritePositions[GL2D_Renderer2D_Max_Triangle_Capacity * 6];
-		//glm::vec4 spriteColors[GL2D_Renderer2D_Max_Triangle_Capacity * 6];
-		//glm::vec2 texturePositions[GL2D_Renderer2D_Max_Triangle_Capacity * 6];
-		//Texture   spriteTextures[GL2D_Renderer2D_Max_Triangle_Capacity * 6];
+	enum SimdLevel
+	{
+		simdScalar = 0,
+		simdSSE41,
+		simdAVX2,
+		simdNEON,
+	};
+
+	//the instruction set used by transformQuads, the best one the cpu supports is chosen at runtime
+	SimdLevel getSimdLevel();
+
+	//forces the instruction set used by transformQuads, usefull for testing and benchmarks.
+	//If the cpu doesn't support it the best supported one is used, returns the level that is used.
+	SimdLevel setSimdLevel(SimdLevel level);
+
+	//Computes the 4 corner positions of count quads, the same as renderRectangleAbsRotation does,
+	//4 or 8 quads at a time. Origins are absolute and the rotations are in degrees.
+	//Only the positions of the vertices are written. Rotations are accurate up to about 10^8 degrees.
+	void transformQuads(const Rect *rects, const glm::vec2 *origins, const float *rotationsDegrees,
+		size_t count, Renderer2DVertex *vertices);
+
+	//how renderPolyline connects two segments
+	enum LineJoin
+	{
+		lineJoinMiter = 0,	//sharp corners, miters longer than 4 times the width are beveled
+		lineJoinBevel,		//the corners are cut
+	};
+
+	//how renderPolyline ends a path that isn't closed
+	enum LineCap
+	{
+		lineCapButt = 0,	//the line ends on the point
+		lineCapSquare,		//the line goes half of the width past the point
+	};
+
+	struct QuadWriter;
+	struct FrameCapture;
+
+	//Records the quads rendered with the drawing functions (rectangles, text, lines, 9 patches).
+	//It doesn't use any gl function so it can be filled on any thread, for example one recorder
+	//for the world, one for the ui and one for the particles. Submit it to a Renderer2D on the gl thread to draw it.
+	//Renderer2D is also a CommandRecorder, it just records into itself.
+	struct CommandRecorder
+	{
+		//copies the window metrics, the rendering settings and the current camera, shader and layer,
+		//call it before recording, the other recorder (or renderer) must not be modified meanwhile.
+		void copySettings(const CommandRecorder &other);
+
+		//If true, rectangles with only one color are stored as one instance
+		//(rect, origin, rotation, texture coordonates, color) instead of 4 vertices
+		//and are drawn with glDrawArraysInstanced. Everything else still uses vertices.
+		bool instancedRendering = false;
+
+		//If true the quads outside the view of the current camera are skipped when rendering.
+		//It is conservative, it tests the bounding box of the (rotated) quad against the bounding box of the view.
+		//Don't use it if you flush with a different camera (flushWithCamera) than the one used while rendering.
+		bool culling = false;
+
+		//counted only when culling is on, they are never reset by the renderer
+		size_t culledQuads = 0;
+		size_t drawnQuads = 0;
+
+		//used for culling, the world bounds (min x, min y, max x, max y) of the view of this camera
+		struct CullingView
+		{
+			Camera camera = {};
+			int windowW = -1;
+			int windowH = -1;
+			glm::vec4 bounds = {};
+		}cullingView;
+
+		//4 vertices for each quad, drawn using the shared index buffer.
+		//The positions are in world space, the camera is applied in the vertex shader.
+		std::vector<Renderer2DVertex>spriteVertices;
+		std::vector<Renderer2DInstance>spriteInstances;
+
+		//one for each quad, in the order they were rendered
+		struct QuadInfo
+		{
+			GLuint texture = 0;
+			bool instanced = false;
+			bool opaque = false; //the texture is opaque and all the colors have an alpha of 1
+		};
+		std::vector<QuadInfo>spriteQuads;
+
+		//the camera and window metrics used by the quads starting at firstQuad,
+		//a new one is added when the camera changes.
+		struct CameraBatch
+		{
+			Camera camera = {};
+			int windowW = 0;
+			int windowH = 0;
+			size_t firstQuad = 0;
+		};
+		std::vector<CameraBatch> cameraBatches;
+
+		//when the first quad after a clear was recorded, in seconds, used by the Renderer2D stats
+		double recordingStart = 0;
+
+		//If true the quads are sorted by layer, shader and texture when flushing
+		//so there are fewer draw calls and state changes.
+		//Lower layers are drawn first. Inside a layer the quads are grouped by shader and texture
+		//so only the quads with the same shader and texture keep the order they were rendered in,
+		//use layers for things that have to be drawn on top of each other.
+		//In this mode the shader is the one that was set when the quad was rendered, not when flushing.
+		bool deferredSorting = false;
+
+		int currentLayer = 0; //clamped to [-32768, 32767], only used with deferredSorting
+		std::vector<int> layerPushPop;
+		void pushLayer(int layer = 0);
+		void popLayer();
+
+		//one for each quad when using deferredSorting:
+		//layer (16 bits) | shader (8 bits) | texture id (16 bits) | submission index (24 bits)
+		std::vector<unsigned long long> sortKeys;
+		std::vector<ShaderProgram> sortShaders; //the shader bits are an index in this vector
 
-		//int spritePositionsCount = 0;
-		//int spriteColorsCount = 0;
-		//int texturePositionsCount = 0;
-		//int spriteTexturesCount = 0;
 
 		ShaderProgram currentShader = {};
 		std::vector<ShaderProgram> shaderPushPop;
@@ -424,6 +767,9 @@ namespace gl2d
 
 		glm::vec4 getViewRect(); //returns the view coordonates and size of this camera. Doesn't take rotation into account!
 
+		//returns the world bounding box (min x, min y, max x, max y) of what this camera sees, takes rotation into account.
+		glm::vec4 getViewBounds();
+
 
 		//window metrics, should be up to date at all times
 		int windowW = -1;
@@ -433,18 +779,23 @@ namespace gl2d
 		//converts pixels to screen (top left) (bottom right)
 		glm::vec4 toScreen(const glm::vec4& transform);
 
+		//reserves the space for n more quads so rendering them doesn't grow the vectors
+		void reserveQuads(size_t n);
+
+		//Reserves n quads and returns a writer that writes them without any capacity check for each quad.
+		//Nothing else can be rendered with this recorder until the writer's end is called.
+		QuadWriter beginQuads(size_t n);
+
 		//clears the things that are to be drawn when calling flush
 		inline void clearDrawData()
 		{
-			spritePositions.clear();
-			spriteColors.clear();
-			texturePositions.clear();
-			spriteTextures.clear();
-
-			//spritePositionsCount = 0;
-			//spriteColorsCount = 0;
-			//spriteTexturesCount = 0;
-			//texturePositionsCount = 0;
+			spriteVertices.clear();
+			spriteInstances.clear();
+			spriteQuads.clear();
+			cameraBatches.clear();
+			sortKeys.clear();
+			sortShaders.clear();
+			recordingStart = 0;
 		}
 
 		glm::vec2 getTextSize(const char *text, const Font font, const float size = 1.5f,
@@ -511,6 +862,16 @@ namespace gl2d
 		}
 
 		//abs rotation means that the rotaion is relative to the screen rather than object
+		inline void renderRectangle(const Rect transforms, const Sprite sprite, const Color4f colors = {1,1,1,1}, const glm::vec2 origin = {}, const float rotationDegrees = 0)
+		{
+			renderRectangle(transforms, sprite.texture, colors, origin, rotationDegrees, sprite.textureCoords);
+		}
+
+		inline void renderRectangleAbsRotation(const Rect transforms, const Sprite sprite, const Color4f colors = {1,1,1,1}, const glm::vec2 origin = {}, const float rotationDegrees = 0)
+		{
+			renderRectangleAbsRotation(transforms, sprite.texture, colors, origin, rotationDegrees, sprite.textureCoords);
+		}
+
 		void renderRectangleAbsRotation(const Rect transforms, const Color4f colors[4], const glm::vec2 origin = { 0,0 }, const float rotationDegrees = 0);
 		inline void renderRectangleAbsRotation(const Rect transforms, const Color4f colors = {1,1,1,1}, const glm::vec2 origin = { 0,0 }, const float rotationDegrees = 0)
 		{
@@ -526,21 +887,166 @@ namespace gl2d
 		
 		void renderCircleOutline(const glm::vec2 position, const float size, const Color4f color, const float width = 2.f, const unsigned int segments = 16);
 
+		//Draws the lines between count points, one quad for each segment written straight into the batch.
+		//The quads of two segments meet on the join so there are no gaps or overlaps, except inside bevel joins.
+		//If closed the last point is connected to the first one. Repeated points are skipped.
+		//Lines, rectangle outlines and circle outlines are drawn with it.
+		void renderPolyline(const glm::vec2 *points, size_t count, const Color4f color, const float width = 2.f,
+			const bool closed = false, const LineJoin join = lineJoinMiter, const LineCap cap = lineCapButt);
+
+		//The shapes are one quad each with the white texture so they batch with the sprites.
+		//The default fragment shader draws them with a signed distance function so the edge is smooth at any size.
+		//Fragment shaders that don't use v_shape (see the default one) draw them as rectangles.
+		void renderCircle(const glm::vec2 center, const float radius, const Color4f color);
+
+		//a circle outline, the width is centered on the radius like for renderCircleOutline
+		void renderRing(const glm::vec2 center, const float radius, const float width, const Color4f color);
+
+		//the corner radius is clamped to half of the smaller side
+		void renderRoundedRect(const Rect transforms, const float cornerRadius, const Color4f color,
+			const glm::vec2 origin = {}, const float rotationDegrees = 0);
+
 		//legacy, use render9Patch2
 		void render9Patch(const Rect position, const int borderSize, const Color4f color, const glm::vec2 origin, const float rotationDegrees, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords);
 
 		//used for ui. draws a texture that scales the margins different so buttons of different sizes can be drawn.
 		void render9Patch2(const Rect position, const Color4f color, const glm::vec2 origin, const float rotationDegrees, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords);
 
-		void clearScreen(const Color4f color = Color4f{0,0,0,0});
-
 		void setShaderProgram(const ShaderProgram shader);
 		void setCamera(const Camera camera);
 
 		//will reset on the current stack
 		void resetCameraAndShader();
+	};
+
+	//Writes quads straight into the draw data of a CommandRecorder (or Renderer2D), get it with beginQuads.
+	//The quads are always written as vertices, with the camera, shader and layer set when beginQuads was called.
+	//Writing more quads than reserved is reported once and the extra quads are dropped.
+	//Call end when done, the unused reserved quads are given back.
+	struct QuadWriter
+	{
+		void write(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin = {}, const float rotationDegrees = 0.f, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords);
+		inline void write(const Rect transforms, const Texture texture, const Color4f color = {1,1,1,1}, const glm::vec2 origin = {}, const float rotationDegrees = 0.f, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords)
+		{
+			Color4f c[4] = {color, color, color, color};
+			write(transforms, texture, c, origin, rotationDegrees, textureCoords);
+		}
+
+		//abs rotation means that the rotaion is relative to the screen rather than object
+		void writeAbsRotation(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin = {}, const float rotationDegrees = 0.f, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords);
+		inline void writeAbsRotation(const Rect transforms, const Texture texture, const Color4f color = {1,1,1,1}, const glm::vec2 origin = {}, const float rotationDegrees = 0.f, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords)
+		{
+			Color4f c[4] = {color, color, color, color};
+			writeAbsRotation(transforms, texture, c, origin, rotationDegrees, textureCoords);
+		}
+
+		//a quad with any 4 corners, in the order of the vertices of a rectangle (top left, bottom left, bottom right, top right)
+		void writeQuad(const glm::vec2 corners[4], const Texture texture, const Color4f color = {1,1,1,1}, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords);
+
+		//the same quad as renderLine
+		void writeLine(const glm::vec2 start, const glm::vec2 end, const Color4f color, const float width = 2.f);
+
+		//the same quads as renderPolyline, reserve 2 * count quads for it (one for each segment and join)
+		void writePolyline(const glm::vec2 *points, size_t count, const Color4f color, const float width = 2.f,
+			const bool closed = false, const LineJoin join = lineJoinMiter, const LineCap cap = lineCapButt);
+
+		//Writes count quads that use the same texture and texture coordonates, they are transformed
+		//with transformQuads so the origins are absolute (like writeAbsRotation). colors can be null (white).
+		//With culling the quads are written one by one.
+		void writeBatch(const Rect *rects, const glm::vec2 *origins, const float *rotationsDegrees, const Color4f *colors,
+			size_t count, const Texture texture, const glm::vec4 textureCoords = GL2D_DefaultTextureCoords);
+
+		void end();
+
+		CommandRecorder *recorder = nullptr;
+		Renderer2DVertex *vertices = nullptr;
+		CommandRecorder::QuadInfo *quads = nullptr;
+		unsigned long long *sortKeys = nullptr; //null when not using deferredSorting
+		unsigned long long sortKey = 0; //layer and shader bits
+
+		size_t firstVertex = 0;
+		size_t firstQuad = 0;
+		size_t count = 0;
+		size_t capacity = 0;
+		bool addedCameraBatch = false;
+		bool overflow = false;
+	};
+
+	struct Renderer2D: public CommandRecorder
+	{
+		Renderer2D() {};
+
+		//feel free to delete this lines but you probably don't want to copy the renderer from a place to another
+		Renderer2D(Renderer2D &other) = delete;
+		Renderer2D(Renderer2D &&other) = delete;
+		Renderer2D operator=(Renderer2D other) = delete;
+		Renderer2D operator=(Renderer2D &other) = delete;
+		Renderer2D operator=(Renderer2D &&other) = delete;
+
+		//creates the renderer
+		//fbo is the default frame buffer, 0 means drawing to the screen.
+		//Quad count is the reserved quad capacity for drawing.
+		//If the capacity is exceded it will be extended but this will cost performance.
+		void create(GLuint fbo = 0, size_t quadCount = 1'000);
+
+		//Clears the object alocated resources but
+		//does not clear resources allocated by user like textures, fonts and fbos!
+		void cleanup();
+
+		GLuint defaultFBO = 0;
+
+		GLuint buffers[Renderer2DBufferType::bufferSize] = {};
+		GLuint vao = {};
+		GLuint instanceVao = {};
+
+		//the vertices and the instances are streamed here every flush
+		Renderer2DStreamBuffer streamBuffer = {};
+
+		//how many quads the static index buffer can draw, it grows on demand
+		size_t indexBufferQuadCapacity = 0;
+
+		//used when flushing, quads that share the bound textures are drawn together.
+		//The textures of a batch are stored in batchTextures starting at firstTexture.
+		struct TextureBatch
+		{
+			size_t firstQuad = 0;
+			size_t firstTexture = 0;
+			int textureCount = 0;
+			int shader = -1; //index in sortShaders, -1 means currentShader
+		};
+		std::vector<TextureBatch> textureBatches;
+		std::vector<GLuint> batchTextures;
+
+		//used when sorting so it doesn't allocate every frame
+		struct SortScratch
+		{
+			std::vector<unsigned long long> keys;
+			std::vector<size_t> source;
+			std::vector<size_t> quadCamera;
+			std::vector<Renderer2DVertex> vertices;
+			std::vector<Renderer2DInstance> instances;
+			std::vector<QuadInfo> quads;
+			std::vector<CameraBatch> cameraBatches;
+		}sortScratch;
+
+		//If true the opaque quads (opaque texture, all the colors with an alpha of 1 and the default shader)
+		//are drawn first from front to back with depth writes and without blending, then the other quads
+		//are drawn from back to front with the depth test so the pixels covered by an opaque quad are skipped.
+		//Every quad gets a depth from its position in the flush so the result looks the same.
+		//It needs a depth buffer in the frame buffer drawn to (FrameBuffer::create with depth),
+		//else the flush is drawn normally. Custom vertex shaders have to handle "uniform float u_depthScale"
+		//like the default one does, else nothing is drawn with the opaque pass while they are used.
+		bool opaquePass = false;
+
+		//Appends the quads recorded by the recorder after the ones already rendered and clears the recorder.
+		//The recorder keeps its own camera, so the quads are drawn with the cameras they were recorded with.
+		//Submit the recorders in the same order every frame so the result is deterministic.
+		void submit(CommandRecorder &recorder);
+
+		void clearScreen(const Color4f color = Color4f{0,0,0,0});
 
 		//The framebuffer need to have the same size as the input!
+		//An empty result means the default fbo, like for the other post process functions.
 		void renderPostProcess(ShaderProgram shader, Texture input, FrameBuffer result = {});
 
 		//Only when this function is called it draws to the screen the things rendered.
@@ -552,6 +1058,11 @@ namespace gl2d
 		//If clearDrawData is false, the rendering information will be kept.
 		void flushFBO(FrameBuffer frameBuffer, bool clearDrawData = true);
 
+		//Draws everything using this camera instead of the cameras used while rendering,
+		//usefull to render the same things again, for example for a minimap (use clearDrawData = false on the first flush).
+		//An empty frameBuffer means the default fbo.
+		void flushWithCamera(const Camera camera, FrameBuffer frameBuffer = {}, bool clearDrawData = true);
+
 		void renderFrameBufferToTheEntireScreen(gl2d::FrameBuffer fbo, gl2d::FrameBuffer screen = {});
 
 		void renderTextureToTheEntireScreen(gl2d::Texture t, gl2d::FrameBuffer screen = {});
@@ -570,10 +1081,342 @@ namespace gl2d
 		void postProcessOverATexture(const std::vector<ShaderProgram> &postProcesses,
 			gl2d::Texture in,
 			FrameBuffer frameBuffer = {});
+
+		//what the renderer did in a frame, collected while flushing.
+		//Every draw call after the first one of a frame counts one batch break with the reason it was split.
+		struct Stats
+		{
+			enum BatchBreak
+			{
+				breakTextureSlots = 0,	//all the texture slots of the batch were used
+				breakShader,			//another shader
+				breakCamera,			//another camera or window size
+				breakInstancing,		//switching between vertex quads and instances
+				breakFlush,				//flush called again on the same frame buffer
+				breakFrameBuffer,		//flush on another frame buffer
+				breakFullScreen,		//post process passes and textures drawn to the entire screen
+				breakOpaquePass,		//from the opaque quads to the translucent ones
+				batchBreakCount
+			};
+
+			unsigned int flushes = 0; //StaticBatch::draw counts as a flush
+			unsigned int drawCalls = 0;
+			size_t quads = 0;
+			size_t vertices = 0;
+			size_t bytesUploaded = 0;
+			unsigned int textureBinds = 0;
+			unsigned int shaderChanges = 0;
+			unsigned int postProcessPasses = 0;
+			size_t opaqueQuads = 0; //drawn with the opaque pass
+
+			//cpu time in milliseconds. Submission is measured from the first quad rendered after a flush
+			//to the next flush so it also contains the work done by the game between the render calls.
+			double submissionMs = 0;
+			double flushMs = 0;
+
+			unsigned int batchBreaks[batchBreakCount] = {};
+		};
+
+		//the frame that is being collected, endFrameStats moves it into the history
+		Stats stats = {};
+
+		//call once every frame, after the last flush
+		void endFrameStats();
+
+		//framesAgo 0 is the last ended frame, returns empty stats if the frame isn't in the history
+		Stats getFrameStats(size_t framesAgo = 0);
+
+		//how many ended frames are in the history
+		size_t getStatsFrameCount() { return statsHistoryCount; }
+
+		//the history keeps the last frames in a ring buffer, 120 by default. Resizing clears it.
+		void setStatsHistorySize(size_t frames);
+
+		//writes the history from the oldest frame to the newest one, returns false on failure
+		bool dumpStatsCSV(const char *fileName);
+
+		//internal use
+		std::vector<Stats> statsHistory;
+		size_t statsHistoryNext = 0;
+		size_t statsHistoryCount = 0;
+		GLuint statsFrameBuffer = 0; //the last frame buffer drawn to by a flush
+
+		//set by FrameCapture::begin, everything the renderer draws is recorded into it
+		FrameCapture *capture = nullptr;
+	};
+
+	//Records quads once into its own vbo so static things (backgrounds, ui panels)
+	//don't have to be rendered and uploaded again every frame.
+	//Everything rendered with the renderer between begin and end is recorded,
+	//the things rendered before begin are kept in the renderer.
+	//Record it again only when the content changes.
+	struct StaticBatch
+	{
+		StaticBatch() {};
+
+		//feel free to delete this lines but you probably don't want to copy the batch from a place to another
+		StaticBatch(StaticBatch &other) = delete;
+		StaticBatch operator=(StaticBatch &other) = delete;
+
+		void begin(Renderer2D &renderer);
+		void end(Renderer2D &renderer);
+
+		//Draws immediately, like flush, so flush the renderer first if the batch has to be drawn on top.
+		//If camera is not null it is used instead of the cameras used while recording.
+		//An empty frameBuffer means the default fbo of the renderer.
+		//If it was recorded with Renderer2D::opaquePass it has to be drawn into a frame buffer with a depth buffer.
+		void draw(Renderer2D &renderer, const Camera *camera = nullptr, FrameBuffer frameBuffer = {});
+
+		bool empty() { return quads.empty(); }
+
+		void cleanup();
+
+		GLuint buffer = 0;
+		size_t instancesOffset = 0;
+		size_t vertexQuadCount = 0;
+		size_t opaqueQuads = 0; //the first quads, recorded with Renderer2D::opaquePass
+		bool recording = false;
+
+		std::vector<Renderer2D::QuadInfo> quads;
+		std::vector<Renderer2D::CameraBatch> cameraBatches;
+		std::vector<Renderer2D::TextureBatch> textureBatches;
+		std::vector<GLuint> batchTextures;
+		std::vector<ShaderProgram> shaders;
+
+		//the draw data of the renderer while recording
+		struct
+		{
+			std::vector<Renderer2DVertex> vertices;
+			std::vector<Renderer2DInstance> instances;
+			std::vector<Renderer2D::QuadInfo> quads;
+			std::vector<Renderer2D::CameraBatch> cameraBatches;
+			std::vector<unsigned long long> sortKeys;
+			std::vector<ShaderProgram> sortShaders;
+			bool culling = false;
+		}saved;
 	};
 
 	void enableNecessaryGLFeatures();
 
+	//The library remembers the gl state it set (bound program, vao, textures, fbo, viewport, blend state)
+	//and skips the calls that wouldn't change it, it also doesn't restore the old bindings after drawing.
+	//Call this after changing the gl state yourself or using another library that does.
+	void invalidateGLStateCache();
+
+#pragma endregion
+
+#pragma region FrameCapture
+
+	//Records everything a Renderer2D draws (flushes, static batches, clears, post process passes
+	//and textures drawn to the entire screen) so it can be saved to a file and replayed without the game.
+	//The quads are stored after batching, textures are stored once by content hash,
+	//shaders by their source and frame buffers by size with their content from when they were first used.
+	//Not recorded: uniforms set by the user on custom shaders, frame buffers cleared or textures changed
+	//outside the renderer after they were first used and the gl state set by the user.
+	struct FrameCapture
+	{
+		FrameCapture() {};
+
+		//feel free to delete this lines but you probably don't want to copy the capture from a place to another
+		FrameCapture(FrameCapture &other) = delete;
+		FrameCapture operator=(FrameCapture &other) = delete;
+
+		//starts recording what the renderer draws, the data of the last capture is cleared
+		void begin(Renderer2D &renderer);
+
+		//stops recording, if fileName is not null the capture is written to it. Returns false on fail
+		bool end(Renderer2D &renderer, const char *fileName = nullptr);
+
+		bool writeToFile(const char *fileName);
+
+		//the gl resources of the last replay are cleared. Returns false on fail
+		bool loadFromFile(const char *fileName);
+
+		//Draws the recorded frame again with this renderer, the default fbo of the renderer is used
+		//for everything drawn to the default fbo. The frame buffers are reset to their captured content first
+		//so every replay draws the same thing. The gl resources are created by the first replay.
+		void replay(Renderer2D &renderer);
+
+		//clears the data and the gl resources created by replay
+		void cleanup();
+
+		bool capturing() { return renderer != nullptr; }
+
+		enum CommandType
+		{
+			commandClear = 0,		//frameBuffer, color
+			commandQuads,			//a flush or a static batch draw
+			commandPostProcess,		//shader, texture, frameBuffer
+			commandTextureToScreen,	//shader, texture, frameBuffer
+		};
+
+		struct Command
+		{
+			int type = commandClear;
+			int frameBuffer = -1; //index in frameBuffers, -1 is the default fbo
+			int shader = -1; //index in shaders
+			int texture = -1; //index in textures
+			glm::vec4 color = {};
+
+			//commandQuads, the textures and shaders are indexes in the capture,
+			//the vertices and instances already have their texture slots set
+			int windowW = 0;
+			int windowH = 0;
+			bool hasOverrideCamera = false;
+			Camera overrideCamera = {};
+			std::vector<Renderer2DVertex> vertices;
+			std::vector<Renderer2DInstance> instances;
+			std::vector<Renderer2D::QuadInfo> quads;
+			std::vector<Renderer2D::CameraBatch> cameraBatches;
+			std::vector<Renderer2D::TextureBatch> textureBatches;
+			std::vector<GLuint> batchTextures;
+			std::vector<int> shaders; //the shaders used by the texture batches
+			size_t opaqueQuads = 0; //drawn with the opaque pass, the frame buffer needs a depth buffer
+
+			//internal use, the gl ids of the textures and shaders when replaying
+			std::vector<GLuint> replayBatchTextures;
+			std::vector<ShaderProgram> replayShaders;
+		};
+
+		struct CapturedTexture
+		{
+			unsigned long long hash = 0;
+			int width = 0;
+			int height = 0;
+			bool pixelated = false;
+			bool mipMaps = false;
+			int frameBuffer = -1; //if it is the texture of a captured frame buffer
+			std::vector<unsigned char> data; //RGBA
+
+			Texture replayTexture = {};
+		};
+
+		struct CapturedFrameBuffer
+		{
+			int texture = -1;
+
+			GLuint capturedId = 0;
+			FrameBuffer replayFrameBuffer = {};
+		};
+
+		struct CapturedShader
+		{
+			std::string vertex;
+			std::string fragment;
+
+			GLuint capturedId = 0;
+			ShaderProgram replayShader = {};
+		};
+
+		int windowW = 0; //the window metrics of the renderer when the capture started
+		int windowH = 0;
+		std::vector<Command> commands;
+		std::vector<CapturedTexture> textures;
+		std::vector<CapturedFrameBuffer> frameBuffers;
+		std::vector<CapturedShader> shaders;
+
+		//internal use
+		Renderer2D *renderer = nullptr;
+		std::vector<std::pair<GLuint, int>> textureIds; //the captured texture ids and their index in textures
+		bool replayResourcesCreated = false;
+		void createReplayResources();
+		int addTexture(GLuint id);
+		int addFrameBuffer(GLuint fbo);
+		int addShader(GLuint id);
+	};
+
+#pragma endregion
+
+#pragma region GpuProfiler
+
+	//Measures the gpu time of the zones with timestamp queries.
+	//The queries are read a few frames later, only when they are ready, so the cpu never waits for the gpu.
+	//The renderer already has zones for the flushes, the post process and the particles,
+	//use GL2D_GPU_ZONE("name") to add your own. Zones can be nested.
+	struct GpuProfiler
+	{
+		//nothing is measured until it is enabled
+		bool enabled = false;
+
+		//how many frames are kept for each zone
+		size_t historySize = 240;
+
+		//how many frames the results can be late, if they aren't ready by then they are dropped
+		static constexpr int latency = 4;
+
+		//the times are in milliseconds, the time of a zone in a frame is the sum of all its calls
+		struct ZoneStats
+		{
+			std::string name;
+			size_t frames = 0;
+			float averageCalls = 0;
+			float averageMs = 0;
+			float minMs = 0;
+			float maxMs = 0;
+			float p50Ms = 0;
+			float p95Ms = 0;
+			float p99Ms = 0;
+		};
+
+		//returns false if nothing is measured, then endZone must not be called
+		bool beginZone(const char *name);
+		void endZone();
+
+		//call once every frame, usually after swapping the buffers. It reads the finished frames.
+		void endFrame();
+
+		std::vector<ZoneStats> getZoneStats();
+
+		//returns empty stats if there is no zone with this name
+		ZoneStats getZoneStats(const char *name);
+
+		//clears the measured times and keeps the zones
+		void reset();
+
+		void cleanup();
+
+		//internal use
+		struct Zone
+		{
+			std::string name;
+			std::vector<float> framesMs; //ring buffer
+			std::vector<unsigned short> framesCalls;
+			size_t next = 0;
+			size_t count = 0;
+		};
+		std::vector<Zone> zones;
+
+		struct PendingZone
+		{
+			GLuint begin = 0;
+			GLuint end = 0;
+			int zone = 0;
+		};
+		std::vector<PendingZone> frames[latency];
+		int currentFrame = 0;
+		std::vector<int> openZones; //indexes in the pending zones of the current frame
+		std::vector<GLuint> freeQueries;
+		size_t droppedFrames = 0;
+
+		int findZone(const char *name);
+		GLuint getQuery();
+		void readFrame(int frame);
+	};
+
+	//the profiler used by the renderer and GL2D_GPU_ZONE
+	GpuProfiler &getGpuProfiler();
+
+	struct GpuZone
+	{
+		GpuZone(const char *name) { active = getGpuProfiler().beginZone(name); }
+		~GpuZone() { if (active) { getGpuProfiler().endZone(); } }
+
+		GpuZone(GpuZone &other) = delete;
+		GpuZone operator=(GpuZone &other) = delete;
+
+		bool active = false;
+	};
+
 #pragma endregion
 
 
@@ -0,0 +1,29 @@
+#pragma once
+#include "gl2d.h"
+
+namespace gl2d
+{
+
+	///////////////////// Headless /////////////////////
+#pragma region Headless
+
+	//Creates an opengl context without a window or a display using EGL
+	//(the surfaceless platform first so it works with mesa llvmpipe on machines without a gpu)
+	//and loads opengl with glad. Call gl2d::init after it.
+	//Returns false on fail, error gets the reason if it isn't null.
+	bool createHeadlessContext(const char **error = nullptr, int glMajor = 3, int glMinor = 3);
+
+	void destroyHeadlessContext();
+
+	//creates the frame buffer and a renderer that draws into it by default,
+	//the window metrics of the renderer are set to the size of the frame buffer.
+	//depth adds a depth buffer to the frame buffer, needed by Renderer2D::opaquePass
+	void createHeadlessRenderer(Renderer2D &renderer, FrameBuffer &frameBuffer, int w, int h, size_t quadCount = 1'000,
+		bool depth = false);
+
+	//reads the frame buffer, RGBA with the rows from top to bottom
+	std::vector<unsigned char> readHeadlessFrameBuffer(FrameBuffer &frameBuffer);
+
+#pragma endregion
+
+};
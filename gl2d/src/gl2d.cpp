@@ -1,5 +1,5 @@
 /////////////////////////////////////////////////////////////////
-//gl2d.cpp				1.6.1
+//gl2d.cpp				1.7.0
 //Copyright(c) 2020 - 2024 Luta Vlad
 //https://github.com/meemknight/gl2d
 // 
@@ -66,6 +66,33 @@
 // 1.6.1
 // trying to fix some text stuff
 // 
+// 1.7.0
+// interleaved packed vertex format, one vbo for the renderer
+// indexed quad rendering, 4 vertices per quad
+// the camera is applied in the vertex shader, flushWithCamera
+// instanced rendering mode
+// persistent mapped streaming ring buffer for the vertex uploads
+// texture slot batching, different textures can be drawn in the same draw call
+// deferredSorting with layers, the quads are radix sorted by layer, shader and texture
+// DynamicAtlas, packs images into shared textures at runtime
+// StaticBatch, records quads once into a gpu buffer and draws them every frame
+// optional conservative view culling for the quads, with culled / drawn counters
+// CommandRecorder, records quads without gl on any thread, submitted to the renderer
+// reserveQuads and QuadWriter, text, 9 patches and outlines write their quads without capacity checks
+// simd batched quad transform (sse4.1, avx2, neon) chosen at runtime, GL2D_SIMD is enabled on linux too
+// specialised quad kernels for rotation, uniform color and default texture coordonates
+// Renderer2D::Stats, per frame counters, batch break reasons and cpu timings with a history dumpable to csv
+// GpuProfiler, timestamp query zones read without stalling, GL2D_GPU_ZONE
+// gl state cache, redundant binds, viewport and blend state changes are skipped, invalidateGLStateCache
+// the texture size, format, mip levels and memory size are stored on Texture, GetSize doesn't query gl
+// TextureManager, gpu memory budget with least recently used eviction and lazy loading with a placeholder
+// headless EGL context (gl2dHeadless), the post process functions use the default fbo of the renderer for an empty frame buffer
+// gl2dBench, renderer throughput for the main workloads as json
+// FrameCapture, records what a renderer draws in a frame to a file, gl2dReplay replays it on a headless context
+// opaquePass, opaque quads are drawn first from front to back with depth writes and without blending, FrameBuffer can have a depth buffer
+// renderCircle, renderRing and renderRoundedRect, one quad each with a signed distance function in the default shader
+// renderPolyline with miter and bevel joins and square caps, one quad for each segment. Lines, rectangle and circle outlines use it
+// 
 ////////////////////////////////////////////////////////////////////////
 
 
@@ -89,6 +116,38 @@
 #include <sstream>
 #include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+
+#if GL2D_SIMD
+	#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__)
+		#define GL2D_SIMD_X86 1
+		#include <immintrin.h>
+		#ifdef _MSC_VER
+			#include <intrin.h>
+		#endif
+	#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+		#define GL2D_SIMD_NEON 1
+		#include <arm_neon.h>
+	#endif
+#endif
+
+#ifndef GL2D_SIMD_X86
+#define GL2D_SIMD_X86 0
+#endif
+
+#ifndef GL2D_SIMD_NEON
+#define GL2D_SIMD_NEON 0
+#endif
+
+//gcc and clang need the instruction set of a function if it is not enabled for the whole file
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GL2D_TARGET(x)
+#else
+#define GL2D_TARGET(x) __attribute__((target(x)))
+#endif
 
 //if you are not using visual studio make shure you link to "Opengl32.lib"
 #ifdef _MSC_VER
@@ -107,6 +166,7 @@ namespace gl2d
 	static ShaderProgram defaultShader = {};
 	static Camera defaultCamera{};
 	static Texture white1pxSquareTexture = {};
+	static int maxTextureSlots = 1;
 
 	static const char* defaultVertexShader =
 		GL2D_OPNEGL_SHADER_VERSION "\n"
@@ -114,14 +174,57 @@ namespace gl2d
 		"in vec2 quad_positions;\n"
 		"in vec4 quad_colors;\n"
 		"in vec2 texturePositions;\n"
+		"in vec4 instance_rect;\n"
+		"in vec2 instance_origin;\n"
+		"in float instance_rotation;\n"
+		"in vec4 instance_color;\n"
+		"in vec4 instance_textureCoords;\n"
+		"in uint quad_textureSlot;\n"
+		"in uint instance_textureSlot;\n"
+		"in uvec3 quad_depth;\n"
+		"in uvec3 instance_depth;\n"
+		"uniform mat3 u_viewProjection;\n"
+		"uniform bool u_instanced;\n"
+		"uniform float u_depthScale;\n"
 		"out vec4 v_color;\n"
 		"out vec2 v_texture;\n"
 		"out vec2 v_positions;\n"
+		"out vec2 v_shapePosition;\n"
+		"flat out vec2 v_shapeParameters;\n"
+		"flat out int v_textureSlot;\n"
+		"flat out int v_shape;\n"
 		"void main()\n"
 		"{\n"
-		"	gl_Position = vec4(quad_positions, 0, 1);\n"
+		"	vec2 position = quad_positions;\n"
 		"	v_color = quad_colors;\n"
 		"	v_texture = texturePositions;\n"
+		"	v_textureSlot = int(quad_textureSlot & 15u);\n"
+		"	v_shape = int(quad_textureSlot >> 4);\n"
+		//the shapes store their parameters in the texture coordonates, the corner comes from the index (4 for each quad)
+		"	int vertex = gl_VertexID & 3;\n"
+		"	v_shapePosition = vec2(vertex >> 1, (vertex ^ (vertex >> 1)) & 1) * 2.0 - 1.0;\n"
+		"	v_shapeParameters = texturePositions;\n"
+		"	uvec3 depth = quad_depth;\n"
+		"	if (u_instanced)\n"
+		"	{\n"
+		"		vec2 corner = vec2(gl_VertexID >> 1, gl_VertexID & 1);\n"
+		"		position = instance_rect.xy + corner * instance_rect.zw;\n"
+		"		float s = sin(instance_rotation);\n"
+		"		float c = cos(instance_rotation);\n"
+		"		vec2 d = position - instance_origin;\n"
+		"		position = instance_origin + vec2(c * d.x + s * d.y, -s * d.x + c * d.y);\n"
+		"		v_color = instance_color;\n"
+		"		v_texture = mix(instance_textureCoords.xy, instance_textureCoords.zw, corner);\n"
+		"		v_textureSlot = int(instance_textureSlot & 15u);\n"
+		"		v_shape = int(instance_textureSlot >> 4);\n"
+		"		v_shapePosition = corner * 2.0 - 1.0;\n"
+		"		v_shapeParameters = instance_textureCoords.xy;\n"
+		"		depth = instance_depth;\n"
+		"	}\n"
+		//the opaque pass, later quads are closer. u_depthScale is 0 when it isn't used
+		"	float z = 0.0;\n"
+		"	if (u_depthScale > 0.0) { z = 1.0 - float(depth.x | (depth.y << 8) | (depth.z << 16)) * u_depthScale; }\n"
+		"	gl_Position = vec4((u_viewProjection * vec3(position, 1)).xy, z, 1);\n"
 		"	v_positions = gl_Position.xy;\n"
 		"}\n";
 
@@ -131,12 +234,64 @@ namespace gl2d
 		"out vec4 color;\n"
 		"in vec4 v_color;\n"
 		"in vec2 v_texture;\n"
-		"uniform sampler2D u_sampler;\n"
+		"in vec2 v_shapePosition;\n"
+		"flat in vec2 v_shapeParameters;\n"
+		"flat in int v_textureSlot;\n"
+		"flat in int v_shape;\n"
+		"uniform sampler2D u_textures[16];\n"
+		//the coverage of the shapes (1 circle, 2 ring, 3 rounded rectangle), p goes from -1 to 1 across the quad.
+		//The distances are converted to pixels with the derivatives of p so the edge is anti-aliased at any size
+		"float shapeCoverage(vec2 p, vec2 dx, vec2 dy)\n"
+		"{\n"
+		"	if (v_shape == 3)\n"
+		"	{\n"
+		"		vec2 halfSize = 1.0 / vec2(length(vec2(dx.x, dy.x)), length(vec2(dx.y, dy.y)));\n"
+		"		float radius = v_shapeParameters.x * min(halfSize.x, halfSize.y);\n"
+		"		vec2 e = abs(p * halfSize) - halfSize + radius;\n"
+		"		float d = length(max(e, 0.0)) + min(max(e.x, e.y), 0.0) - radius;\n"
+		"		return clamp(0.5 - d, 0.0, 1.0);\n"
+		"	}\n"
+		"	float r = length(p);\n"
+		"	vec2 n = p / max(r, 0.0001);\n"
+		"	float pixel = max(length(vec2(dot(n, dx), dot(n, dy))), 0.0001);\n"
+		"	float coverage = clamp(0.5 - (r - 1.0) / pixel, 0.0, 1.0);\n"
+		"	if (v_shape == 2) { coverage *= clamp(0.5 - (v_shapeParameters.x - r) / pixel, 0.0, 1.0); }\n"
+		"	return coverage;\n"
+		"}\n"
 		"void main()\n"
 		"{\n"
-		"    color = v_color * texture2D(u_sampler, v_texture);\n"
+		//the sampler array can only be indexed with constants in glsl 330,
+		//the derivatives are computed outside the branches so the mipmaps are still right
+		"	vec2 dx = dFdx(v_texture);\n"
+		"	vec2 dy = dFdy(v_texture);\n"
+		"	vec4 t = vec4(1);\n"
+		"	switch (v_textureSlot)\n"
+		"	{\n"
+		"		case 0: t = textureGrad(u_textures[0], v_texture, dx, dy); break;\n"
+		"		case 1: t = textureGrad(u_textures[1], v_texture, dx, dy); break;\n"
+		"		case 2: t = textureGrad(u_textures[2], v_texture, dx, dy); break;\n"
+		"		case 3: t = textureGrad(u_textures[3], v_texture, dx, dy); break;\n"
+		"		case 4: t = textureGrad(u_textures[4], v_texture, dx, dy); break;\n"
+		"		case 5: t = textureGrad(u_textures[5], v_texture, dx, dy); break;\n"
+		"		case 6: t = textureGrad(u_textures[6], v_texture, dx, dy); break;\n"
+		"		case 7: t = textureGrad(u_textures[7], v_texture, dx, dy); break;\n"
+		"		case 8: t = textureGrad(u_textures[8], v_texture, dx, dy); break;\n"
+		"		case 9: t = textureGrad(u_textures[9], v_texture, dx, dy); break;\n"
+		"		case 10: t = textureGrad(u_textures[10], v_texture, dx, dy); break;\n"
+		"		case 11: t = textureGrad(u_textures[11], v_texture, dx, dy); break;\n"
+		"		case 12: t = textureGrad(u_textures[12], v_texture, dx, dy); break;\n"
+		"		case 13: t = textureGrad(u_textures[13], v_texture, dx, dy); break;\n"
+		"		case 14: t = textureGrad(u_textures[14], v_texture, dx, dy); break;\n"
+		"		case 15: t = textureGrad(u_textures[15], v_texture, dx, dy); break;\n"
+		"	}\n"
+		"	color = v_color * t;\n"
+		"	vec2 sx = dFdx(v_shapePosition);\n"
+		"	vec2 sy = dFdy(v_shapePosition);\n"
+		"	if (v_shape != 0) { color.a *= shapeCoverage(v_shapePosition, sx, sy); }\n"
 		"}\n";
 
+	static_assert(GL2D_MAX_TEXTURE_SLOTS <= 16, "the default fragment shader has 16 texture slots");
+
 	static const char *defaultVertexPostProcessShader =
 		GL2D_OPNEGL_SHADER_VERSION "\n"
 		GL2D_OPNEGL_SHADER_PRECISION "\n"
@@ -176,6 +331,175 @@ namespace gl2d
 
 	namespace internal
 	{
+		//the gl state set by the library, the calls that wouldn't change it are skipped.
+		//unknownState means the library doesn't know what is bound, the next call is never skipped
+		constexpr GLuint unknownState = ~0u;
+
+		struct GLStateCache
+		{
+			GLuint program = unknownState;
+			GLuint vertexArray = unknownState;
+			GLuint frameBuffer = unknownState;
+			int activeTextureUnit = -1;
+			GLuint textures[GL2D_MAX_TEXTURE_SLOTS] = {};
+			glm::ivec4 viewport = {-1, -1, -1, -1};
+			bool blendState = false;
+			std::vector<GLuint> samplerPrograms; //programs that already have u_sampler set to 0
+			std::vector<std::pair<GLuint, bool>> depthFrameBuffers; //frame buffers checked for a depth buffer
+
+			GLStateCache() { invalidate(); }
+
+			void invalidate()
+			{
+				program = unknownState;
+				vertexArray = unknownState;
+				frameBuffer = unknownState;
+				activeTextureUnit = -1;
+				for (auto &t : textures) { t = unknownState; }
+				viewport = {-1, -1, -1, -1};
+				blendState = false;
+				samplerPrograms.clear();
+				depthFrameBuffers.clear();
+			}
+		}glState;
+
+		void useProgram(GLuint program)
+		{
+			if (glState.program == program) { return; }
+			glState.program = program;
+			glUseProgram(program);
+		}
+
+		void bindVertexArray(GLuint vertexArray)
+		{
+			if (glState.vertexArray == vertexArray) { return; }
+			glState.vertexArray = vertexArray;
+			glBindVertexArray(vertexArray);
+		}
+
+		void bindFrameBuffer(GLuint frameBuffer)
+		{
+			if (glState.frameBuffer == frameBuffer) { return; }
+			glState.frameBuffer = frameBuffer;
+			glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+		}
+
+		void setViewport(int x, int y, int w, int h)
+		{
+			const glm::ivec4 viewport = {x, y, w, h};
+			if (glState.viewport == viewport) { return; }
+			glState.viewport = viewport;
+			glViewport(x, y, w, h);
+		}
+
+		void activeTexture(int unit)
+		{
+			if (glState.activeTextureUnit == unit) { return; }
+			glState.activeTextureUnit = unit;
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+
+		//the textures are bound to the unit 0 before they are changed.
+		//returns false if the texture was already bound
+		bool bindTexture(int unit, GLuint texture)
+		{
+			if (unit >= GL2D_MAX_TEXTURE_SLOTS)
+			{
+				activeTexture(unit);
+				glBindTexture(GL_TEXTURE_2D, texture);
+				return true;
+			}
+
+			if (glState.textures[unit] == texture) { return false; }
+
+			activeTexture(unit);
+			glState.textures[unit] = texture;
+			glBindTexture(GL_TEXTURE_2D, texture);
+			return true;
+		}
+
+		//so a texture isn't bound while it is drawn into
+		void unbindTexture(GLuint texture)
+		{
+			if (!texture) { return; }
+
+			for (int i = 0; i < GL2D_MAX_TEXTURE_SLOTS; i++)
+			{
+				if (glState.textures[i] == texture || glState.textures[i] == unknownState)
+				{
+					bindTexture(i, 0);
+				}
+			}
+		}
+
+		//the program has to be bound
+		void setSamplerUniform(const ShaderProgram &shader)
+		{
+			for (auto p : glState.samplerPrograms)
+			{
+				if (p == shader.id) { return; }
+			}
+
+			glState.samplerPrograms.push_back(shader.id);
+			glUniform1i(shader.u_sampler, 0);
+		}
+
+		//gl unbinds the deleted objects and can give their names to new objects
+		void forgetTexture(GLuint texture)
+		{
+			for (auto &t : glState.textures)
+			{
+				if (t == texture) { t = 0; }
+			}
+		}
+
+		void forgetFrameBuffer(GLuint frameBuffer)
+		{
+			if (glState.frameBuffer == frameBuffer) { glState.frameBuffer = 0; }
+
+			auto &depth = glState.depthFrameBuffers;
+			depth.erase(std::remove_if(depth.begin(), depth.end(),
+				[&](const std::pair<GLuint, bool> &f) { return f.first == frameBuffer; }), depth.end());
+		}
+
+		//needed by the opaque pass, it is queried once for every frame buffer
+		bool frameBufferHasDepth(GLuint frameBuffer)
+		{
+			for (auto &f : glState.depthFrameBuffers)
+			{
+				if (f.first == frameBuffer) { return f.second; }
+			}
+
+			//the default frame buffer names its depth buffer differently
+			const GLenum attachment = frameBuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+
+			bindFrameBuffer(frameBuffer);
+			GLint type = GL_NONE;
+			GLint bits = 0;
+			glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+			if (type != GL_NONE)
+			{
+				glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &bits);
+			}
+
+			glState.depthFrameBuffers.push_back({frameBuffer, bits > 0});
+			return bits > 0;
+		}
+
+		void forgetVertexArray(GLuint vertexArray)
+		{
+			if (glState.vertexArray == vertexArray) { glState.vertexArray = 0; }
+		}
+
+		void forgetProgram(GLuint program)
+		{
+			//a deleted program stays in use until another one is used
+			if (glState.program == program) { glState.program = unknownState; }
+
+			auto &p = glState.samplerPrograms;
+			p.erase(std::remove(p.begin(), p.end(), program), p.end());
+		}
+
 		float positionToScreenCoordsX(const float position, float w)
 		{
 			return (position / w) * 2 - 1;
@@ -210,6 +534,335 @@ namespace gl2d
 			return glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1};
 		}
 
+		glm::mat3 computeViewProjection(const Camera &c, float windowW, float windowH)
+		{
+			//flip y, rotate and zoom around the center of the screen, than scale to (-1, 1)
+			const float a = glm::radians(c.rotation);
+			const float s = sinf(a);
+			const float co = cosf(a);
+
+			const float sx = 2.f * c.zoom / windowW;
+			const float sy = 2.f * c.zoom / windowH;
+
+			glm::mat2 linear;
+			linear[0] = glm::vec2{co * sx, s * sy};
+			linear[1] = glm::vec2{s * sx, -co * sy};
+
+			const glm::vec2 translation = -(linear * (c.position + glm::vec2{windowW / 2.f, windowH / 2.f}));
+
+			glm::mat3 m;
+			m[0] = glm::vec3(linear[0], 0);
+			m[1] = glm::vec3(linear[1], 0);
+			m[2] = glm::vec3(translation, 1);
+			return m;
+		}
+
+		//the world bounding box (min x, min y, max x, max y) of the screen corners seen by this camera
+		glm::vec4 computeViewBounds(const Camera &c, float windowW, float windowH)
+		{
+			const glm::mat3 inverse = glm::inverse(computeViewProjection(c, windowW, windowH));
+
+			glm::vec2 minPos = glm::vec2(inverse * glm::vec3(-1, -1, 1));
+			glm::vec2 maxPos = minPos;
+			const glm::vec2 corners[3] = {{1, -1}, {1, 1}, {-1, 1}};
+			for (auto corner : corners)
+			{
+				const glm::vec2 p = glm::vec2(inverse * glm::vec3(corner, 1));
+				minPos = glm::min(minPos, p);
+				maxPos = glm::max(maxPos, p);
+			}
+
+			return {minPos, maxPos};
+		}
+
+		inline bool sameCamera(const Camera &a, const Camera &b)
+		{
+			return a.position == b.position && a.rotation == b.rotation && a.zoom == b.zoom;
+		}
+
+		inline GLubyte packColorComponent(float c)
+		{
+			return (GLubyte)(glm::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+		}
+
+		inline GLushort packTextureCoord(float c)
+		{
+			return (GLushort)(glm::clamp(c, 0.f, 1.f) * 65535.f + 0.5f);
+		}
+
+		inline void setVertex(Renderer2DVertex &v, const GLubyte color[4], GLushort u, GLushort t)
+		{
+			v.color[0] = color[0];
+			v.color[1] = color[1];
+			v.color[2] = color[2];
+			v.color[3] = color[3];
+			v.texturePosition[0] = u;
+			v.texturePosition[1] = t;
+		}
+
+		//the shapes drawn by the default fragment shader are stored in the high bits of the texture slot
+		enum Shape : GLubyte
+		{
+			shapeNone = 0,
+			shapeCircle = 1 << 4,
+			shapeRing = 2 << 4,
+			shapeRoundedRect = 3 << 4,
+		};
+		constexpr GLubyte shapeMask = 0xF0;
+
+		//for QuadInfo::opaque, the texture has to be opaque too
+		inline bool opaqueVertices(const Renderer2DVertex *v)
+		{
+			return (v[0].color[3] & v[1].color[3] & v[2].color[3] & v[3].color[3]) == 255;
+		}
+
+		inline void setDepth(GLubyte depth[3], size_t index)
+		{
+			depth[0] = (GLubyte)(index & 0xFF);
+			depth[1] = (GLubyte)((index >> 8) & 0xFF);
+			depth[2] = (GLubyte)((index >> 16) & 0xFF);
+		}
+
+		constexpr unsigned long long sortIndexMask = 0xFFFFFF;
+
+		//layer (16 bits) | shader (8 bits) | texture id (16 bits) | submission index (24 bits)
+		inline unsigned long long makeSortKey(int layer, int shader, GLuint texture, size_t index)
+		{
+			const unsigned long long l = (unsigned long long)(glm::clamp(layer, -32768, 32767) + 32768);
+			return (l << 48) | ((unsigned long long)(shader & 0xFF) << 40) |
+				((unsigned long long)(texture & 0xFFFF) << 24) | (index & sortIndexMask);
+		}
+
+		inline int sortKeyShader(unsigned long long key)
+		{
+			return (int)((key >> 40) & 0xFF);
+		}
+
+		//the index of the current shader in sortShaders, it is added if missing
+		int currentSortShader(gl2d::CommandRecorder &renderer)
+		{
+			int shader = -1;
+			for (int i = (int)renderer.sortShaders.size() - 1; i >= 0; i--)
+			{
+				if (renderer.sortShaders[i].id == renderer.currentShader.id)
+				{
+					shader = i;
+					break;
+				}
+			}
+
+			if (shader < 0)
+			{
+				if (renderer.sortShaders.size() >= 256)
+				{
+					errorFunc("More than 256 shaders used in one flush with deferredSorting", userDefinedData);
+					shader = 255;
+				}
+				else
+				{
+					shader = (int)renderer.sortShaders.size();
+					renderer.sortShaders.push_back(renderer.currentShader);
+				}
+			}
+
+			return shader;
+		}
+
+		//call after the quad was added
+		void recordSortKey(gl2d::CommandRecorder &renderer, GLuint texture)
+		{
+			renderer.sortKeys.push_back(makeSortKey(renderer.currentLayer, currentSortShader(renderer), texture,
+				renderer.spriteQuads.size() - 1));
+		}
+
+		//seconds from an arbitrary point, used for the stats
+		double statsClock()
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		//counts a draw call, the reason is ignored for the first draw call of a frame
+		void countDrawCall(gl2d::Renderer2D &renderer, int reason, size_t quads)
+		{
+			auto &stats = renderer.stats;
+
+			if (stats.drawCalls)
+			{
+				stats.batchBreaks[reason]++;
+			}
+
+			stats.drawCalls++;
+			stats.quads += quads;
+			stats.vertices += quads * 4;
+		}
+
+		//adds a camera batch if the camera or the window metrics changed, returns true if one was added
+		bool updateCameraBatch(gl2d::CommandRecorder &renderer)
+		{
+			auto &batches = renderer.cameraBatches;
+
+			if (batches.empty())
+			{
+				renderer.recordingStart = statsClock();
+			}
+
+			if (batches.empty() ||
+				!sameCamera(batches.back().camera, renderer.currentCamera) ||
+				batches.back().windowW != renderer.windowW || batches.back().windowH != renderer.windowH)
+			{
+				gl2d::CommandRecorder::CameraBatch batch;
+				batch.camera = renderer.currentCamera;
+				batch.windowW = renderer.windowW;
+				batch.windowH = renderer.windowH;
+				batch.firstQuad = renderer.spriteQuads.size();
+				batches.push_back(batch);
+				return true;
+			}
+
+			return false;
+		}
+
+		//returns true if the box (min, max) is outside the view of the current camera
+		bool cullBounds(gl2d::CommandRecorder &renderer, glm::vec2 min, glm::vec2 max)
+		{
+			auto &view = renderer.cullingView;
+			if (view.windowW != renderer.windowW || view.windowH != renderer.windowH ||
+				!sameCamera(view.camera, renderer.currentCamera))
+			{
+				view.camera = renderer.currentCamera;
+				view.windowW = renderer.windowW;
+				view.windowH = renderer.windowH;
+				view.bounds = computeViewBounds(renderer.currentCamera, (float)renderer.windowW, (float)renderer.windowH);
+			}
+
+			if (max.x < view.bounds.x || min.x > view.bounds.z ||
+				max.y < view.bounds.y || min.y > view.bounds.w)
+			{
+				renderer.culledQuads++;
+				return true;
+			}
+
+			renderer.drawnQuads++;
+			return false;
+		}
+
+		//returns true if the quad is outside the view of the current camera, origin is absolute.
+		//This is done before the camera batch is added so culled quads don't leave empty batches
+		bool cullQuad(gl2d::CommandRecorder &renderer, const Rect &transforms, glm::vec2 origin, float rotation)
+		{
+			glm::vec2 center = {transforms.x + transforms.z / 2.f, transforms.y + transforms.w / 2.f};
+			glm::vec2 halfSize = glm::abs(glm::vec2{transforms.z, transforms.w}) / 2.f;
+
+			if (rotation != 0)
+			{
+				const float a = glm::radians(std::fmod(rotation, 360.f));
+				const float s = sinf(a);
+				const float c = cosf(a);
+
+				const glm::vec2 d = center - origin;
+				center = origin + glm::vec2{c * d.x + s * d.y, -s * d.x + c * d.y};
+				halfSize = {std::abs(c) * halfSize.x + std::abs(s) * halfSize.y,
+					std::abs(s) * halfSize.x + std::abs(c) * halfSize.y};
+			}
+
+			return cullBounds(renderer, center - halfSize, center + halfSize);
+		}
+
+		//the reference for transformQuads, it only writes the positions
+		inline void transformQuadScalar(const Rect &transforms, glm::vec2 origin, float rotation, Renderer2DVertex *v)
+		{
+			glm::vec2 v1 = { transforms.x,				  transforms.y };
+			glm::vec2 v2 = { transforms.x,				  transforms.y + transforms.w };
+			glm::vec2 v3 = { transforms.x + transforms.z, transforms.y + transforms.w };
+			glm::vec2 v4 = { transforms.x + transforms.z, transforms.y };
+
+			//Apply rotations
+			if (rotation != 0)
+			{
+				//whole turns are removed in degrees where it is exact, like the simd versions do
+				const float a = glm::radians(std::fmod(rotation, 360.f));
+				const float s = sinf(a);
+				const float c = cosf(a);
+
+				//y goes down so this rotates the same way as rotateAroundPoint on the flipped coordonates
+				auto rotate = [&](glm::vec2 v)
+				{
+					const glm::vec2 d = v - origin;
+					return origin + glm::vec2{c * d.x + s * d.y, -s * d.x + c * d.y};
+				};
+
+				v1 = rotate(v1);
+				v2 = rotate(v2);
+				v3 = rotate(v3);
+				v4 = rotate(v4);
+			}
+
+			v[0].position = v1;
+			v[1].position = v2;
+			v[2].position = v3;
+			v[3].position = v4;
+		}
+
+		//Specialised quad kernels, the common ui and tile case (not rotated, one color, default texture coordonates)
+		//is only the corner positions and copies. The camera doesn't matter here, it is applied in the vertex shader.
+		template<bool Rotated, bool UniformColor, bool DefaultTextureCoords>
+		inline void emitQuad(Renderer2DVertex *v, const Rect &transforms, const Color4f colors[4],
+			glm::vec2 origin, float rotation, const glm::vec4 &textureCoords)
+		{
+			if (Rotated)
+			{
+				transformQuadScalar(transforms, origin, rotation, v);
+			}
+			else
+			{
+				v[0].position = {transforms.x, transforms.y};
+				v[1].position = {transforms.x, transforms.y + transforms.w};
+				v[2].position = {transforms.x + transforms.z, transforms.y + transforms.w};
+				v[3].position = {transforms.x + transforms.z, transforms.y};
+			}
+
+			GLubyte c[4][4];
+			for (int i = 0; i < (UniformColor ? 1 : 4); i++)
+			{
+				c[i][0] = packColorComponent(colors[i].r);
+				c[i][1] = packColorComponent(colors[i].g);
+				c[i][2] = packColorComponent(colors[i].b);
+				c[i][3] = packColorComponent(colors[i].a);
+			}
+
+			//GL2D_DefaultTextureCoords is {0, 1, 1, 0}
+			const GLushort u0 = DefaultTextureCoords ? 0 : packTextureCoord(textureCoords.x);
+			const GLushort t0 = DefaultTextureCoords ? 65535 : packTextureCoord(textureCoords.y);
+			const GLushort u1 = DefaultTextureCoords ? 65535 : packTextureCoord(textureCoords.z);
+			const GLushort t1 = DefaultTextureCoords ? 0 : packTextureCoord(textureCoords.w);
+
+			setVertex(v[0], c[0], u0, t0);
+			setVertex(v[1], c[UniformColor ? 0 : 1], u0, t1);
+			setVertex(v[2], c[UniformColor ? 0 : 2], u1, t1);
+			setVertex(v[3], c[UniformColor ? 0 : 3], u1, t0);
+		}
+
+		//the vertices are kept in world space, the camera is applied in the vertex shader
+		void writeQuadVertices(Renderer2DVertex *v, const Rect &transforms, const Color4f colors[4],
+			glm::vec2 origin, float rotation, const glm::vec4 &textureCoords)
+		{
+			const bool rotated = rotation != 0;
+			const bool uniformColor = colors[0] == colors[1] && colors[0] == colors[2] && colors[0] == colors[3];
+			const bool defaultTextureCoords = textureCoords == GL2D_DefaultTextureCoords;
+
+			switch ((int)rotated | ((int)uniformColor << 1) | ((int)defaultTextureCoords << 2))
+			{
+			case 0: emitQuad<false, false, false>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 1: emitQuad<true, false, false>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 2: emitQuad<false, true, false>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 3: emitQuad<true, true, false>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 4: emitQuad<false, false, true>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 5: emitQuad<true, false, true>(v, transforms, colors, origin, rotation, textureCoords); break;
+			case 6: emitQuad<false, true, true>(v, transforms, colors, origin, rotation, textureCoords); break;
+			default: emitQuad<true, true, true>(v, transforms, colors, origin, rotation, textureCoords); break;
+			}
+		}
+
 		GLuint loadShader(const char* source, GLenum shaderType)
 		{
 			GLuint id = glCreateShader(shaderType);
@@ -288,6 +941,14 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 		extensions.wglSwapIntervalEXT = (PFNWGLSWAPINTERVALEXTPROC)wglGetProcAddress("wglSwapIntervalEXT");
 	#endif
 
+		{
+			GLint units = 0;
+			glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+			maxTextureSlots = std::max(1, std::min(units, GL2D_MAX_TEXTURE_SLOTS));
+		}
+
+		internal::glState.invalidate();
+
 		defaultShader = createShaderProgram(defaultVertexShader, defaultFragmentShader);
 		white1pxSquareTexture.create1PxSquare();
 
@@ -298,6 +959,8 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 	{
 		white1pxSquareTexture.cleanup();
 		defaultShader.clear();
+		getGpuProfiler().cleanup();
+		internal::glState.invalidate();
 		hasInitialized = false;
 	}
 
@@ -380,6 +1043,15 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 		glBindAttribLocation(shader.id, 0, "quad_positions");
 		glBindAttribLocation(shader.id, 1, "quad_colors");
 		glBindAttribLocation(shader.id, 2, "texturePositions");
+		glBindAttribLocation(shader.id, 3, "instance_rect");
+		glBindAttribLocation(shader.id, 4, "instance_origin");
+		glBindAttribLocation(shader.id, 5, "instance_rotation");
+		glBindAttribLocation(shader.id, 6, "instance_color");
+		glBindAttribLocation(shader.id, 7, "instance_textureCoords");
+		glBindAttribLocation(shader.id, 8, "quad_textureSlot");
+		glBindAttribLocation(shader.id, 9, "instance_textureSlot");
+		glBindAttribLocation(shader.id, 10, "quad_depth");
+		glBindAttribLocation(shader.id, 11, "instance_depth");
 
 		glLinkProgram(shader.id);
 
@@ -389,10 +1061,37 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 		validateProgram(shader.id);
 
 		shader.u_sampler = glGetUniformLocation(shader.id, "u_sampler");
+		shader.u_viewProjection = glGetUniformLocation(shader.id, "u_viewProjection");
+		shader.u_instanced = glGetUniformLocation(shader.id, "u_instanced");
+		shader.u_textures = glGetUniformLocation(shader.id, "u_textures");
+		shader.u_depthScale = glGetUniformLocation(shader.id, "u_depthScale");
+
+		//the slots are always bound to the same texture units
+		if (shader.u_textures >= 0)
+		{
+			GLint units[GL2D_MAX_TEXTURE_SLOTS] = {};
+			for (int i = 0; i < GL2D_MAX_TEXTURE_SLOTS; i++) { units[i] = i; }
+
+			internal::useProgram(shader.id);
+			glUniform1iv(shader.u_textures, GL2D_MAX_TEXTURE_SLOTS, units);
+			internal::useProgram(0);
+		}
 
 		return shader;
 	}
 
+	void ShaderProgram::bind()
+	{
+		internal::useProgram(id);
+	}
+
+	void ShaderProgram::clear()
+	{
+		internal::forgetProgram(id);
+		glDeleteProgram(id);
+		*this = {};
+	}
+
 	ShaderProgram createShaderFromFile(const char *filePath)
 	{
 		std::ifstream fileFont(filePath, std::ios::binary);
@@ -536,8 +1235,9 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 		//Init texture
 		{
 			glGenTextures(1, &texture.id);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			internal::bindTexture(0, texture.id);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, fontRgbaBuffer);
+			texture.setMetadata(size.x, size.y, GL_RGBA8, false);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
@@ -601,1773 +1301,5442 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 
 #pragma endregion
 
-	///////////////////// Renderer2D /////////////////////
-#pragma region Renderer2D
+	///////////////////// SIMD /////////////////////
+#pragma region simd
 
-	//won't bind any fbo
-	void internalFlush(gl2d::Renderer2D &renderer, bool clearDrawData)
+	//The quads are transformed 4 (or 8) at a time, one quad in each lane.
+	//sin and cos are computed together with the cephes polynomials (the same as sse_mathfun),
+	//quads with 0 rotation keep the exact positions like in the scalar code.
+	//Whole turns are removed from the rotation in degrees before it is converted to radians, this is exact
+	//(the same as the fmod in the scalar code) for rotations up to about 10^8 degrees, past that the result is wrong.
+	namespace simd
 	{
-		enableNecessaryGLFeatures();
-
-		if (!hasInitialized)
+		constexpr float toRadians = 3.14159265358979323846f / 180.f;
+		constexpr float fourOverPi = 1.27323954473516f;
+		constexpr float dp1 = -0.78515625f;
+		constexpr float dp2 = -2.4187564849853515625e-4f;
+		constexpr float dp3 = -3.77489497744594108e-8f;
+		constexpr float sinP0 = -1.9515295891E-4f;
+		constexpr float sinP1 = 8.3321608736E-3f;
+		constexpr float sinP2 = -1.6666654611E-1f;
+		constexpr float cosP0 = 2.443315711809948E-005f;
+		constexpr float cosP1 = -1.388731625493765E-003f;
+		constexpr float cosP2 = 4.166664568298827E-002f;
+
+		void transformQuadsScalar(const Rect *rects, const glm::vec2 *origins, const float *rotations,
+			size_t count, Renderer2DVertex *v)
 		{
-			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
-			renderer.clearDrawData();
-			return;
+			for (size_t i = 0; i < count; i++)
+			{
+				internal::transformQuadScalar(rects[i], origins[i], rotations[i], v + i * 4);
+			}
 		}
 
-		if (!renderer.vao)
-		{
-			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
-			renderer.clearDrawData();
-			return;
-		}
+	#if GL2D_SIMD_X86
 
-		if (renderer.windowH == 0 || renderer.windowW == 0)
+		//writes the 4 positions of 4 quads, vertex k of quad i is at v[i * 4 + k]
+		inline void storeQuadPositions(Renderer2DVertex *v,
+			__m128 v1x, __m128 v1y, __m128 v2x, __m128 v2y,
+			__m128 v3x, __m128 v3y, __m128 v4x, __m128 v4y)
 		{
-			if (clearDrawData)
+			const __m128 x[4] = {v1x, v2x, v3x, v4x};
+			const __m128 y[4] = {v1y, v2y, v3y, v4y};
+
+			for (int k = 0; k < 4; k++)
 			{
-				renderer.clearDrawData();
+				const __m128 lo = _mm_unpacklo_ps(x[k], y[k]); //quad 0, quad 1
+				const __m128 hi = _mm_unpackhi_ps(x[k], y[k]); //quad 2, quad 3
+				_mm_storel_pi((__m64 *)&v[0 + k].position, lo);
+				_mm_storeh_pi((__m64 *)&v[4 + k].position, lo);
+				_mm_storel_pi((__m64 *)&v[8 + k].position, hi);
+				_mm_storeh_pi((__m64 *)&v[12 + k].position, hi);
 			}
+		}
 
-			return;
+		//loads 4 rects and origins as one component for each lane
+		inline void loadQuads(const Rect *rects, const glm::vec2 *origins,
+			__m128 &x, __m128 &y, __m128 &w, __m128 &h, __m128 &ox, __m128 &oy)
+		{
+			x = _mm_loadu_ps(&rects[0].x);
+			y = _mm_loadu_ps(&rects[1].x);
+			w = _mm_loadu_ps(&rects[2].x);
+			h = _mm_loadu_ps(&rects[3].x);
+			_MM_TRANSPOSE4_PS(x, y, w, h);
+
+			const __m128 o01 = _mm_loadu_ps(&origins[0].x);
+			const __m128 o23 = _mm_loadu_ps(&origins[2].x);
+			ox = _mm_shuffle_ps(o01, o23, _MM_SHUFFLE(2, 0, 2, 0));
+			oy = _mm_shuffle_ps(o01, o23, _MM_SHUFFLE(3, 1, 3, 1));
 		}
 
-		if (renderer.windowH < 0 || renderer.windowW < 0)
+		GL2D_TARGET("sse4.1")
+		inline void sinCosSSE41(__m128 x, __m128 &outSin, __m128 &outCos)
 		{
-			if (clearDrawData)
+			const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+
+			__m128 signSin = _mm_and_ps(x, signMask);
+			x = _mm_andnot_ps(signMask, x);
+
+			__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(fourOverPi)));
+			j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+			const __m128 y = _mm_cvtepi32_ps(j);
+
+			const __m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+			const __m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+			const __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(
+				_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+			signSin = _mm_xor_ps(signSin, swapSignSin);
+
+			x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(dp1)));
+			x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(dp2)));
+			x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(dp3)));
+			const __m128 z = _mm_mul_ps(x, x);
+
+			__m128 c = _mm_set1_ps(cosP0);
+			c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(cosP1));
+			c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(cosP2));
+			c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+			c = _mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+			c = _mm_add_ps(c, _mm_set1_ps(1.f));
+
+			__m128 s = _mm_set1_ps(sinP0);
+			s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(sinP1));
+			s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(sinP2));
+			s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+			outSin = _mm_xor_ps(_mm_blendv_ps(c, s, polyMask), signSin);
+			outCos = _mm_xor_ps(_mm_blendv_ps(s, c, polyMask), signCos);
+		}
+
+		GL2D_TARGET("sse4.1")
+		void transformQuadsSSE41(const Rect *rects, const glm::vec2 *origins, const float *rotations,
+			size_t count, Renderer2DVertex *v)
+		{
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
 			{
-				renderer.clearDrawData();
+				__m128 x, y, w, h, ox, oy;
+				loadQuads(rects + i, origins + i, x, y, w, h, ox, oy);
+
+				const __m128 rotation = _mm_loadu_ps(rotations + i);
+				const __m128 turns = _mm_round_ps(_mm_mul_ps(rotation, _mm_set1_ps(1.f / 360.f)),
+					_MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+				const __m128 reduced = _mm_sub_ps(rotation, _mm_mul_ps(turns, _mm_set1_ps(360.f)));
+				__m128 s, c;
+				sinCosSSE41(_mm_mul_ps(reduced, _mm_set1_ps(toRadians)), s, c);
+
+				const __m128 x1 = _mm_add_ps(x, w);
+				const __m128 y1 = _mm_add_ps(y, h);
+				const __m128 dx0 = _mm_sub_ps(x, ox);
+				const __m128 dx1 = _mm_sub_ps(x1, ox);
+				const __m128 dy0 = _mm_sub_ps(y, oy);
+				const __m128 dy1 = _mm_sub_ps(y1, oy);
+
+				const __m128 cdx0 = _mm_mul_ps(c, dx0), cdx1 = _mm_mul_ps(c, dx1);
+				const __m128 sdx0 = _mm_mul_ps(s, dx0), sdx1 = _mm_mul_ps(s, dx1);
+				const __m128 cdy0 = _mm_mul_ps(c, dy0), cdy1 = _mm_mul_ps(c, dy1);
+				const __m128 sdy0 = _mm_mul_ps(s, dy0), sdy1 = _mm_mul_ps(s, dy1);
+
+				const __m128 noRotation = _mm_cmpeq_ps(rotation, _mm_setzero_ps());
+
+				storeQuadPositions(v + i * 4,
+					_mm_blendv_ps(_mm_add_ps(ox, _mm_add_ps(cdx0, sdy0)), x, noRotation),
+					_mm_blendv_ps(_mm_add_ps(oy, _mm_sub_ps(cdy0, sdx0)), y, noRotation),
+					_mm_blendv_ps(_mm_add_ps(ox, _mm_add_ps(cdx0, sdy1)), x, noRotation),
+					_mm_blendv_ps(_mm_add_ps(oy, _mm_sub_ps(cdy1, sdx0)), y1, noRotation),
+					_mm_blendv_ps(_mm_add_ps(ox, _mm_add_ps(cdx1, sdy1)), x1, noRotation),
+					_mm_blendv_ps(_mm_add_ps(oy, _mm_sub_ps(cdy1, sdx1)), y1, noRotation),
+					_mm_blendv_ps(_mm_add_ps(ox, _mm_add_ps(cdx1, sdy0)), x1, noRotation),
+					_mm_blendv_ps(_mm_add_ps(oy, _mm_sub_ps(cdy0, sdx1)), y, noRotation));
 			}
 
-			errorFunc("Negative windowW or windowH, have you forgotten to call updateWindowMetrics(w, h)?", userDefinedData);
+			transformQuadsScalar(rects + i, origins + i, rotations + i, count - i, v + i * 4);
+		}
 
-			return;
+		GL2D_TARGET("avx2,fma")
+		inline void sinCosAVX2(__m256 x, __m256 &outSin, __m256 &outCos)
+		{
+			const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+
+			__m256 signSin = _mm256_and_ps(x, signMask);
+			x = _mm256_andnot_ps(signMask, x);
+
+			__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(fourOverPi)));
+			j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+			const __m256 y = _mm256_cvtepi32_ps(j);
+
+			const __m256 swapSignSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+			const __m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+			const __m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(
+				_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+			signSin = _mm256_xor_ps(signSin, swapSignSin);
+
+			x = _mm256_fmadd_ps(y, _mm256_set1_ps(dp1), x);
+			x = _mm256_fmadd_ps(y, _mm256_set1_ps(dp2), x);
+			x = _mm256_fmadd_ps(y, _mm256_set1_ps(dp3), x);
+			const __m256 z = _mm256_mul_ps(x, x);
+
+			__m256 c = _mm256_set1_ps(cosP0);
+			c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(cosP1));
+			c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(cosP2));
+			c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+			c = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), c);
+			c = _mm256_add_ps(c, _mm256_set1_ps(1.f));
+
+			__m256 s = _mm256_set1_ps(sinP0);
+			s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(sinP1));
+			s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(sinP2));
+			s = _mm256_fmadd_ps(_mm256_mul_ps(s, z), x, x);
+
+			outSin = _mm256_xor_ps(_mm256_blendv_ps(c, s, polyMask), signSin);
+			outCos = _mm256_xor_ps(_mm256_blendv_ps(s, c, polyMask), signCos);
 		}
 
-		if(renderer.spriteTextures.empty())
+		GL2D_TARGET("avx2,fma")
+		inline __m256 combine(__m128 lo, __m128 hi)
 		{
-			return;
+			return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
 		}
 
-		glViewport(0, 0, renderer.windowW, renderer.windowH);
-
-		glBindVertexArray(renderer.vao);
-
-		glUseProgram(renderer.currentShader.id);
+		GL2D_TARGET("avx2,fma")
+		void transformQuadsAVX2(const Rect *rects, const glm::vec2 *origins, const float *rotations,
+			size_t count, Renderer2DVertex *v)
+		{
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m128 xl, yl, wl, hl, oxl, oyl;
+				__m128 xh, yh, wh, hh, oxh, oyh;
+				loadQuads(rects + i, origins + i, xl, yl, wl, hl, oxl, oyl);
+				loadQuads(rects + i + 4, origins + i + 4, xh, yh, wh, hh, oxh, oyh);
+
+				const __m256 x = combine(xl, xh);
+				const __m256 y = combine(yl, yh);
+				const __m256 ox = combine(oxl, oxh);
+				const __m256 oy = combine(oyl, oyh);
+
+				const __m256 rotation = _mm256_loadu_ps(rotations + i);
+				const __m256 turns = _mm256_round_ps(_mm256_mul_ps(rotation, _mm256_set1_ps(1.f / 360.f)),
+					_MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+				const __m256 reduced = _mm256_fnmadd_ps(turns, _mm256_set1_ps(360.f), rotation);
+				__m256 s, c;
+				sinCosAVX2(_mm256_mul_ps(reduced, _mm256_set1_ps(toRadians)), s, c);
+
+				const __m256 x1 = _mm256_add_ps(x, combine(wl, wh));
+				const __m256 y1 = _mm256_add_ps(y, combine(hl, hh));
+				const __m256 dx0 = _mm256_sub_ps(x, ox);
+				const __m256 dx1 = _mm256_sub_ps(x1, ox);
+				const __m256 dy0 = _mm256_sub_ps(y, oy);
+				const __m256 dy1 = _mm256_sub_ps(y1, oy);
+
+				const __m256 cdx0 = _mm256_mul_ps(c, dx0), cdx1 = _mm256_mul_ps(c, dx1);
+				const __m256 sdx0 = _mm256_mul_ps(s, dx0), sdx1 = _mm256_mul_ps(s, dx1);
+				const __m256 cdy0 = _mm256_mul_ps(c, dy0), cdy1 = _mm256_mul_ps(c, dy1);
+				const __m256 sdy0 = _mm256_mul_ps(s, dy0), sdy1 = _mm256_mul_ps(s, dy1);
+
+				const __m256 noRotation = _mm256_cmp_ps(rotation, _mm256_setzero_ps(), _CMP_EQ_OQ);
+
+				const __m256 p[8] =
+				{
+					_mm256_blendv_ps(_mm256_add_ps(ox, _mm256_add_ps(cdx0, sdy0)), x, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(oy, _mm256_sub_ps(cdy0, sdx0)), y, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(ox, _mm256_add_ps(cdx0, sdy1)), x, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(oy, _mm256_sub_ps(cdy1, sdx0)), y1, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(ox, _mm256_add_ps(cdx1, sdy1)), x1, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(oy, _mm256_sub_ps(cdy1, sdx1)), y1, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(ox, _mm256_add_ps(cdx1, sdy0)), x1, noRotation),
+					_mm256_blendv_ps(_mm256_add_ps(oy, _mm256_sub_ps(cdy0, sdx1)), y, noRotation),
+				};
 
-		glUniform1i(renderer.currentShader.u_sampler, 0);
+				storeQuadPositions(v + i * 4,
+					_mm256_castps256_ps128(p[0]), _mm256_castps256_ps128(p[1]),
+					_mm256_castps256_ps128(p[2]), _mm256_castps256_ps128(p[3]),
+					_mm256_castps256_ps128(p[4]), _mm256_castps256_ps128(p[5]),
+					_mm256_castps256_ps128(p[6]), _mm256_castps256_ps128(p[7]));
+
+				storeQuadPositions(v + (i + 4) * 4,
+					_mm256_extractf128_ps(p[0], 1), _mm256_extractf128_ps(p[1], 1),
+					_mm256_extractf128_ps(p[2], 1), _mm256_extractf128_ps(p[3], 1),
+					_mm256_extractf128_ps(p[4], 1), _mm256_extractf128_ps(p[5], 1),
+					_mm256_extractf128_ps(p[6], 1), _mm256_extractf128_ps(p[7], 1));
+			}
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::quadPositions]);
-		glBufferData(GL_ARRAY_BUFFER, renderer.spritePositions.size() * sizeof(glm::vec2), renderer.spritePositions.data(), GL_STREAM_DRAW);
+			transformQuadsSSE41(rects + i, origins + i, rotations + i, count - i, v + i * 4);
+		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::quadColors]);
-		glBufferData(GL_ARRAY_BUFFER, renderer.spriteColors.size() * sizeof(glm::vec4), renderer.spriteColors.data(), GL_STREAM_DRAW);
+	#endif
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::texturePositions]);
-		glBufferData(GL_ARRAY_BUFFER, renderer.texturePositions.size() * sizeof(glm::vec2), renderer.texturePositions.data(), GL_STREAM_DRAW);
+	#if GL2D_SIMD_NEON
 
-		//Instance render the textures
+		inline void sinCosNEON(float32x4_t x, float32x4_t &outSin, float32x4_t &outCos)
 		{
-			const int size = renderer.spriteTextures.size();
-			int pos = 0;
-			unsigned int id = renderer.spriteTextures[0].id;
-
-			renderer.spriteTextures[0].bind();
+			const uint32x4_t signMask = vdupq_n_u32(0x80000000);
+
+			uint32x4_t signSin = vandq_u32(vreinterpretq_u32_f32(x), signMask);
+			x = vabsq_f32(x);
+
+			int32x4_t j = vcvtq_s32_f32(vmulq_n_f32(x, fourOverPi));
+			j = vandq_s32(vaddq_s32(j, vdupq_n_s32(1)), vdupq_n_s32(~1));
+			const float32x4_t y = vcvtq_f32_s32(j);
+
+			const uint32x4_t swapSignSin = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(j, vdupq_n_s32(4))), 29);
+			const uint32x4_t polyMask = vceqq_s32(vandq_s32(j, vdupq_n_s32(2)), vdupq_n_s32(0));
+			const uint32x4_t signCos = vshlq_n_u32(vreinterpretq_u32_s32(
+				vbicq_s32(vdupq_n_s32(4), vsubq_s32(j, vdupq_n_s32(2)))), 29);
+			signSin = veorq_u32(signSin, swapSignSin);
+
+			x = vmlaq_n_f32(x, y, dp1);
+			x = vmlaq_n_f32(x, y, dp2);
+			x = vmlaq_n_f32(x, y, dp3);
+			const float32x4_t z = vmulq_f32(x, x);
+
+			float32x4_t c = vdupq_n_f32(cosP0);
+			c = vmlaq_f32(vdupq_n_f32(cosP1), c, z);
+			c = vmlaq_f32(vdupq_n_f32(cosP2), c, z);
+			c = vmulq_f32(vmulq_f32(c, z), z);
+			c = vmlsq_n_f32(c, z, 0.5f);
+			c = vaddq_f32(c, vdupq_n_f32(1.f));
+
+			float32x4_t s = vdupq_n_f32(sinP0);
+			s = vmlaq_f32(vdupq_n_f32(sinP1), s, z);
+			s = vmlaq_f32(vdupq_n_f32(sinP2), s, z);
+			s = vmlaq_f32(x, vmulq_f32(s, z), x);
+
+			outSin = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(polyMask, s, c)), signSin));
+			outCos = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(polyMask, c, s)), signCos));
+		}
 
-			for (int i = 1; i < size; i++)
+		void transformQuadsNEON(const Rect *rects, const glm::vec2 *origins, const float *rotations,
+			size_t count, Renderer2DVertex *v)
+		{
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
 			{
-				if (renderer.spriteTextures[i].id != id)
+				const float32x4x4_t r = vld4q_f32(&rects[i].x);
+				const float32x4x2_t o = vld2q_f32(&origins[i].x);
+				const float32x4_t x = r.val[0], y = r.val[1];
+				const float32x4_t ox = o.val[0], oy = o.val[1];
+
+				const float32x4_t rotation = vld1q_f32(rotations + i);
+				const float32x4_t turns = vcvtq_f32_s32(vcvtq_s32_f32(vmulq_n_f32(rotation, 1.f / 360.f)));
+				const float32x4_t reduced = vmlsq_n_f32(rotation, turns, 360.f);
+				float32x4_t s, c;
+				sinCosNEON(vmulq_n_f32(reduced, toRadians), s, c);
+
+				const float32x4_t x1 = vaddq_f32(x, r.val[2]);
+				const float32x4_t y1 = vaddq_f32(y, r.val[3]);
+				const float32x4_t dx0 = vsubq_f32(x, ox);
+				const float32x4_t dx1 = vsubq_f32(x1, ox);
+				const float32x4_t dy0 = vsubq_f32(y, oy);
+				const float32x4_t dy1 = vsubq_f32(y1, oy);
+
+				const float32x4_t cdx0 = vmulq_f32(c, dx0), cdx1 = vmulq_f32(c, dx1);
+				const float32x4_t sdx0 = vmulq_f32(s, dx0), sdx1 = vmulq_f32(s, dx1);
+				const float32x4_t cdy0 = vmulq_f32(c, dy0), cdy1 = vmulq_f32(c, dy1);
+				const float32x4_t sdy0 = vmulq_f32(s, dy0), sdy1 = vmulq_f32(s, dy1);
+
+				const uint32x4_t noRotation = vceqq_f32(rotation, vdupq_n_f32(0));
+
+				const float32x4_t px[4] =
 				{
-					glDrawArrays(GL_TRIANGLES, pos * 6, 6 * (i - pos));
+					vbslq_f32(noRotation, x, vaddq_f32(ox, vaddq_f32(cdx0, sdy0))),
+					vbslq_f32(noRotation, x, vaddq_f32(ox, vaddq_f32(cdx0, sdy1))),
+					vbslq_f32(noRotation, x1, vaddq_f32(ox, vaddq_f32(cdx1, sdy1))),
+					vbslq_f32(noRotation, x1, vaddq_f32(ox, vaddq_f32(cdx1, sdy0))),
+				};
 
-					pos = i;
-					id = renderer.spriteTextures[i].id;
+				const float32x4_t py[4] =
+				{
+					vbslq_f32(noRotation, y, vaddq_f32(oy, vsubq_f32(cdy0, sdx0))),
+					vbslq_f32(noRotation, y1, vaddq_f32(oy, vsubq_f32(cdy1, sdx0))),
+					vbslq_f32(noRotation, y1, vaddq_f32(oy, vsubq_f32(cdy1, sdx1))),
+					vbslq_f32(noRotation, y, vaddq_f32(oy, vsubq_f32(cdy0, sdx1))),
+				};
 
-					renderer.spriteTextures[i].bind();
+				Renderer2DVertex *quad = v + i * 4;
+				for (int k = 0; k < 4; k++)
+				{
+					const float32x4x2_t p = vzipq_f32(px[k], py[k]);
+					vst1_f32(&quad[0 + k].position.x, vget_low_f32(p.val[0]));
+					vst1_f32(&quad[4 + k].position.x, vget_high_f32(p.val[0]));
+					vst1_f32(&quad[8 + k].position.x, vget_low_f32(p.val[1]));
+					vst1_f32(&quad[12 + k].position.x, vget_high_f32(p.val[1]));
 				}
-
 			}
 
-			glDrawArrays(GL_TRIANGLES, pos * 6, 6 * (size - pos));
-
-			glBindVertexArray(0);
+			transformQuadsScalar(rects + i, origins + i, rotations + i, count - i, v + i * 4);
 		}
 
-		if (clearDrawData) 
+	#endif
+
+		SimdLevel detectSimdLevel()
 		{
-			renderer.clearDrawData();
+		#if GL2D_SIMD_X86
+
+			bool sse41 = false;
+			bool avx2 = false;
+
+		#if defined(_MSC_VER) && !defined(__clang__)
+			int info[4] = {};
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			sse41 = (info[2] & (1 << 19)) != 0;
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+
+			//the os has to save the ymm registers
+			if (maxLeaf >= 7 && fma && osxsave && avx && (_xgetbv(0) & 6) == 6)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+		#else
+			__builtin_cpu_init();
+			sse41 = __builtin_cpu_supports("sse4.1");
+			avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		#endif
+
+			if (avx2) { return simdAVX2; }
+			if (sse41) { return simdSSE41; }
+
+		#elif GL2D_SIMD_NEON
+			return simdNEON;
+		#endif
+
+			return simdScalar;
 		}
+
+		const SimdLevel supportedLevel = detectSimdLevel();
+		SimdLevel currentLevel = supportedLevel;
 	}
 
-	void gl2d::Renderer2D::flush(bool clearDrawData)
+	SimdLevel getSimdLevel()
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
-		internalFlush(*this, clearDrawData);
+		return simd::currentLevel;
 	}
 
-	void Renderer2D::flushFBO(FrameBuffer frameBuffer, bool clearDrawData)
+	SimdLevel setSimdLevel(SimdLevel level)
 	{
-		if (frameBuffer.fbo == 0) 
-		{
-			errorFunc("Framebuffer not initialized", userDefinedData);
-			return;
-		}
-
-		glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.fbo);
-		glBindTexture(GL_TEXTURE_2D, 0); //todo investigate and remove
+		const bool supported = level == simdScalar || level == simd::supportedLevel ||
+			(level == simdSSE41 && simd::supportedLevel == simdAVX2);
 
-		internalFlush(*this, clearDrawData);
-
-		glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
+		simd::currentLevel = supported ? level : simd::supportedLevel;
+		return simd::currentLevel;
 	}
 
-	void Renderer2D::renderFrameBufferToTheEntireScreen(gl2d::FrameBuffer fbo, gl2d::FrameBuffer screen)
+	void transformQuads(const Rect *rects, const glm::vec2 *origins, const float *rotationsDegrees,
+		size_t count, Renderer2DVertex *vertices)
 	{
-		renderTextureToTheEntireScreen(fbo.texture, screen);
+		switch (simd::currentLevel)
+		{
+		#if GL2D_SIMD_X86
+		case simdSSE41:
+		simd::transformQuadsSSE41(rects, origins, rotationsDegrees, count, vertices);
+		break;
+		case simdAVX2:
+		simd::transformQuadsAVX2(rects, origins, rotationsDegrees, count, vertices);
+		break;
+		#endif
+		#if GL2D_SIMD_NEON
+		case simdNEON:
+		simd::transformQuadsNEON(rects, origins, rotationsDegrees, count, vertices);
+		break;
+		#endif
+		default:
+		simd::transformQuadsScalar(rects, origins, rotationsDegrees, count, vertices);
+		break;
+		}
 	}
 
-	//doesn't bind or unbind stuff, except the vertex array,
-	//doesn't set the viewport
-	void renderQuadToScreenInternal(gl2d::Renderer2D &renderer)
-	{
-		static float positions[12] = {
-		-1, 1,
-		-1, -1,
-		1, 1,
-
-		1, 1,
-		-1, -1,
-		1, -1,};
-
-		//not used
-		static float colors[6 * 4] = {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,};
-		static float texCoords[12] = {
-			0, 1,
-			0, 0,
-			1, 1,
-
-			1, 1,
-			0, 0,
-			1, 0,
-		};
-
-
-		glBindVertexArray(renderer.vao);
+#pragma endregion
 
+	///////////////////// Renderer2D /////////////////////
+#pragma region Renderer2D
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::quadPositions]);
-		glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec2), positions, GL_STREAM_DRAW);
+	//the index buffer is static, every quad uses the same 6 indices pattern.
+	//The vao has to be bound.
+	void ensureIndexBufferCapacity(gl2d::Renderer2D &renderer, size_t quadCount)
+	{
+		if (quadCount <= renderer.indexBufferQuadCapacity)
+		{
+			return;
+		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::quadColors]);
-		glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec4), colors, GL_STREAM_DRAW);
+		size_t newCapacity = std::max<size_t>(renderer.indexBufferQuadCapacity * 2, quadCount);
 
-		glBindBuffer(GL_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::texturePositions]);
-		glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec2), texCoords, GL_STREAM_DRAW);
+		std::vector<GLuint> indices;
+		indices.resize(newCapacity * 6);
 
+		for (size_t i = 0; i < newCapacity; i++)
 		{
-			glDrawArrays(GL_TRIANGLES, 0, 6);
+			GLuint v = (GLuint)(i * 4);
+			indices[i * 6 + 0] = v + 0; //1
+			indices[i * 6 + 1] = v + 1; //2
+			indices[i * 6 + 2] = v + 3; //4
+			indices[i * 6 + 3] = v + 1; //2
+			indices[i * 6 + 4] = v + 2; //3
+			indices[i * 6 + 5] = v + 3; //4
 		}
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.buffers[Renderer2DBufferType::quadIndices]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+		renderer.indexBufferQuadCapacity = newCapacity;
+		renderer.stats.bytesUploaded += indices.size() * sizeof(GLuint);
 	}
 
-	void Renderer2D::renderTextureToTheEntireScreen(gl2d::Texture t, gl2d::FrameBuffer screen)
+	void Renderer2DStreamBuffer::create(size_t size)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, screen.fbo);
+		cleanup();
 
-		enableNecessaryGLFeatures();
+		this->size = size;
 
-		if (!hasInitialized)
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		if (glBufferStorage)
 		{
-			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
-			return;
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+			persistentData = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
 		}
+	}
 
-		if (!vao)
+	void Renderer2DStreamBuffer::ensureCapacity(size_t dataSize)
+	{
+		if (dataSize > size)
 		{
-			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
-			return;
+			create(std::max(dataSize * 2, size * 2));
 		}
+	}
 
-		if (!currentShader.id)
+	size_t Renderer2DStreamBuffer::upload(const void *data, size_t dataSize)
+	{
+		size_t unused = 0;
+		return upload(data, dataSize, nullptr, 0, unused);
+	}
+
+	size_t Renderer2DStreamBuffer::upload(const void *first, size_t firstSize,
+		const void *second, size_t secondSize, size_t &secondOffset)
+	{
+		//keep every region aligned so the attribute offsets are valid
+		const size_t alignedFirst = (firstSize + 63) & ~(size_t)63;
+		const size_t alignedSecond = (secondSize + 63) & ~(size_t)63;
+		const size_t alignedSize = alignedFirst + alignedSecond;
+
+		ensureCapacity(alignedSize);
+
+		//both blocks are in one region so the second one can't wrap onto the first one
+		if (cursor + alignedSize > size)
 		{
-			errorFunc("Post Process Shader not created.", userDefinedData);
-			return;
+			cursor = 0;
 		}
 
-		glm::ivec2 size = {windowW, windowH};
+		const size_t begin = cursor;
+		const size_t end = cursor + alignedSize;
 
-		if (screen.fbo) 
+		//wait for the gpu to finish with the regions that will be overwritten
+		for (size_t i = 0; i < lockedRegions.size();)
 		{
-			size = screen.texture.GetSize();
+			auto &region = lockedRegions[i];
+
+			if (region.begin < end && begin < region.end)
+			{
+				GLenum result = 0;
+				do
+				{
+					result = glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+				} while (result == GL_TIMEOUT_EXPIRED);
+
+				glDeleteSync(region.fence);
+				lockedRegions.erase(lockedRegions.begin() + i);
+			}
+			else
+			{
+				i++;
+			}
 		}
-		if (size.x == 0 || size.y == 0)
+
+		char *mapped = nullptr;
+		if (persistentData)
 		{
-			return;
+			mapped = persistentData + begin;
+		}
+		else
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			mapped = (char *)glMapBufferRange(GL_ARRAY_BUFFER, begin, alignedSize,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
 		}
 
-		glViewport(0, 0, size.x, size.y);
+		if (firstSize) { memcpy(mapped, first, firstSize); }
+		if (secondSize) { memcpy(mapped + alignedFirst, second, secondSize); }
 
-		glUseProgram(currentShader.id);
-		glUniform1i(currentShader.u_sampler, 0);
-		t.bind();
+		if (!persistentData)
+		{
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
 
-		renderQuadToScreenInternal(*this);
+		cursor = end;
+		secondOffset = begin + alignedFirst;
 
-		glBindVertexArray(0);
+		return begin;
+	}
+
+	void Renderer2DStreamBuffer::lockRegion(size_t offset, size_t dataSize)
+	{
+		if (!dataSize) { return; }
 
+		LockedRegion region;
+		region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region.begin = offset;
+		region.end = offset + dataSize;
+		lockedRegions.push_back(region);
 	}
 
-	void Renderer2D::flushPostProcess(const std::vector<ShaderProgram> &postProcesses,
-		FrameBuffer frameBuffer, bool clearDrawData)
+	void Renderer2DStreamBuffer::cleanup()
 	{
+		for (auto &region : lockedRegions)
+		{
+			glDeleteSync(region.fence);
+		}
 
-		if (postProcesses.empty())
+		if (buffer)
 		{
-			if (clearDrawData)
+			if (persistentData)
 			{
-				this->clearDrawData();
-				return;
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
 			}
+
+			glDeleteBuffers(1, &buffer);
 		}
 
-		if (!postProcessFbo1.fbo) { postProcessFbo1.create(0,0); }
+		*this = {};
+	}
 
-		postProcessFbo1.resize(windowW, windowH);
-		postProcessFbo1.clear();
+	//the vertex attributes are pointed at the region in the buffer (the stream buffer or a static batch).
+	//The vao has to be bound.
+	void setVertexAttributes(GLuint buffer, size_t offset)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Renderer2DVertex),
+			(void *)(offset + offsetof(Renderer2DVertex, position)));
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Renderer2DVertex),
+			(void *)(offset + offsetof(Renderer2DVertex, color)));
+		glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Renderer2DVertex),
+			(void *)(offset + offsetof(Renderer2DVertex, texturePosition)));
+		glVertexAttribIPointer(8, 1, GL_UNSIGNED_BYTE, sizeof(Renderer2DVertex),
+			(void *)(offset + offsetof(Renderer2DVertex, textureSlot)));
+		glVertexAttribIPointer(10, 3, GL_UNSIGNED_BYTE, sizeof(Renderer2DVertex),
+			(void *)(offset + offsetof(Renderer2DVertex, depth)));
+	}
 
-		flushFBO(postProcessFbo1, clearDrawData);
-		
-		internalPostProcessFlip = 1;
-		postProcessOverATexture(postProcesses, postProcessFbo1.texture, frameBuffer);
+	//uploads the vertices and the instances of one flush into the stream buffer and points the vertex attributes
+	//at the vertices, lock both regions after the draw calls. The vao has to be bound.
+	void uploadQuadData(Renderer2D &renderer, const std::vector<Renderer2DVertex> &vertices,
+		const std::vector<Renderer2DInstance> &instances, size_t &verticesOffset, size_t &instancesOffset)
+	{
+		const size_t verticesSize = vertices.size() * sizeof(Renderer2DVertex);
+		const size_t instancesSize = instances.size() * sizeof(Renderer2DInstance);
+
+		verticesOffset = renderer.streamBuffer.upload(vertices.data(), verticesSize,
+			instances.data(), instancesSize, instancesOffset);
 
+		if (verticesSize)
+		{
+			setVertexAttributes(renderer.streamBuffer.buffer, verticesOffset);
+		}
+
+		renderer.stats.bytesUploaded += verticesSize + instancesSize;
 	}
 
-	void Renderer2D::postProcessOverATexture(const std::vector<ShaderProgram> &postProcesses, 
-		gl2d::Texture in,
-		FrameBuffer frameBuffer)
+	//the instance attributes are pointed at the first instance of the run since gl 3.3 has no base instance.
+	//The instance vao has to be bound.
+	void setInstanceAttributes(GLuint buffer, size_t offset)
 	{
-		if (postProcesses.empty())
-			{return;}
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, rect)));
+		glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, origin)));
+		glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, rotation)));
+		glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, color)));
+		glVertexAttribPointer(7, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, textureCoords)));
+		glVertexAttribIPointer(9, 1, GL_UNSIGNED_BYTE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, textureSlot)));
+		glVertexAttribIPointer(11, 3, GL_UNSIGNED_BYTE, sizeof(Renderer2DInstance),
+			(void *)(offset + offsetof(Renderer2DInstance, depth)));
+	}
 
+	//reorders the quads, vertices, instances and camera batches by the sort keys
+	void sortDeferredQuads(gl2d::Renderer2D &renderer)
+	{
+		const size_t n = renderer.spriteQuads.size();
+		if (!n) { return; }
 
-		if (!postProcessFbo1.fbo) { postProcessFbo1.create(0, 0); }
-		if (!postProcessFbo2.fbo && postProcesses.size() > 1)
-			{ postProcessFbo2.create(0, 0); }
-		
-		if (internalPostProcessFlip == 0) 
+		auto &keys = renderer.sortKeys;
+		auto &scratch = renderer.sortScratch;
+
+		//lsd radix sort on the bytes above the submission index,
+		//it is stable so the submission index bits don't need to be sorted
+		scratch.keys.resize(n);
+		for (int shift = 24; shift < 64; shift += 8)
 		{
-			postProcessFbo1.resize(windowW, windowH);
-			postProcessFbo1.clear();
-			postProcessFbo2.resize(windowW, windowH);
-			postProcessFbo2.clear();
+			size_t count[256] = {};
+			for (size_t i = 0; i < n; i++) { count[(keys[i] >> shift) & 0xFF]++; }
+
+			//all the keys have the same byte here
+			if (count[(keys[0] >> shift) & 0xFF] == n) { continue; }
+
+			size_t offset = 0;
+			for (int i = 0; i < 256; i++)
+			{
+				const size_t c = count[i];
+				count[i] = offset;
+				offset += c;
+			}
+
+			for (size_t i = 0; i < n; i++) { scratch.keys[count[(keys[i] >> shift) & 0xFF]++] = keys[i]; }
+
+			keys.swap(scratch.keys);
 		}
-		else if(postProcessFbo2.fbo)
+
+		//where each quad's data and camera are before sorting
+		scratch.source.resize(n);
+		scratch.quadCamera.resize(n);
 		{
-			//postProcessFbo1 has already been resized
-			postProcessFbo2.resize(windowW, windowH);
-			postProcessFbo2.clear();
+			size_t vertexQuad = 0;
+			size_t instance = 0;
+			size_t camera = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				while (camera + 1 < renderer.cameraBatches.size() && renderer.cameraBatches[camera + 1].firstQuad <= i)
+				{
+					camera++;
+				}
+
+				scratch.quadCamera[i] = camera;
+				scratch.source[i] = renderer.spriteQuads[i].instanced ? instance++ : vertexQuad++;
+			}
 		}
 
-		for (int i = 0; i < postProcesses.size(); i++)
+		scratch.vertices.resize(renderer.spriteVertices.size());
+		scratch.instances.resize(renderer.spriteInstances.size());
+		scratch.quads.resize(n);
+		scratch.cameraBatches.clear();
+
+		size_t vertexQuad = 0;
+		size_t instance = 0;
+		for (size_t i = 0; i < n; i++)
 		{
-			gl2d::FrameBuffer output;
-			gl2d::Texture input;
+			const size_t original = keys[i] & internal::sortIndexMask;
+			const auto &quad = renderer.spriteQuads[original];
+			scratch.quads[i] = quad;
 
-			if (internalPostProcessFlip == 0)
+			if (quad.instanced)
 			{
-				input = postProcessFbo2.texture;
-				output = postProcessFbo1;
+				scratch.instances[instance++] = renderer.spriteInstances[scratch.source[original]];
 			}
 			else
 			{
-				input = postProcessFbo1.texture;
-				output = postProcessFbo2;
-			}
-
-			if (i == 0)
-			{
-				input = in;
+				memcpy(&scratch.vertices[vertexQuad * 4], &renderer.spriteVertices[scratch.source[original] * 4],
+					sizeof(Renderer2DVertex) * 4);
+				vertexQuad++;
 			}
 
-			if (i == postProcesses.size() - 1)
+			const size_t camera = scratch.quadCamera[original];
+			if (i == 0 || scratch.quadCamera[keys[i - 1] & internal::sortIndexMask] != camera)
 			{
-				output = frameBuffer;
+				auto batch = renderer.cameraBatches[camera];
+				batch.firstQuad = i;
+				scratch.cameraBatches.push_back(batch);
 			}
-			output.clear();
-			
-			renderPostProcess(postProcesses[i], input, output);
-			internalPostProcessFlip = !internalPostProcessFlip;
 		}
 
+		//the keys point to the new positions so flushing again without clearing keeps this order
+		for (size_t i = 0; i < n; i++)
+		{
+			keys[i] = (keys[i] & ~internal::sortIndexMask) | i;
+		}
 
-		internalPostProcessFlip = 0;
+		renderer.spriteVertices.swap(scratch.vertices);
+		renderer.spriteInstances.swap(scratch.instances);
+		renderer.spriteQuads.swap(scratch.quads);
+		renderer.cameraBatches.swap(scratch.cameraBatches);
 	}
 
-	void enableNecessaryGLFeatures()
+	//swaps the quads, vertices, instances, camera batches (and sort keys) with the sort scratch
+	void swapOpaqueSplit(gl2d::Renderer2D &renderer, bool sorted)
 	{
-		glEnable(GL_BLEND);
-		glDisable(GL_DEPTH_TEST);
-		glBlendEquation(GL_FUNC_ADD);
-		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		auto &scratch = renderer.sortScratch;
+		renderer.spriteVertices.swap(scratch.vertices);
+		renderer.spriteInstances.swap(scratch.instances);
+		renderer.spriteQuads.swap(scratch.quads);
+		renderer.cameraBatches.swap(scratch.cameraBatches);
+		if (sorted) { renderer.sortKeys.swap(scratch.keys); }
 	}
 
-	///////////////////// Renderer2D - render ///////////////////// 
-
-	void Renderer2D::renderRectangle(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
+	//for the opaque pass, moves the opaque quads to the front in reverse order so they are drawn from front to back,
+	//the other quads keep their order after them. Every quad gets its position before the split + 1 as depth.
+	//The old data stays in the sort scratch, swapOpaqueSplit gives it back.
+	//Returns how many quads are opaque, nothing is changed if there are none.
+	size_t splitOpaqueQuads(gl2d::Renderer2D &renderer, bool sorted)
 	{
-		glm::vec2 newOrigin;
-		newOrigin.x = origin.x + transforms.x + (transforms.z / 2);
-		newOrigin.y = origin.y + transforms.y + (transforms.w / 2);
-		renderRectangleAbsRotation(transforms, texture, colors, newOrigin, rotation, textureCoords);
-	}
+		const size_t n = renderer.spriteQuads.size();
+		auto &scratch = renderer.sortScratch;
 
-	void gl2d::Renderer2D::renderRectangleAbsRotation(const Rect transforms, 
-		const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
-	{
-		Texture textureCopy = texture;
+		if (n > 0xFFFFFF) { return 0; } //the depth has 24 bits
 
-		if (textureCopy.id == 0)
+		//every shader has to write the depth and only the default shader is known to be opaque
+		bool opaqueShaders[256] = {};
+		if (sorted)
 		{
-			errorFunc("Invalid texture", userDefinedData);
-			textureCopy = white1pxSquareTexture;
+			for (size_t i = 0; i < renderer.sortShaders.size() && i < 256; i++)
+			{
+				if (renderer.sortShaders[i].u_depthScale < 0) { return 0; }
+				opaqueShaders[i] = renderer.sortShaders[i].id == defaultShader.id;
+			}
+		}
+		else if (renderer.currentShader.id != defaultShader.id)
+		{
+			return 0;
 		}
 
-		//We need to flip texture_transforms.y
-		const float transformsY = transforms.y * -1;
+		auto isOpaque = [&](size_t i)
+		{
+			return renderer.spriteQuads[i].opaque &&
+				(!sorted || opaqueShaders[internal::sortKeyShader(renderer.sortKeys[i])]);
+		};
 
-		glm::vec2 v1 = { transforms.x,				  transformsY };
-		glm::vec2 v2 = { transforms.x,				  transformsY - transforms.w };
-		glm::vec2 v3 = { transforms.x + transforms.z, transformsY - transforms.w };
-		glm::vec2 v4 = { transforms.x + transforms.z, transformsY };
+		size_t opaqueQuads = 0;
+		for (size_t i = 0; i < n; i++) { opaqueQuads += isOpaque(i); }
+		if (!opaqueQuads) { return 0; }
 
-		//Apply rotations
-		if (rotation != 0)
+		//where each quad's data and camera are before the split
+		scratch.source.resize(n);
+		scratch.quadCamera.resize(n);
 		{
-			v1 = rotateAroundPoint(v1, origin, rotation);
-			v2 = rotateAroundPoint(v2, origin, rotation);
-			v3 = rotateAroundPoint(v3, origin, rotation);
-			v4 = rotateAroundPoint(v4, origin, rotation);
-		}
+			size_t vertexQuad = 0;
+			size_t instance = 0;
+			size_t camera = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				while (camera + 1 < renderer.cameraBatches.size() && renderer.cameraBatches[camera + 1].firstQuad <= i)
+				{
+					camera++;
+				}
 
-		//Apply camera transformations
-		v1.x -= currentCamera.position.x;
-		v1.y += currentCamera.position.y;
-		v2.x -= currentCamera.position.x;
-		v2.y += currentCamera.position.y;
-		v3.x -= currentCamera.position.x;
-		v3.y += currentCamera.position.y;
-		v4.x -= currentCamera.position.x;
-		v4.y += currentCamera.position.y;
+				scratch.quadCamera[i] = camera;
+				scratch.source[i] = renderer.spriteQuads[i].instanced ? instance++ : vertexQuad++;
+			}
+		}
 
-		//Apply camera rotation
-		if (currentCamera.rotation != 0)
+		scratch.vertices.resize(renderer.spriteVertices.size());
+		scratch.instances.resize(renderer.spriteInstances.size());
+		scratch.quads.resize(n);
+		scratch.cameraBatches.clear();
+		if (sorted) { scratch.keys.resize(n); }
+
+		size_t vertexQuad = 0;
+		size_t instance = 0;
+		size_t position = 0;
+		size_t lastCamera = 0;
+		auto moveQuad = [&](size_t original)
 		{
-			glm::vec2 cameraCenter;
+			const auto &quad = renderer.spriteQuads[original];
 
-			cameraCenter.x = windowW / 2.0f;
-			cameraCenter.y = windowH / 2.0f;
+			if (quad.instanced)
+			{
+				auto &i = scratch.instances[instance++];
+				i = renderer.spriteInstances[scratch.source[original]];
+				internal::setDepth(i.depth, original + 1);
+			}
+			else
+			{
+				Renderer2DVertex *v = &scratch.vertices[vertexQuad * 4];
+				memcpy(v, &renderer.spriteVertices[scratch.source[original] * 4], sizeof(Renderer2DVertex) * 4);
+				for (int i = 0; i < 4; i++) { internal::setDepth(v[i].depth, original + 1); }
+				vertexQuad++;
+			}
 
-			v1 = rotateAroundPoint(v1, cameraCenter, currentCamera.rotation);
-			v2 = rotateAroundPoint(v2, cameraCenter, currentCamera.rotation);
-			v3 = rotateAroundPoint(v3, cameraCenter, currentCamera.rotation);
-			v4 = rotateAroundPoint(v4, cameraCenter, currentCamera.rotation);
-		}
+			scratch.quads[position] = quad;
+			if (sorted) { scratch.keys[position] = renderer.sortKeys[original]; }
 
-		//Apply camera zoom
-		//if(renderer->currentCamera.zoom != 1)
-		{
+			const size_t camera = scratch.quadCamera[original];
+			if (position == 0 || camera != lastCamera)
+			{
+				auto batch = renderer.cameraBatches[camera];
+				batch.firstQuad = position;
+				scratch.cameraBatches.push_back(batch);
+				lastCamera = camera;
+			}
 
-			glm::vec2 cameraCenter;
-			cameraCenter.x = windowW / 2.0f;
-			cameraCenter.y = -windowH / 2.0f;
+			position++;
+		};
 
-			v1 = scaleAroundPoint(v1, cameraCenter, currentCamera.zoom);
-			v2 = scaleAroundPoint(v2, cameraCenter, currentCamera.zoom);
-			v3 = scaleAroundPoint(v3, cameraCenter, currentCamera.zoom);
-			v4 = scaleAroundPoint(v4, cameraCenter, currentCamera.zoom);
+		for (size_t i = n; i-- > 0;)
+		{
+			if (isOpaque(i)) { moveQuad(i); }
 		}
 
-		v1.x = internal::positionToScreenCoordsX(v1.x, (float)windowW);
-		v2.x = internal::positionToScreenCoordsX(v2.x, (float)windowW);
-		v3.x = internal::positionToScreenCoordsX(v3.x, (float)windowW);
-		v4.x = internal::positionToScreenCoordsX(v4.x, (float)windowW);
-		v1.y = internal::positionToScreenCoordsY(v1.y, (float)windowH);
-		v2.y = internal::positionToScreenCoordsY(v2.y, (float)windowH);
-		v3.y = internal::positionToScreenCoordsY(v3.y, (float)windowH);
-		v4.y = internal::positionToScreenCoordsY(v4.y, (float)windowH);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (!isOpaque(i)) { moveQuad(i); }
+		}
 
-		spritePositions.push_back(glm::vec2{ v1.x, v1.y });
-		spritePositions.push_back(glm::vec2{ v2.x, v2.y });
-		spritePositions.push_back(glm::vec2{ v4.x, v4.y });
+		swapOpaqueSplit(renderer, sorted);
 
-		spritePositions.push_back(glm::vec2{ v2.x, v2.y });
-		spritePositions.push_back(glm::vec2{ v3.x, v3.y });
-		spritePositions.push_back(glm::vec2{ v4.x, v4.y });
+		return opaqueQuads;
+	}
 
-		spriteColors.push_back(colors[0]);
-		spriteColors.push_back(colors[1]);
-		spriteColors.push_back(colors[3]);
-		spriteColors.push_back(colors[1]);
-		spriteColors.push_back(colors[2]);
-		spriteColors.push_back(colors[3]);
+	//splits the quads in batches that can be drawn with the same bound textures
+	//and writes the texture slot of every quad in the vertices and instances.
+	//A batch ends when the slots are full or the camera changes.
+	//With sorted quads a batch also ends when the shader changes, with the opaque pass after the opaque quads.
+	void buildTextureBatches(gl2d::Renderer2D &renderer, bool ignoreCameraBatches, bool sorted, size_t opaqueQuads = 0)
+	{
+		renderer.textureBatches.clear();
+		renderer.batchTextures.clear();
 
-		texturePositions.push_back(glm::vec2{ textureCoords.x, textureCoords.y }); //1
-		texturePositions.push_back(glm::vec2{ textureCoords.x, textureCoords.w }); //2
-		texturePositions.push_back(glm::vec2{ textureCoords.z, textureCoords.y }); //4
-		texturePositions.push_back(glm::vec2{ textureCoords.x, textureCoords.w }); //2
-		texturePositions.push_back(glm::vec2{ textureCoords.z, textureCoords.w }); //3
-		texturePositions.push_back(glm::vec2{ textureCoords.z, textureCoords.y }); //4
+		//shaders without u_textures only see the texture bound to u_sampler
+		auto getSlots = [&](int shader)
+		{
+			const ShaderProgram &s = shader >= 0 ? renderer.sortShaders[shader] : renderer.currentShader;
+			return s.u_textures >= 0 ? maxTextureSlots : 1;
+		};
 
-		spriteTextures.push_back(textureCopy);
-	}
+		int slots = getSlots(-1);
 
-	void Renderer2D::renderRectangle(const Rect transforms, const Color4f colors[4], const glm::vec2 origin, const float rotation)
-	{
-		renderRectangle(transforms, white1pxSquareTexture, colors, origin, rotation);
-	}
+		size_t nextCameraBatch = ignoreCameraBatches ? renderer.cameraBatches.size() : 1;
+		size_t vertexQuad = 0;
+		size_t instance = 0;
 
-	void Renderer2D::renderRectangleAbsRotation(const Rect transforms, const Color4f colors[4], const glm::vec2 origin, const float rotation)
-	{
-		renderRectangleAbsRotation(transforms, white1pxSquareTexture, colors, origin, rotation);
+		for (size_t i = 0; i < renderer.spriteQuads.size(); i++)
+		{
+			auto &quad = renderer.spriteQuads[i];
+
+			bool newBatch = renderer.textureBatches.empty();
+
+			const int shader = sorted ? internal::sortKeyShader(renderer.sortKeys[i]) : -1;
+			if (!newBatch && renderer.textureBatches.back().shader != shader)
+			{
+				newBatch = true;
+			}
+
+			if (nextCameraBatch < renderer.cameraBatches.size() &&
+				renderer.cameraBatches[nextCameraBatch].firstQuad == i)
+			{
+				newBatch = true;
+				nextCameraBatch++;
+			}
+
+			if (opaqueQuads && i == opaqueQuads)
+			{
+				newBatch = true;
+			}
+
+			int slot = -1;
+			if (!newBatch)
+			{
+				auto &batch = renderer.textureBatches.back();
+				for (int t = 0; t < batch.textureCount; t++)
+				{
+					if (renderer.batchTextures[batch.firstTexture + t] == quad.texture)
+					{
+						slot = t;
+						break;
+					}
+				}
+
+				if (slot < 0 && batch.textureCount >= slots)
+				{
+					newBatch = true;
+				}
+			}
+
+			if (newBatch)
+			{
+				Renderer2D::TextureBatch batch;
+				batch.firstQuad = i;
+				batch.firstTexture = renderer.batchTextures.size();
+				batch.shader = shader;
+				renderer.textureBatches.push_back(batch);
+				slots = getSlots(shader);
+			}
+
+			if (slot < 0)
+			{
+				auto &batch = renderer.textureBatches.back();
+				slot = batch.textureCount;
+				batch.textureCount++;
+				renderer.batchTextures.push_back(quad.texture);
+			}
+
+			//the high bits are the shape
+			if (quad.instanced)
+			{
+				auto &i = renderer.spriteInstances[instance];
+				i.textureSlot = (GLubyte)((i.textureSlot & internal::shapeMask) | slot);
+				instance++;
+			}
+			else
+			{
+				Renderer2DVertex *v = &renderer.spriteVertices[vertexQuad * 4];
+				const GLubyte s = (GLubyte)((v[0].textureSlot & internal::shapeMask) | slot);
+				v[0].textureSlot = s;
+				v[1].textureSlot = s;
+				v[2].textureSlot = s;
+				v[3].textureSlot = s;
+				vertexQuad++;
+			}
+		}
 	}
 
-	void Renderer2D::renderLine(const glm::vec2 position, const float angleDegrees, const float length, const Color4f color, const float width)
+	//what drawQuadBatches needs, the data of the renderer when flushing or of a StaticBatch
+	struct QuadDrawData
+	{
+		GLuint buffer = 0;
+		size_t verticesOffset = 0;
+		size_t instancesOffset = 0;
+		const std::vector<Renderer2D::QuadInfo> *quads = nullptr;
+		const std::vector<Renderer2D::CameraBatch> *cameraBatches = nullptr;
+		const std::vector<Renderer2D::TextureBatch> *textureBatches = nullptr;
+		const std::vector<GLuint> *batchTextures = nullptr;
+		const std::vector<ShaderProgram> *shaders = nullptr;
+		GLuint frameBuffer = 0; //only used for the stats, the frame capture and the depth buffer check
+		size_t opaqueQuads = 0; //the first quads, drawn with the opaque pass
+	};
+
+	//the window metrics are stored with every command, the renderer uses them for the default fbo
+	FrameCapture::Command &addCaptureCommand(gl2d::Renderer2D &renderer, int type, GLuint frameBuffer)
 	{
-		renderRectangle({position - glm::vec2(0,width / 2.f), length, width},
-			color, {-length/2, 0}, angleDegrees);
+		auto &capture = *renderer.capture;
+
+		FrameCapture::Command command;
+		command.type = type;
+		command.frameBuffer = capture.addFrameBuffer(frameBuffer);
+		command.windowW = renderer.windowW;
+		command.windowH = renderer.windowH;
+		capture.commands.push_back(std::move(command));
+
+		return capture.commands.back();
 	}
 
-	void Renderer2D::renderLine(const glm::vec2 start, const glm::vec2 end, const Color4f color, const float width) 
+	//FrameBuffer::clear uses the clear color that is set in gl,
+	//call it before clearing so the old content of the frame buffer can be captured
+	void captureFrameBufferClear(gl2d::Renderer2D &renderer, GLuint frameBuffer)
 	{
-		glm::vec2 vector = end - start;
-		float length = glm::length(vector);
-		float angle = std::atan2(vector.y, vector.x);
-		renderLine(start, -glm::degrees(angle), length, color, width);
+		if (!renderer.capture) { return; }
+
+		auto &command = addCaptureCommand(renderer, FrameCapture::commandClear, frameBuffer);
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, &command.color[0]);
 	}
 
-	void Renderer2D::renderRectangleOutline(const glm::vec4 position, const Color4f color, const float width,
-		const glm::vec2 origin, const float rotationDegrees)
+	//records the quads the way they are drawn, after batching.
+	//The vertices and instances are read back from the buffer so it works for the static batches too
+	void captureQuadDraw(gl2d::Renderer2D &renderer, const QuadDrawData &data, const Camera *overrideCamera)
 	{
-		
-		glm::vec2 topLeft = position;
-		glm::vec2 topRight = glm::vec2(position) + glm::vec2(position.z, 0);
-		glm::vec2 bottomLeft = glm::vec2(position) + glm::vec2(0, position.w);
-		glm::vec2 bottomRight = glm::vec2(position) + glm::vec2(position.z, position.w);
-		
-		glm::vec2 p1 = topLeft + glm::vec2(-width / 2.f, 0);
-		glm::vec2 p2 = topRight + glm::vec2(+width / 2.f, 0);
-		glm::vec2 p3 = topRight + glm::vec2(0, +width / 2.f);
-		glm::vec2 p4 = bottomRight + glm::vec2(0, -width / 2.f);
-		glm::vec2 p5 = bottomRight + glm::vec2(width / 2.f, 0);
-		glm::vec2 p6 = bottomLeft + glm::vec2(-width / 2.f, 0);
-		glm::vec2 p7 = bottomLeft + glm::vec2(0, -width / 2.f);
-		glm::vec2 p8 = topLeft + glm::vec2(0, +width / 2.f);
+		auto &capture = *renderer.capture;
+		auto &command = addCaptureCommand(renderer, FrameCapture::commandQuads, data.frameBuffer);
 
-		if (rotationDegrees != 0) 
+		if (overrideCamera)
 		{
-			glm::vec2 o = origin + glm::vec2(position.x, -position.y) + glm::vec2(position.z, -position.w) / 2.f;
-
-			p1 = rotateAroundPoint(p1, o, -rotationDegrees);
-			p2 = rotateAroundPoint(p2, o, -rotationDegrees);
-			p3 = rotateAroundPoint(p3, o, -rotationDegrees);
-			p4 = rotateAroundPoint(p4, o, -rotationDegrees);
-			p5 = rotateAroundPoint(p5, o, -rotationDegrees);
-			p6 = rotateAroundPoint(p6, o, -rotationDegrees);
-			p7 = rotateAroundPoint(p7, o, -rotationDegrees);
-			p8 = rotateAroundPoint(p8, o, -rotationDegrees);
+			command.hasOverrideCamera = true;
+			command.overrideCamera = *overrideCamera;
 		}
 
-		auto renderPoint = [&](glm::vec2 pos) 
+		command.quads = *data.quads;
+		command.cameraBatches = *data.cameraBatches;
+		command.textureBatches = *data.textureBatches;
+		command.batchTextures = *data.batchTextures;
+		command.opaqueQuads = data.opaqueQuads;
+
+		size_t instances = 0;
+		GLuint lastId = 0;
+		int lastIndex = -1;
+		for (auto &q : command.quads)
 		{
-			renderRectangle({pos - glm::vec2(1,1),2,2}, Colors_Black);
-		};
+			if (q.texture != lastId || lastIndex < 0)
+			{
+				lastId = q.texture;
+				lastIndex = capture.addTexture(q.texture);
+			}
+			q.texture = lastIndex;
+			instances += q.instanced;
+		}
 
-		renderPoint(p1);
-		renderPoint(p2);
-		renderPoint(p3);
-		renderPoint(p4);
-		renderPoint(p5);
-		renderPoint(p6);
-		renderPoint(p7);
-		renderPoint(p8);
+		for (auto &t : command.batchTextures) { t = capture.addTexture(t); }
 
-		//add a padding so the lines align properly.
-		renderLine(p1, p2, color, width); //top line
-		renderLine(p3, p4, color, width);
-		renderLine(p5, p6, color, width); //bottom line
-		renderLine(p7, p8, color, width);
+		command.shader = capture.addShader(renderer.currentShader.id);
+		for (auto &s : *data.shaders) { command.shaders.push_back(capture.addShader(s.id)); }
 
+		command.vertices.resize((command.quads.size() - instances) * 4);
+		command.instances.resize(instances);
+
+		glBindBuffer(GL_ARRAY_BUFFER, data.buffer);
+		if (!command.vertices.empty())
+		{
+			glGetBufferSubData(GL_ARRAY_BUFFER, data.verticesOffset,
+				command.vertices.size() * sizeof(Renderer2DVertex), command.vertices.data());
+		}
+		if (!command.instances.empty())
+		{
+			glGetBufferSubData(GL_ARRAY_BUFFER, data.instancesOffset,
+				command.instances.size() * sizeof(Renderer2DInstance), command.instances.data());
+		}
 	}
 
-	void  Renderer2D::renderCircleOutline(const glm::vec2 position,
-		const float size, const Color4f color,
-		const float width, const unsigned int segments)
+	//draws the texture batches, the vao has to be bound and the vertex attributes set.
+	//if overrideCamera is not null it is used instead of the recorded cameras
+	void drawQuadBatches(gl2d::Renderer2D &renderer, const QuadDrawData &data, const Camera *overrideCamera)
 	{
-	
-		auto calcPos = [&](int p)
-		{
-			glm::vec2 circle = {size,0};
+		auto &quads = *data.quads;
+		auto &cameraBatches = *data.cameraBatches;
+		auto &textureBatches = *data.textureBatches;
+		auto &batchTextures = *data.batchTextures;
+		auto &shaders = *data.shaders;
 
-			float a = 3.1415926 * 2 * ((float)p / segments);
+		const size_t size = quads.size();
+		const size_t cameraBatchesCount = overrideCamera ? 1 : cameraBatches.size();
 
-			float c = std::cos(a);
-			float s = std::sin(a);
+		if (renderer.capture) { captureQuadDraw(renderer, data, overrideCamera); }
 
-			circle = {c * circle.x - s * circle.y, s * circle.x + c * circle.y};
+		//the opaque quads are drawn first from front to back and write the depth, the rest is drawn with the depth test
+		size_t opaqueQuads = data.opaqueQuads;
+		if (opaqueQuads && !internal::frameBufferHasDepth(data.frameBuffer))
+		{
+			errorFunc("Quads split for the opaque pass are drawn into a frame buffer without a depth buffer", userDefinedData);
+			opaqueQuads = 0;
+		}
 
-			return circle + position;
-		};
+		const float depthScale = opaqueQuads ? 2.f / (float)(size + 1) : 0.f;
 
-		
-		glm::vec2 lastPos = calcPos(1);
-		renderLine(calcPos(0), lastPos, color, width);
-		for (int i = 1; i < segments; i++)
+		if (opaqueQuads)
 		{
+			glDepthMask(GL_TRUE);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LESS);
+			glDisable(GL_BLEND);
+			renderer.stats.opaqueQuads += opaqueQuads;
+		}
 
-			glm::vec2 pos1 = lastPos;
-			glm::vec2 pos2 = calcPos(i + 1);
+		//vertex quads and instances are stored separately, these keep track of where the next run starts
+		size_t vertexQuadsDrawn = 0;
+		size_t instancesDrawn = 0;
+		bool instancedBound = false;
 
-			renderLine(pos1, pos2, color, width);
+		//with deferredSorting every batch can have a different shader
+		const ShaderProgram *shader = nullptr;
+		glm::mat3 viewProjection = {};
 
-			lastPos = pos2;
-		}
+		//why the next draw call is split from the previous one
+		int breakReason = renderer.statsFrameBuffer == data.frameBuffer ?
+			Renderer2D::Stats::breakFlush : Renderer2D::Stats::breakFrameBuffer;
+		renderer.statsFrameBuffer = data.frameBuffer;
 
-	}
+		auto drawQuads = [&](size_t begin, size_t end)
+		{
+			const size_t count = end - begin;
 
+			internal::countDrawCall(renderer, breakReason, count);
+			breakReason = Renderer2D::Stats::breakInstancing;
 
+			if (quads[begin].instanced)
+			{
+				if (!instancedBound)
+				{
+					internal::bindVertexArray(renderer.instanceVao);
+					glUniform1i(shader->u_instanced, 1);
+					instancedBound = true;
+				}
 
-	void Renderer2D::render9Patch(const Rect position, const int borderSize, const Color4f color, const glm::vec2 origin, const float rotation, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords)
-	{
-		glm::vec4 colorData[4] = { color, color, color, color };
+				setInstanceAttributes(data.buffer, data.instancesOffset + instancesDrawn * sizeof(Renderer2DInstance));
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+				instancesDrawn += count;
+			}
+			else
+			{
+				if (instancedBound)
+				{
+					internal::bindVertexArray(renderer.vao);
+					glUniform1i(shader->u_instanced, 0);
+					instancedBound = false;
+				}
 
-		//inner
-		Rect innerPos = position;
-		innerPos.x += borderSize;
-		innerPos.y += borderSize;
-		innerPos.z -= borderSize * 2;
-		innerPos.w -= borderSize * 2;
-		renderRectangle(innerPos, texture, colorData, Position2D{ 0, 0 }, 0, inner_texture_coords);
+				glDrawElements(GL_TRIANGLES, (GLsizei)(6 * count), GL_UNSIGNED_INT,
+					(void *)(vertexQuadsDrawn * 6 * sizeof(GLuint)));
+				vertexQuadsDrawn += count;
+			}
+		};
 
-		//top
-		Rect topPos = position;
-		topPos.x += borderSize;
-		topPos.z -= (float)borderSize * 2;
-		topPos.w = (float)borderSize;
-		glm::vec4 upperTexPos;
-		upperTexPos.x = inner_texture_coords.x;
-		upperTexPos.y = textureCoords.y;
-		upperTexPos.z = inner_texture_coords.z;
-		upperTexPos.w = inner_texture_coords.y;
-		renderRectangle(topPos, texture, colorData, Position2D{ 0, 0 }, 0, upperTexPos);
+		size_t cameraBatch = 0;
+		const size_t textureBatchesCount = textureBatches.size();
 
-		//bottom
-		Rect bottom = position;
-		bottom.x += (float)borderSize;
-		bottom.y += (float)position.w - borderSize;
-		bottom.z -= (float)borderSize * 2;
-		bottom.w = (float)borderSize;
-		glm::vec4 bottomTexPos;
-		bottomTexPos.x = inner_texture_coords.x;
-		bottomTexPos.y = inner_texture_coords.w;
-		bottomTexPos.z = inner_texture_coords.z;
-		bottomTexPos.w = textureCoords.w;
-		renderRectangle(bottom, texture, colorData, Position2D{ 0, 0 }, 0, bottomTexPos);
+		for (size_t b = 0; b < textureBatchesCount; b++)
+		{
+			auto &batch = textureBatches[b];
+			const size_t begin = batch.firstQuad;
+			const size_t end = (b + 1 < textureBatchesCount) ? textureBatches[b + 1].firstQuad : size;
 
-		//left
-		Rect left = position;
-		left.y += borderSize;
-		left.z = (float)borderSize;
-		left.w -= (float)borderSize * 2;
-		glm::vec4 leftTexPos;
-		leftTexPos.x = textureCoords.x;
-		leftTexPos.y = inner_texture_coords.y;
-		leftTexPos.z = inner_texture_coords.x;
-		leftTexPos.w = inner_texture_coords.w;
-		renderRectangle(left, texture, colorData, Position2D{ 0, 0 }, 0, leftTexPos);
+			if (b != 0) { breakReason = Renderer2D::Stats::breakTextureSlots; }
 
-		//right
-		Rect right = position;
-		right.x += position.z - borderSize;
-		right.y += borderSize;
-		right.z = (float)borderSize;
-		right.w -= (float)borderSize * 2;
-		glm::vec4 rightTexPos;
-		rightTexPos.x = inner_texture_coords.z;
-		rightTexPos.y = inner_texture_coords.y;
-		rightTexPos.z = textureCoords.z;
-		rightTexPos.w = inner_texture_coords.w;
-		renderRectangle(right, texture, colorData, Position2D{ 0, 0 }, 0, rightTexPos);
+			if (opaqueQuads && begin == opaqueQuads)
+			{
+				glDepthMask(GL_FALSE);
+				glEnable(GL_BLEND);
+				breakReason = Renderer2D::Stats::breakOpaquePass;
+			}
 
-		//topleft
-		Rect topleft = position;
-		topleft.z = (float)borderSize;
-		topleft.w = (float)borderSize;
-		glm::vec4 topleftTexPos;
-		topleftTexPos.x = textureCoords.x;
-		topleftTexPos.y = textureCoords.y;
-		topleftTexPos.z = inner_texture_coords.x;
-		topleftTexPos.w = inner_texture_coords.y;
-		renderRectangle(topleft, texture, colorData, Position2D{ 0, 0 }, 0, topleftTexPos);
+			//the texture batches never cross a camera batch
+			if (b == 0 || (!overrideCamera && cameraBatch + 1 < cameraBatchesCount &&
+				cameraBatches[cameraBatch + 1].firstQuad == begin))
+			{
+				if (b != 0) { cameraBatch++; breakReason = Renderer2D::Stats::breakCamera; }
 
-		//topright
-		Rect topright = position;
-		topright.x += position.z - borderSize;
-		topright.z = (float)borderSize;
-		topright.w = (float)borderSize;
-		glm::vec4 toprightTexPos;
-		toprightTexPos.x = inner_texture_coords.z;
-		toprightTexPos.y = textureCoords.y;
-		toprightTexPos.z = textureCoords.z;
-		toprightTexPos.w = inner_texture_coords.y;
-		renderRectangle(topright, texture, colorData, Position2D{ 0, 0 }, 0, toprightTexPos);
+				if (overrideCamera)
+				{
+					viewProjection = internal::computeViewProjection(*overrideCamera,
+						(float)renderer.windowW, (float)renderer.windowH);
+				}
+				else
+				{
+					auto &c = cameraBatches[cameraBatch];
+					viewProjection = internal::computeViewProjection(c.camera,
+						(float)c.windowW, (float)c.windowH);
+				}
 
-		//bottomleft
-		Rect bottomleft = position;
-		bottomleft.y += position.w - borderSize;
-		bottomleft.z = (float)borderSize;
-		bottomleft.w = (float)borderSize;
-		glm::vec4 bottomleftTexPos;
-		bottomleftTexPos.x = textureCoords.x;
-		bottomleftTexPos.y = inner_texture_coords.w;
-		bottomleftTexPos.z = inner_texture_coords.x;
-		bottomleftTexPos.w = textureCoords.w;
-		renderRectangle(bottomleft, texture, colorData, Position2D{ 0, 0 }, 0, bottomleftTexPos);
+				if (shader)
+				{
+					glUniformMatrix3fv(shader->u_viewProjection, 1, GL_FALSE, &viewProjection[0][0]);
+				}
+			}
 
-		//bottomright
-		Rect bottomright = position;
-		bottomright.y += position.w - borderSize;
-		bottomright.x += position.z - borderSize;
-		bottomright.z = (float)borderSize;
-		bottomright.w = (float)borderSize;
-		glm::vec4 bottomrightTexPos;
-		bottomrightTexPos.x = inner_texture_coords.z;
-		bottomrightTexPos.y = inner_texture_coords.w;
-		bottomrightTexPos.z = textureCoords.z;
-		bottomrightTexPos.w = textureCoords.w;
-		renderRectangle(bottomright, texture, colorData, Position2D{ 0, 0 }, 0, bottomrightTexPos);
+			const ShaderProgram *batchShader = batch.shader >= 0 ?
+				&shaders[batch.shader] : &renderer.currentShader;
 
-	}
+			if (!shader || batchShader->id != shader->id)
+			{
+				if (shader && breakReason == Renderer2D::Stats::breakTextureSlots) { breakReason = Renderer2D::Stats::breakShader; }
+
+				shader = batchShader;
+				renderer.stats.shaderChanges++;
+				internal::useProgram(shader->id);
+				internal::setSamplerUniform(*shader);
+				glUniform1i(shader->u_instanced, instancedBound);
+				glUniformMatrix3fv(shader->u_viewProjection, 1, GL_FALSE, &viewProjection[0][0]);
+				if (shader->u_depthScale >= 0) { glUniform1f(shader->u_depthScale, depthScale); }
+			}
 
-	void Renderer2D::render9Patch2(const Rect position, const Color4f color, const glm::vec2 origin, const float rotation, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords)
-	{
-		glm::vec4 colorData[4] = { color, color, color, color };
+			for (int t = 0; t < batch.textureCount; t++)
+			{
+				if (internal::bindTexture(t, batchTextures[batch.firstTexture + t]))
+				{
+					renderer.stats.textureBinds++;
+				}
+			}
 
-		int w = 0;
-		int h = 0;
-		glBindTexture(GL_TEXTURE_2D, texture.id);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+			//vertex quads and instances can share the textures but not the draw call
+			size_t pos = begin;
+			for (size_t i = begin + 1; i < end; i++)
+			{
+				if (quads[i].instanced != quads[pos].instanced)
+				{
+					drawQuads(pos, i);
+					pos = i;
+				}
+			}
 
-		float textureSpaceW = textureCoords.z - textureCoords.x;
-		float textureSpaceH = textureCoords.y - textureCoords.w;
+			drawQuads(pos, end);
+		}
 
-		float topBorder = (textureCoords.y - inner_texture_coords.y) / textureSpaceH * position.w;
-		float bottomBorder = (inner_texture_coords.w - textureCoords.w) / textureSpaceH * position.w;
-		float leftBorder = (inner_texture_coords.x - textureCoords.x) / textureSpaceW * position.z;
-		float rightBorder = (textureCoords.z - inner_texture_coords.z) / textureSpaceW * position.z;
+		if (opaqueQuads)
+		{
+			glDisable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glEnable(GL_BLEND);
+		}
+	}
 
-		float newAspectRatio = position.z / position.w;
-		
-		if (newAspectRatio < 1.f) 
+	//won't bind any fbo, frameBuffer is the bound one and it is only used for the stats
+	//if overrideCamera is not null it is used instead of the recorded cameras
+	void internalFlush(gl2d::Renderer2D &renderer, GLuint frameBuffer, bool clearDrawData, const Camera *overrideCamera = nullptr)
+	{
+		enableNecessaryGLFeatures();
+
+		if (!hasInitialized)
 		{
-			topBorder *= newAspectRatio;
-			bottomBorder *= newAspectRatio;
+			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
+			renderer.clearDrawData();
+			return;
 		}
-		else
+
+		if (!renderer.vao)
 		{
-			leftBorder /= newAspectRatio;
-			rightBorder /= newAspectRatio;
+			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
+			renderer.clearDrawData();
+			return;
 		}
 
-	
+		if (renderer.windowH == 0 || renderer.windowW == 0)
+		{
+			if (clearDrawData)
+			{
+				renderer.clearDrawData();
+			}
 
-		//topBorder = 50;
-		//bottomBorder = -50;
-		//leftBorder = 0;
-		//rightBorder = 0;
+			return;
+		}
 
+		if (renderer.windowH < 0 || renderer.windowW < 0)
+		{
+			if (clearDrawData)
+			{
+				renderer.clearDrawData();
+			}
 
-		//inner
-		Rect innerPos = position;
-		innerPos.x += leftBorder;
-		innerPos.y += topBorder;
-		innerPos.z -= leftBorder + rightBorder;
-		innerPos.w -= topBorder + bottomBorder;
-		renderRectangle(innerPos, texture, colorData, Position2D{ 0, 0 }, 0, inner_texture_coords);
+			errorFunc("Negative windowW or windowH, have you forgotten to call updateWindowMetrics(w, h)?", userDefinedData);
 
-		//top
-		Rect topPos = position;
-		topPos.x += leftBorder;
-		topPos.z -= leftBorder + rightBorder;
-		topPos.w = topBorder;
-		glm::vec4 upperTexPos;
-		upperTexPos.x = inner_texture_coords.x;
-		upperTexPos.y = textureCoords.y;
-		upperTexPos.z = inner_texture_coords.z;
-		upperTexPos.w = inner_texture_coords.y;
-		renderRectangle(topPos, texture, colorData, Position2D{ 0, 0 }, 0, upperTexPos);
+			return;
+		}
 
-		//Rect topPos = position;
-		//topPos.x += leftBorder;
-		//topPos.w = topBorder;
-		//topPos.z = topBorder;
-		//float end = rightBorder;
-		//float size = topBorder;
-		//
-		//while(1)
-		//{
-		//	if(topPos.x + size <= end)
-		//	{
-		//
-		//		//draw
-		//		renderRectangle(topPos, colorData, Position2D{ 0, 0 }, 0, texture, upperTexPos);
-		//
-		//		topPos += size;
-		//	}else
-		//	{
-		//		float newW = end - topPos.x;
-		//		if(newW>0)
-		//		{
-		//			topPos.z = newW;
-		//			renderRectangle(topPos, colorData, Position2D{ 0, 0 }, 0, texture, upperTexPos);
-		//		}
-		//		break;
-		//	}
-		//
-		//}
+		if(renderer.spriteQuads.empty())
+		{
+			return;
+		}
 
+		GL2D_GPU_ZONE("gl2d flush");
 
-		//bottom
-		Rect bottom = position;
-		bottom.x += leftBorder;
-		bottom.y += (float)position.w - bottomBorder;
-		bottom.z -= leftBorder + rightBorder;
-		bottom.w = bottomBorder;
-		glm::vec4 bottomTexPos;
-		bottomTexPos.x = inner_texture_coords.x;
-		bottomTexPos.y = inner_texture_coords.w;
-		bottomTexPos.z = inner_texture_coords.z;
-		bottomTexPos.w = textureCoords.w;
-		renderRectangle(bottom, texture, colorData, Position2D{ 0, 0 }, 0, bottomTexPos);
+		const double flushStart = internal::statsClock();
+		if (renderer.recordingStart)
+		{
+			renderer.stats.submissionMs += (flushStart - renderer.recordingStart) * 1000.0;
+			renderer.recordingStart = 0;
+		}
+		renderer.stats.flushes++;
 
-		//left
-		Rect left = position;
-		left.y += topBorder;
-		left.z = leftBorder;
-		left.w -= topBorder + bottomBorder;
-		glm::vec4 leftTexPos;
-		leftTexPos.x = textureCoords.x;
-		leftTexPos.y = inner_texture_coords.y;
-		leftTexPos.z = inner_texture_coords.x;
-		leftTexPos.w = inner_texture_coords.w;
-		renderRectangle(left, texture, colorData, Position2D{ 0, 0 }, 0, leftTexPos);
+		bool sorted = false;
+		if (renderer.deferredSorting)
+		{
+			if (renderer.sortKeys.size() != renderer.spriteQuads.size())
+			{
+				errorFunc("Some quads were rendered without deferredSorting, they will be drawn unsorted", userDefinedData);
+			}
+			else if (renderer.spriteQuads.size() > internal::sortIndexMask)
+			{
+				errorFunc("Too many quads to sort in one flush, they will be drawn unsorted", userDefinedData);
+			}
+			else
+			{
+				sortDeferredQuads(renderer);
+				sorted = true;
+			}
+		}
 
-		//right
-		Rect right = position;
-		right.x += position.z - rightBorder;
-		right.y += topBorder;
-		right.z = rightBorder;
-		right.w -= topBorder + bottomBorder;
-		glm::vec4 rightTexPos;
-		rightTexPos.x = inner_texture_coords.z;
-		rightTexPos.y = inner_texture_coords.y;
-		rightTexPos.z = textureCoords.z;
-		rightTexPos.w = inner_texture_coords.w;
-		renderRectangle(right, texture, colorData, Position2D{ 0, 0 }, 0, rightTexPos);
+		internal::setViewport(0, 0, renderer.windowW, renderer.windowH);
 
-		//topleft
-		Rect topleft = position;
-		topleft.z = leftBorder;
-		topleft.w = topBorder;
-		glm::vec4 topleftTexPos;
-		topleftTexPos.x = textureCoords.x;
-		topleftTexPos.y = textureCoords.y;
-		topleftTexPos.z = inner_texture_coords.x;
-		topleftTexPos.w = inner_texture_coords.y;
-		renderRectangle(topleft, texture, colorData, Position2D{ 0, 0 }, 0, topleftTexPos);
-		//repair here?
+		internal::bindVertexArray(renderer.vao);
 
+		ensureIndexBufferCapacity(renderer, renderer.spriteVertices.size() / 4);
 
-		//topright
-		Rect topright = position;
-		topright.x += position.z - rightBorder;
-		topright.z = rightBorder;
-		topright.w = topBorder;
-		glm::vec4 toprightTexPos;
-		toprightTexPos.x = inner_texture_coords.z;
-		toprightTexPos.y = textureCoords.y;
-		toprightTexPos.z = textureCoords.z;
-		toprightTexPos.w = inner_texture_coords.y;
-		renderRectangle(topright, texture, colorData, Position2D{ 0, 0 }, 0, toprightTexPos);
+		size_t opaqueQuads = 0;
+		if (renderer.opaquePass && internal::frameBufferHasDepth(frameBuffer))
+		{
+			opaqueQuads = splitOpaqueQuads(renderer, sorted);
+		}
 
-		//bottomleft
-		Rect bottomleft = position;
-		bottomleft.y += position.w - bottomBorder;
-		bottomleft.z = leftBorder;
-		bottomleft.w = bottomBorder;
-		glm::vec4 bottomleftTexPos;
-		bottomleftTexPos.x = textureCoords.x;
-		bottomleftTexPos.y = inner_texture_coords.w;
-		bottomleftTexPos.z = inner_texture_coords.x;
-		bottomleftTexPos.w = textureCoords.w;
-		renderRectangle(bottomleft, texture, colorData, Position2D{ 0, 0 }, 0, bottomleftTexPos);
+		buildTextureBatches(renderer, overrideCamera != nullptr, sorted, opaqueQuads);
 
-		//bottomright
-		Rect bottomright = position;
-		bottomright.y += position.w - bottomBorder;
-		bottomright.x += position.z - rightBorder;
-		bottomright.z = rightBorder;
-		bottomright.w = bottomBorder;
-		glm::vec4 bottomrightTexPos;
-		bottomrightTexPos.x = inner_texture_coords.z;
-		bottomrightTexPos.y = inner_texture_coords.w;
-		bottomrightTexPos.z = textureCoords.z;
-		bottomrightTexPos.w = textureCoords.w;
-		renderRectangle(bottomright, texture, colorData, Position2D{ 0, 0 }, 0, bottomrightTexPos);
+		const size_t verticesSize = renderer.spriteVertices.size() * sizeof(Renderer2DVertex);
+		const size_t instancesSize = renderer.spriteInstances.size() * sizeof(Renderer2DInstance);
+		size_t verticesOffset = 0;
+		size_t instancesOffset = 0;
+		uploadQuadData(renderer, renderer.spriteVertices, renderer.spriteInstances, verticesOffset, instancesOffset);
 
-	}
+		//Instance render the textures
+		{
+			QuadDrawData data;
+			data.buffer = renderer.streamBuffer.buffer;
+			data.verticesOffset = verticesOffset;
+			data.instancesOffset = instancesOffset;
+			data.quads = &renderer.spriteQuads;
+			data.cameraBatches = &renderer.cameraBatches;
+			data.textureBatches = &renderer.textureBatches;
+			data.batchTextures = &renderer.batchTextures;
+			data.shaders = &renderer.sortShaders;
+			data.frameBuffer = frameBuffer;
+			data.opaqueQuads = opaqueQuads;
+
+			drawQuadBatches(renderer, data, overrideCamera);
+		}
 
-	void Renderer2D::create(GLuint fbo, size_t quadCount)
-	{
-		if (!hasInitialized)
+		renderer.streamBuffer.lockRegion(verticesOffset, verticesSize);
+		renderer.streamBuffer.lockRegion(instancesOffset, instancesSize);
+
+		//the quads are kept in the order they were rendered in, so flushing again splits them the same way
+		if (opaqueQuads && !clearDrawData)
 		{
-			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
+			swapOpaqueSplit(renderer, sorted);
 		}
 
-		defaultFBO = fbo;
+		if (clearDrawData) 
+		{
+			renderer.clearDrawData();
+		}
 
-		clearDrawData();
-		spritePositions.reserve(quadCount * 6);
-		spriteColors.reserve(quadCount * 6);
-		texturePositions.reserve(quadCount * 6);
-		spriteTextures.reserve(quadCount);
+		renderer.stats.flushMs += (internal::statsClock() - flushStart) * 1000.0;
+	}
 
-		this->resetCameraAndShader();
+	void gl2d::Renderer2D::flush(bool clearDrawData)
+	{
+		internal::bindFrameBuffer(defaultFBO);
+		internalFlush(*this, defaultFBO, clearDrawData);
+	}
 
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
+	void Renderer2D::flushWithCamera(const Camera camera, FrameBuffer frameBuffer, bool clearDrawData)
+	{
+		internal::bindFrameBuffer(frameBuffer.fbo ? frameBuffer.fbo : defaultFBO);
+		internal::unbindTexture(frameBuffer.texture.id);
 
-		glGenBuffers(Renderer2DBufferType::bufferSize, buffers);
+		internalFlush(*this, frameBuffer.fbo ? frameBuffer.fbo : defaultFBO, clearDrawData, &camera);
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, buffers[Renderer2DBufferType::quadPositions]);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	void StaticBatch::begin(Renderer2D &renderer)
+	{
+		if (recording)
+		{
+			errorFunc("StaticBatch::begin called twice without end", userDefinedData);
+			return;
+		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, buffers[Renderer2DBufferType::quadColors]);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		recording = true;
 
-		glBindBuffer(GL_ARRAY_BUFFER, buffers[Renderer2DBufferType::texturePositions]);
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		//the renderer records into empty vectors, the old draw data is given back in end
+		renderer.spriteVertices.swap(saved.vertices);
+		renderer.spriteInstances.swap(saved.instances);
+		renderer.spriteQuads.swap(saved.quads);
+		renderer.cameraBatches.swap(saved.cameraBatches);
+		renderer.sortKeys.swap(saved.sortKeys);
+		renderer.sortShaders.swap(saved.sortShaders);
 
-		glBindVertexArray(0);
+		//the batch can be drawn with any camera later so nothing is culled while recording
+		saved.culling = renderer.culling;
+		renderer.culling = false;
 	}
 
-	void Renderer2D::cleanup()
+	void StaticBatch::end(Renderer2D &renderer)
 	{
-		glDeleteVertexArrays(1, &vao);
-		glDeleteBuffers(Renderer2DBufferType::bufferSize, buffers);
+		if (!recording)
+		{
+			errorFunc("StaticBatch::end called without begin", userDefinedData);
+			return;
+		}
 
-		postProcessFbo1.cleanup();
-		postProcessFbo2.cleanup();
-		internalPostProcessFlip = 0;
-	}
+		recording = false;
 
-	void Renderer2D::pushShader(ShaderProgram s)
-	{
-		shaderPushPop.push_back(currentShader);
-		currentShader = s;
+		bool sorted = false;
+		if (renderer.deferredSorting && renderer.sortKeys.size() == renderer.spriteQuads.size() &&
+			renderer.spriteQuads.size() <= internal::sortIndexMask)
+		{
+			sortDeferredQuads(renderer);
+			sorted = true;
+		}
+
+		opaqueQuads = renderer.opaquePass ? splitOpaqueQuads(renderer, sorted) : 0;
+
+		buildTextureBatches(renderer, false, sorted, opaqueQuads);
+
+		const size_t verticesSize = renderer.spriteVertices.size() * sizeof(Renderer2DVertex);
+		const size_t instancesSize = renderer.spriteInstances.size() * sizeof(Renderer2DInstance);
+
+		vertexQuadCount = renderer.spriteVertices.size() / 4;
+		instancesOffset = (verticesSize + 63) & ~(size_t)63;
+
+		if (!buffer)
+		{
+			glGenBuffers(1, &buffer);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, instancesOffset + instancesSize, nullptr, GL_STATIC_DRAW);
+		if (verticesSize) { glBufferSubData(GL_ARRAY_BUFFER, 0, verticesSize, renderer.spriteVertices.data()); }
+		if (instancesSize) { glBufferSubData(GL_ARRAY_BUFFER, instancesOffset, instancesSize, renderer.spriteInstances.data()); }
+		renderer.stats.bytesUploaded += verticesSize + instancesSize;
+
+		quads.swap(renderer.spriteQuads);
+		cameraBatches.swap(renderer.cameraBatches);
+		textureBatches.swap(renderer.textureBatches);
+		batchTextures.swap(renderer.batchTextures);
+		shaders.swap(renderer.sortShaders);
+
+		renderer.clearDrawData();
+		renderer.spriteVertices.swap(saved.vertices);
+		renderer.spriteInstances.swap(saved.instances);
+		renderer.spriteQuads.swap(saved.quads);
+		renderer.cameraBatches.swap(saved.cameraBatches);
+		renderer.sortKeys.swap(saved.sortKeys);
+		renderer.sortShaders.swap(saved.sortShaders);
+		renderer.culling = saved.culling;
 	}
 
-	void Renderer2D::popShader()
+	void StaticBatch::draw(Renderer2D &renderer, const Camera *camera, FrameBuffer frameBuffer)
 	{
-		if (shaderPushPop.empty())
+		if (recording)
 		{
-			errorFunc("Pop on an empty stack on popShader", userDefinedData);
+			errorFunc("StaticBatch::draw called while recording", userDefinedData);
+			return;
 		}
-		else
+
+		if (quads.empty() || !buffer || renderer.windowW <= 0 || renderer.windowH <= 0)
 		{
-			currentShader = shaderPushPop.back();
-			shaderPushPop.pop_back();
+			return;
 		}
-	}
 
-	void Renderer2D::pushCamera(Camera c)
-	{
-		cameraPushPop.push_back(currentCamera);
-		currentCamera = c;
+		const double drawStart = internal::statsClock();
+		renderer.stats.flushes++;
+
+		enableNecessaryGLFeatures();
+
+		internal::bindFrameBuffer(frameBuffer.fbo ? frameBuffer.fbo : renderer.defaultFBO);
+		internal::setViewport(0, 0, renderer.windowW, renderer.windowH);
+
+		internal::bindVertexArray(renderer.vao);
+		ensureIndexBufferCapacity(renderer, vertexQuadCount);
+		setVertexAttributes(buffer, 0);
+
+		QuadDrawData data;
+		data.buffer = buffer;
+		data.verticesOffset = 0;
+		data.instancesOffset = instancesOffset;
+		data.quads = &quads;
+		data.cameraBatches = &cameraBatches;
+		data.textureBatches = &textureBatches;
+		data.batchTextures = &batchTextures;
+		data.shaders = &shaders;
+		data.frameBuffer = frameBuffer.fbo ? frameBuffer.fbo : renderer.defaultFBO;
+		data.opaqueQuads = opaqueQuads;
+
+		drawQuadBatches(renderer, data, camera);
+
+		renderer.stats.flushMs += (internal::statsClock() - drawStart) * 1000.0;
 	}
 
-	void Renderer2D::popCamera()
+	void StaticBatch::cleanup()
 	{
-		if (cameraPushPop.empty())
+		if (buffer)
 		{
-			errorFunc("Pop on an empty stack on popCamera", userDefinedData);
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
 		}
-		else
+
+		quads.clear();
+		cameraBatches.clear();
+		textureBatches.clear();
+		batchTextures.clear();
+		shaders.clear();
+		vertexQuadCount = 0;
+		instancesOffset = 0;
+		opaqueQuads = 0;
+	}
+
+	void Renderer2D::flushFBO(FrameBuffer frameBuffer, bool clearDrawData)
+	{
+		if (frameBuffer.fbo == 0) 
 		{
-			currentCamera = cameraPushPop.back();
-			cameraPushPop.pop_back();
+			errorFunc("Framebuffer not initialized", userDefinedData);
+			return;
 		}
+
+		internal::bindFrameBuffer(frameBuffer.fbo);
+		internal::unbindTexture(frameBuffer.texture.id);
+
+		internalFlush(*this, frameBuffer.fbo, clearDrawData);
 	}
 
-	glm::vec4 Renderer2D::getViewRect()
+	void Renderer2D::renderFrameBufferToTheEntireScreen(gl2d::FrameBuffer fbo, gl2d::FrameBuffer screen)
 	{
-		auto rect = glm::vec4{0, 0, windowW, windowH};
+		renderTextureToTheEntireScreen(fbo.texture, screen);
+	}
 
-		glm::mat3 mat = 
-		{1.f, 0, currentCamera.position.x ,
-		 0, 1.f, currentCamera.position.y,
-		 0, 0, 1.f};
-		mat = glm::transpose(mat);
+	//doesn't bind or unbind stuff, except the vertex array,
+	//doesn't set the viewport, frameBuffer is the bound one and it is only used for the stats
+	void renderQuadToScreenInternal(gl2d::Renderer2D &renderer, GLuint frameBuffer)
+	{
+		//colors are not used
+		static const Renderer2DVertex vertices[4] = {
+			{{-1, 1}, {255,255,255,255}, {0, 65535}},
+			{{-1, -1}, {255,255,255,255}, {0, 0}},
+			{{1, -1}, {255,255,255,255}, {65535, 0}},
+			{{1, 1}, {255,255,255,255}, {65535, 65535}},
+		};
 
-		glm::vec3 pos1 = {rect.x, rect.y, 1.f};
-		glm::vec3 pos2 = {rect.z + rect.x, rect.w + rect.y, 1.f};
+		internal::bindVertexArray(renderer.vao);
 
-		pos1 = mat * pos1;
-		pos2 = mat * pos2;
-		
-		glm::vec2 point((pos1.x + pos2.x) / 2.f, (pos1.y + pos2.y) / 2.f);
+		const size_t offset = renderer.streamBuffer.upload(vertices, sizeof(vertices));
+		setVertexAttributes(renderer.streamBuffer.buffer, offset);
 
-		pos1 = glm::vec3(scaleAroundPoint(pos1, point, 1.f/currentCamera.zoom), 1.f);
-		pos2 = glm::vec3(scaleAroundPoint(pos2, point, 1.f/currentCamera.zoom), 1.f);
+		{
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		}
 
-		rect = {pos1.x, pos1.y, pos2.x - pos1.x, pos2.y - pos1.y};
+		renderer.streamBuffer.lockRegion(offset, sizeof(vertices));
 
-		return rect;
+		internal::countDrawCall(renderer, Renderer2D::Stats::breakFullScreen, 1);
+		renderer.stats.bytesUploaded += sizeof(vertices);
+		renderer.stats.shaderChanges++;
+		renderer.stats.textureBinds++;
+		renderer.statsFrameBuffer = frameBuffer;
 	}
 
-	glm::vec4 Renderer2D::toScreen(const glm::vec4& transform)
+	void Renderer2D::renderTextureToTheEntireScreen(gl2d::Texture t, gl2d::FrameBuffer screen)
 	{
-		//We need to flip texture_transforms.y
-		const float transformsY = transform.y * -1;
-
-		glm::vec2 v1 = { transform.x,				  transformsY };
-		glm::vec2 v2 = { transform.x,				  transformsY - transform.w };
-		glm::vec2 v3 = { transform.x + transform.z, transformsY - transform.w };
-		glm::vec2 v4 = { transform.x + transform.z, transformsY };
+		GLuint target = screen.fbo ? screen.fbo : defaultFBO;
+		internal::bindFrameBuffer(target);
 
-		//Apply camera transformations
-		v1.x -= currentCamera.position.x;
-		v1.y += currentCamera.position.y;
-		v2.x -= currentCamera.position.x;
-		v2.y += currentCamera.position.y;
-		v3.x -= currentCamera.position.x;
-		v3.y += currentCamera.position.y;
-		v4.x -= currentCamera.position.x;
-		v4.y += currentCamera.position.y;
+		enableNecessaryGLFeatures();
 
-		//Apply camera zoom
-		//if(renderer->currentCamera.zoom != 1)
+		if (!hasInitialized)
 		{
-
-			glm::vec2 cameraCenter;
-			cameraCenter.x = windowW / 2.0f;
-			cameraCenter.y = -windowH / 2.0f;
-
-			v1 = scaleAroundPoint(v1, cameraCenter, currentCamera.zoom);
-			v3 = scaleAroundPoint(v3, cameraCenter, currentCamera.zoom);
+			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
+			return;
 		}
 
-		v1.x = internal::positionToScreenCoordsX(v1.x, (float)windowW);
-		v3.x = internal::positionToScreenCoordsX(v3.x, (float)windowW);
-		v1.y = internal::positionToScreenCoordsY(v1.y, (float)windowH);
-		v3.y = internal::positionToScreenCoordsY(v3.y, (float)windowH);
-
-		return glm::vec4(v1.x, v1.y, v3.x, v3.y);
-	}
+		if (!vao)
+		{
+			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
+			return;
+		}
 
-	glm::vec2 Renderer2D::getTextSize(const char *text, const Font font,
-		const float size, const float spacing, const float line_space)
-	{
-		if (font.texture.id == 0)
+		if (!currentShader.id)
 		{
-			errorFunc("Missing font", userDefinedData);
-			return {};
+			errorFunc("Post Process Shader not created.", userDefinedData);
+			return;
 		}
 
-		glm::vec2 position = {};
+		glm::ivec2 size = {windowW, windowH};
 
-		const int text_length = (int)strlen(text);
-		Rect rectangle = {};
-		rectangle.x = position.x;
-		float linePositionY = position.y;
+		if (screen.fbo) 
+		{
+			size = screen.texture.GetSize();
+		}
+		if (size.x == 0 || size.y == 0)
+		{
+			return;
+		}
 
-		//This is the y position we render at because it advances when we encounter newlines
-		float maxPos = 0;
-		float maxPosY = 0;
-		float bonusY = 0;
+		internal::setViewport(0, 0, size.x, size.y);
 
-		for (int i = 0; i < text_length; i++)
+		if (capture)
 		{
-			if (text[i] == '\n')
-			{
-				rectangle.x = position.x;
-				linePositionY += (font.max_height + line_space) * size;
-				bonusY += (font.max_height + line_space) * size;
-				maxPosY = 0;
-			}
-			else if (text[i] == '\t')
-			{
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, '_');
-				auto x = quad.x1 - quad.x0;
-
-				rectangle.x += x * size * 3 + spacing * size;
-			}
-			else if (text[i] == ' ')
-			{
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, '_');
-				auto x = quad.x1 - quad.x0;
+			auto &command = addCaptureCommand(*this, FrameCapture::commandTextureToScreen, target);
+			command.shader = capture->addShader(currentShader.id);
+			command.texture = capture->addTexture(t.id);
+		}
 
-				rectangle.x += x * size + spacing * size;
-			}
-			else if (text[i] >= ' ' && text[i] <= '~')
-			{
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, text[i]);
+		internal::useProgram(currentShader.id);
+		internal::setSamplerUniform(currentShader);
 
-				rectangle.z = quad.x1 - quad.x0;
-				rectangle.w = quad.y1 - quad.y0;
+		//the quad is already in screen coordonates
+		glm::mat3 identity(1.f);
+		glUniformMatrix3fv(currentShader.u_viewProjection, 1, GL_FALSE, &identity[0][0]);
+		glUniform1i(currentShader.u_instanced, 0);
 
-				rectangle.z *= size;
-				rectangle.w *= size;
+		t.bind();
 
-				rectangle.y = linePositionY + quad.y0 * size;
+		renderQuadToScreenInternal(*this, target);
+	}
 
-				rectangle.x += rectangle.z + spacing * size;
+	void Renderer2D::flushPostProcess(const std::vector<ShaderProgram> &postProcesses,
+		FrameBuffer frameBuffer, bool clearDrawData)
+	{
 
-				maxPosY = std::max(maxPosY, rectangle.y);
-				maxPos = std::max(maxPos, rectangle.x);
+		if (postProcesses.empty())
+		{
+			if (clearDrawData)
+			{
+				this->clearDrawData();
+				return;
 			}
 		}
 
-		maxPos = std::max(maxPos, rectangle.x);
-		maxPosY = std::max(maxPosY, rectangle.y);
-
-		float paddX = maxPos;
-
-		float paddY = maxPosY;
+		//the quads are flushed into it so it needs a depth buffer for the opaque pass
+		if (!postProcessFbo1.fbo || (opaquePass && !postProcessFbo1.depthTexture))
+		{
+			postProcessFbo1.cleanup();
+			postProcessFbo1.create(0, 0, opaquePass);
+		}
 
-		paddY += font.max_height * size + bonusY;
+		postProcessFbo1.resize(windowW, windowH);
+		captureFrameBufferClear(*this, postProcessFbo1.fbo);
+		postProcessFbo1.clear();
 
-		return glm::vec2{paddX, paddY};
+		flushFBO(postProcessFbo1, clearDrawData);
+		
+		internalPostProcessFlip = 1;
+		postProcessOverATexture(postProcesses, postProcessFbo1.texture, frameBuffer);
 
 	}
 
-	float Renderer2D::determineTextRescaleFitSmaller(const std::string &str,
-		gl2d::Font &f, glm::vec4 transform, float maxSize)
+	void Renderer2D::postProcessOverATexture(const std::vector<ShaderProgram> &postProcesses, 
+		gl2d::Texture in,
+		FrameBuffer frameBuffer)
 	{
-		auto s = getTextSize(str.c_str(), f, maxSize);
+		if (postProcesses.empty())
+			{return;}
 
-		float ratioX = transform.z / s.x;
-		float ratioY = transform.w / s.y;
+		GL2D_GPU_ZONE("gl2d post process");
 
+		//an empty frame buffer means the default fbo
+		if (!frameBuffer.fbo) { frameBuffer.fbo = defaultFBO; }
 
-		if (ratioX > 1 && ratioY > 1)
+		if (!postProcessFbo1.fbo) { postProcessFbo1.create(0, 0); }
+		if (!postProcessFbo2.fbo && postProcesses.size() > 1)
+			{ postProcessFbo2.create(0, 0); }
+		
+		if (internalPostProcessFlip == 0) 
 		{
-			return maxSize;
+			postProcessFbo1.resize(windowW, windowH);
+			captureFrameBufferClear(*this, postProcessFbo1.fbo);
+			postProcessFbo1.clear();
+			postProcessFbo2.resize(windowW, windowH);
+			captureFrameBufferClear(*this, postProcessFbo2.fbo);
+			postProcessFbo2.clear();
 		}
-		else
+		else if(postProcessFbo2.fbo)
 		{
-			if (ratioX < ratioY)
+			//postProcessFbo1 has already been resized
+			postProcessFbo2.resize(windowW, windowH);
+			captureFrameBufferClear(*this, postProcessFbo2.fbo);
+			postProcessFbo2.clear();
+		}
+
+		for (int i = 0; i < postProcesses.size(); i++)
+		{
+			gl2d::FrameBuffer output;
+			gl2d::Texture input;
+
+			if (internalPostProcessFlip == 0)
 			{
-				return maxSize*ratioX;
+				input = postProcessFbo2.texture;
+				output = postProcessFbo1;
 			}
 			else
 			{
-				return maxSize * ratioY;
+				input = postProcessFbo1.texture;
+				output = postProcessFbo2;
 			}
-		}
-	}
-
-
-	float Renderer2D::determineTextRescaleFitBigger(const std::string &str,
-		gl2d::Font &f, glm::vec4 transform, float minSize)
-	{
-		auto s = getTextSize(str.c_str(), f, minSize);
 
-		float ratioX = transform.z / s.x;
-		float ratioY = transform.w / s.y;
-
-
-		if (ratioX > 1 && ratioY > 1)
-		{
-			if (ratioX > ratioY)
+			if (i == 0)
 			{
-				return minSize * ratioY;
+				input = in;
 			}
-			else
+
+			if (i == postProcesses.size() - 1)
 			{
-				return minSize * ratioX;
+				output = frameBuffer;
 			}
-		}
-		else
-		{
+			captureFrameBufferClear(*this, output.fbo);
+			output.clear();
 			
+			renderPostProcess(postProcesses[i], input, output);
+			internalPostProcessFlip = !internalPostProcessFlip;
 		}
 
-		return minSize;
-	
+
+		internalPostProcessFlip = 0;
 	}
 
-	float Renderer2D::determineTextRescaleFit(const std::string &str,
-		gl2d::Font &f, glm::vec4 transform)
+	void invalidateGLStateCache()
 	{
-		float ret = 1;
+		internal::glState.invalidate();
+	}
 
-		auto s = getTextSize(str.c_str(), f, ret);
+	void enableNecessaryGLFeatures()
+	{
+		if (internal::glState.blendState) { return; }
+		internal::glState.blendState = true;
 
-		float ratioX = transform.z / s.x;
-		float ratioY = transform.w / s.y;
+		glEnable(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glBlendEquation(GL_FUNC_ADD);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	}
 
+	///////////////////// Renderer2D - render ///////////////////// 
 
-		if (ratioX > 1 && ratioY > 1)
+	void CommandRecorder::renderRectangle(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
+	{
+		glm::vec2 newOrigin;
+		newOrigin.x = origin.x + transforms.x + (transforms.z / 2);
+		newOrigin.y = origin.y + transforms.y + (transforms.w / 2);
+		renderRectangleAbsRotation(transforms, texture, colors, newOrigin, rotation, textureCoords);
+	}
+
+	void CommandRecorder::renderRectangleAbsRotation(const Rect transforms, 
+		const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
+	{
+		Texture textureCopy = texture;
+
+		if (textureCopy.id == 0)
 		{
-			if (ratioX > ratioY)
-			{
-				return ret * ratioY;
-			}
-			else
-			{
-				return ret * ratioX;
-			}
+			errorFunc("Invalid texture", userDefinedData);
+			textureCopy = white1pxSquareTexture;
 		}
-		else
+
+		if (culling && internal::cullQuad(*this, transforms, origin, rotation))
 		{
-			if (ratioX < ratioY)
-			{
-				return ret * ratioX;
-			}
-			else
-			{
-				return ret * ratioY;
-			}
+			return;
 		}
 
-		return ret;
-	}
+		internal::updateCameraBatch(*this);
 
-	int  Renderer2D::wrap(const std::string &in, gl2d::Font &f,
-		float baseSize, float maxDimension, std::string *outRez)
-	{
-		if (outRez)
+		if (instancedRendering && colors[0] == colors[1] && colors[0] == colors[2] && colors[0] == colors[3])
 		{
-			*outRez = "";
-			outRez->reserve(in.size() + 10);
+			Renderer2DInstance instance;
+			instance.rect = transforms;
+			instance.origin = origin;
+			instance.rotation = glm::radians(std::fmod(rotation, 360.f)); //whole turns are removed like for the vertices
+			instance.color[0] = internal::packColorComponent(colors[0].r);
+			instance.color[1] = internal::packColorComponent(colors[0].g);
+			instance.color[2] = internal::packColorComponent(colors[0].b);
+			instance.color[3] = internal::packColorComponent(colors[0].a);
+			instance.textureCoords[0] = internal::packTextureCoord(textureCoords.x);
+			instance.textureCoords[1] = internal::packTextureCoord(textureCoords.y);
+			instance.textureCoords[2] = internal::packTextureCoord(textureCoords.z);
+			instance.textureCoords[3] = internal::packTextureCoord(textureCoords.w);
+			spriteInstances.push_back(instance);
+
+			spriteQuads.push_back({textureCopy.id, true, textureCopy.opaque && instance.color[3] == 255});
+			if (deferredSorting) { internal::recordSortKey(*this, textureCopy.id); }
+			return;
 		}
 
-		std::string word = "";
-		std::string currentLine = "";
-		currentLine.reserve(in.size() + 10);
+		const size_t vertexPos = spriteVertices.size();
+		spriteVertices.resize(vertexPos + 4);
+		internal::writeQuadVertices(&spriteVertices[vertexPos], transforms, colors, origin, rotation, textureCoords);
 
-		bool wrap = 0;
-		bool newLine = 1;
-		int newLineCounter = 0;
+		spriteQuads.push_back({textureCopy.id, false,
+			textureCopy.opaque && internal::opaqueVertices(&spriteVertices[vertexPos])});
+		if (deferredSorting) { internal::recordSortKey(*this, textureCopy.id); }
+	}
 
-		for (int i = 0; i < in.size(); i++)
+	void CommandRecorder::renderRectangle(const Rect transforms, const Color4f colors[4], const glm::vec2 origin, const float rotation)
+	{
+		renderRectangle(transforms, white1pxSquareTexture, colors, origin, rotation);
+	}
+
+	void CommandRecorder::renderRectangleAbsRotation(const Rect transforms, const Color4f colors[4], const glm::vec2 origin, const float rotation)
+	{
+		renderRectangleAbsRotation(transforms, white1pxSquareTexture, colors, origin, rotation);
+	}
+
+	void CommandRecorder::reserveQuads(size_t n)
+	{
+		spriteVertices.reserve(spriteVertices.size() + n * 4);
+		spriteInstances.reserve(spriteInstances.size() + n);
+		spriteQuads.reserve(spriteQuads.size() + n);
+		if (deferredSorting) { sortKeys.reserve(sortKeys.size() + n); }
+	}
+
+	QuadWriter CommandRecorder::beginQuads(size_t n)
+	{
+		QuadWriter writer;
+		writer.recorder = this;
+		writer.capacity = n;
+		writer.firstVertex = spriteVertices.size();
+		writer.firstQuad = spriteQuads.size();
+
+		if (n == 0) { return writer; }
+
+		writer.addedCameraBatch = internal::updateCameraBatch(*this);
+
+		spriteVertices.resize(writer.firstVertex + n * 4);
+		spriteQuads.resize(writer.firstQuad + n);
+		writer.vertices = spriteVertices.data() + writer.firstVertex;
+		writer.quads = spriteQuads.data() + writer.firstQuad;
+
+		if (deferredSorting && sortKeys.size() == writer.firstQuad)
 		{
-			word.push_back(in[i]);
-			currentLine.push_back(in[i]);
+			sortKeys.resize(writer.firstQuad + n);
+			writer.sortKeys = sortKeys.data() + writer.firstQuad;
+			writer.sortKey = internal::makeSortKey(currentLayer, internal::currentSortShader(*this), 0, 0);
+		}
 
-			if (in[i] == ' ')
+		return writer;
+	}
+
+	namespace internal
+	{
+		//the corners are in the order of the vertices of a rectangle (top left, bottom left, bottom right, top right)
+		void writeCorners(QuadWriter &writer, const glm::vec2 corners[4], const Texture &texture,
+			const GLubyte color[4], const GLushort textureCoords[4])
+		{
+			if (writer.count >= writer.capacity)
 			{
-				if (wrap)
+				if (!writer.overflow)
 				{
-					if (outRez)
-					{
-						outRez->push_back('\n'); currentLine = "";
-					}
-					newLineCounter++;
-
+					errorFunc("QuadWriter overflow, more quads were written than reserved with beginQuads", userDefinedData);
+					writer.overflow = true;
 				}
+				return;
+			}
 
-				if (outRez)
+			if (writer.recorder->culling)
+			{
+				const glm::vec2 min = glm::min(glm::min(corners[0], corners[1]), glm::min(corners[2], corners[3]));
+				const glm::vec2 max = glm::max(glm::max(corners[0], corners[1]), glm::max(corners[2], corners[3]));
+				if (cullBounds(*writer.recorder, min, max)) { return; }
+			}
+
+			Renderer2DVertex *v = writer.vertices + writer.count * 4;
+			v[0].position = corners[0];
+			v[1].position = corners[1];
+			v[2].position = corners[2];
+			v[3].position = corners[3];
+			setVertex(v[0], color, textureCoords[0], textureCoords[1]);
+			setVertex(v[1], color, textureCoords[0], textureCoords[3]);
+			setVertex(v[2], color, textureCoords[2], textureCoords[3]);
+			setVertex(v[3], color, textureCoords[2], textureCoords[1]);
+
+			writer.quads[writer.count] = {texture.id, false, texture.opaque && color[3] == 255};
+
+			if (writer.sortKeys)
+			{
+				writer.sortKeys[writer.count] = writer.sortKey | ((unsigned long long)(texture.id & 0xFFFF) << 24) |
+					((writer.firstQuad + writer.count) & sortIndexMask);
+			}
+
+			writer.count++;
+		}
+
+		//longer miters are beveled, like the default stroke-miterlimit of svg
+		constexpr float miterLimit = 4.f;
+
+		//Writes a polyline, pointAt(i) returns the point i so the points don't have to be stored.
+		//Each segment is one quad that starts on the edge where the previous one ends, so it is
+		//the same geometry as a triangle strip but it is drawn with the other quads.
+		//Bevel joins add a triangle (a quad with 2 equal corners), it needs at most 2 * count quads.
+		template<class PointAt>
+		void writePath(QuadWriter &writer, PointAt pointAt, size_t count, const Color4f color, const float width,
+			const bool closed, const LineJoin join, const LineCap cap)
+		{
+			if (count < 2) { return; }
+
+			const float halfWidth = width / 2.f;
+			const GLubyte packedColor[4] = {packColorComponent(color.r), packColorComponent(color.g),
+				packColorComponent(color.b), packColorComponent(color.a)};
+			const GLushort textureCoords[4] = {0, 65535, 65535, 0};
+
+			auto same = [](glm::vec2 a, glm::vec2 b) { const glm::vec2 d = b - a; return glm::dot(d, d) < 1e-8f; };
+			auto normal = [](glm::vec2 d) { return glm::vec2(-d.y, d.x); };
+
+			auto writeQuad = [&](glm::vec2 a, glm::vec2 b, glm::vec2 c, glm::vec2 d)
+			{
+				const glm::vec2 corners[4] = {a, b, c, d};
+				writeCorners(writer, corners, white1pxSquareTexture, packedColor, textureCoords);
+			};
+
+			const glm::vec2 first = pointAt(0);
+
+			//a closed path doesn't need the first point again at the end
+			size_t n = count;
+			if (closed) { while (n > 1 && same(pointAt(n - 1), first)) { n--; } }
+
+			//the next point that isn't the same as p, when there is none it returns n and the first point
+			auto next = [&](size_t i, glm::vec2 p, glm::vec2 &point)
+			{
+				for (i++; i < n; i++)
 				{
-					*outRez += word;
+					point = pointAt(i);
+					if (!same(p, point)) { return i; }
 				}
-				word = "";
-				wrap = 0;
-				newLine = false;
-			}
-			else if (in[i] == '\n')
+				point = first;
+				return n;
+			};
+
+			struct Edge
 			{
-				if (wrap)
+				glm::vec2 minus = {};
+				glm::vec2 plus = {};
+			};
+
+			auto capEdge = [&](glm::vec2 p, glm::vec2 direction, float extend)
+			{
+				const glm::vec2 o = normal(direction) * halfWidth;
+				p += direction * extend;
+				return Edge{p - o, p + o};
+			};
+			const float capExtend = cap == lineCapSquare ? halfWidth : 0.f;
+
+			//end is where the segment with the direction d0 ends and start where the next one begins,
+			//they are the same for a miter
+			auto joinEdges = [&](glm::vec2 p, glm::vec2 d0, glm::vec2 d1, Edge &end, Edge &start)
+			{
+				const glm::vec2 n0 = normal(d0);
+				const glm::vec2 n1 = normal(d1);
+				const glm::vec2 sum = n0 + n1;
+
+				end = {p - n0 * halfWidth, p + n0 * halfWidth};
+				start = {p - n1 * halfWidth, p + n1 * halfWidth};
+
+				//the straight case, the edges are already the same
+				const float turn = d0.x * d1.y - d0.y * d1.x;
+				if (std::abs(turn) < 1e-6f && glm::dot(d0, d1) > 0) { return; }
+
+				glm::vec2 miter = {};
+				bool hasMiter = false;
+				if (glm::dot(sum, sum) > 1e-6f)
 				{
-					if (outRez)
+					const glm::vec2 m = glm::normalize(sum);
+					const float cosHalfAngle = glm::dot(m, n0);
+					if (cosHalfAngle * miterLimit >= 1.f)
 					{
-						outRez->push_back('\n');
+						miter = m * (halfWidth / cosHalfAngle);
+						hasMiter = true;
 					}
-					newLineCounter++;
 				}
 
-				currentLine = "";
+				if (hasMiter && join == lineJoinMiter)
+				{
+					end = start = {p - miter, p + miter};
+					return;
+				}
 
-				if (outRez)
+				//the segments meet on the inside of the corner if the miter isn't too long,
+				//else they overlap there. The bevel fills the outside.
+				if (turn > 0)
 				{
-					*outRez += word;
+					glm::vec2 inner = p;
+					if (hasMiter) { inner = end.plus = start.plus = p + miter; }
+					writeQuad(inner, end.minus, start.minus, inner);
 				}
-				word = "";
-				wrap = 0;
-				newLine = true;
+				else
+				{
+					glm::vec2 inner = p;
+					if (hasMiter) { inner = end.minus = start.minus = p - miter; }
+					writeQuad(inner, end.plus, start.plus, inner);
+				}
+			};
+
+			glm::vec2 b = {};
+			size_t bIndex = next(0, first, b);
+			if (bIndex >= n) { return; } //all the points are the same
+
+			glm::vec2 direction = glm::normalize(b - first);
+
+			Edge start;
+			Edge closingEnd;
+			if (closed)
+			{
+				joinEdges(first, glm::normalize(first - pointAt(n - 1)), direction, closingEnd, start);
 			}
 			else
 			{
-				//let's check, only if needed
-				if (!wrap && !newLine)
-				{
-					float size = baseSize;
-					auto textSize = getTextSize(currentLine.c_str(), f, size);
-
-					if (textSize.x >= maxDimension && !newLine)
-					{
-						//wrap last word
-						wrap = 1;
-					}
-				};
+				start = capEdge(first, direction, -capExtend);
 			}
 
-		}
+			while (true)
+			{
+				glm::vec2 c = first;
+				const size_t cIndex = bIndex < n ? next(bIndex, b, c) : n;
+				const bool lastSegment = closed ? bIndex == n : cIndex >= n;
+
+				Edge end;
+				Edge nextStart;
+				glm::vec2 nextDirection = {};
+				if (lastSegment)
+				{
+					end = closed ? closingEnd : capEdge(b, direction, capExtend);
+				}
+				else
+				{
+					nextDirection = glm::normalize(c - b);
+					joinEdges(b, direction, nextDirection, end, nextStart);
+				}
 
-		{
-			if (wrap) { if (outRez)outRez->push_back('\n'); newLineCounter++; }
+				writeQuad(start.minus, start.plus, end.plus, end.minus);
 
-			if (outRez)
-			{
-				*outRez += word;
+				if (lastSegment) { break; }
+
+				start = nextStart;
+				b = c;
+				bIndex = cIndex;
+				direction = nextDirection;
 			}
 		}
+	}
 
-		return newLineCounter + 1;
+	void QuadWriter::write(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
+	{
+		glm::vec2 newOrigin;
+		newOrigin.x = origin.x + transforms.x + (transforms.z / 2);
+		newOrigin.y = origin.y + transforms.y + (transforms.w / 2);
+		writeAbsRotation(transforms, texture, colors, newOrigin, rotation, textureCoords);
 	}
 
-	void Renderer2D::renderText(glm::vec2 position, const char *text, const Font font,
-		const Color4f color, const float size, const float spacing, const float line_space, bool showInCenter,
-		const Color4f ShadowColor
-		, const Color4f LightColor
-	)
+	void QuadWriter::writeAbsRotation(const Rect transforms, const Texture texture, const Color4f colors[4], const glm::vec2 origin, const float rotation, const glm::vec4 textureCoords)
 	{
-		if (font.texture.id == 0)
+		if (count >= capacity)
 		{
-			errorFunc("Missing font", userDefinedData);
+			if (!overflow)
+			{
+				errorFunc("QuadWriter overflow, more quads were written than reserved with beginQuads", userDefinedData);
+				overflow = true;
+			}
 			return;
 		}
 
-		const int text_length = (int)strlen(text);
-		Rect rectangle;
-		rectangle.x = position.x;
-		float linePositionY = position.y;
-
-		if (showInCenter)
+		GLuint id = texture.id;
+		if (id == 0)
 		{
-			auto textSize = this->getTextSize(text, font, size, spacing, line_space);
-
-			position.x -= textSize.x / 2.f;
-			position.y += textSize.y / 2.f;
+			errorFunc("Invalid texture", userDefinedData);
+			id = white1pxSquareTexture.id;
 		}
 
-		if (0)
+		if (recorder->culling && internal::cullQuad(*recorder, transforms, origin, rotation))
 		{
-			//This is the y position we render at because it advances when we encounter newlines
+			return;
+		}
 
-			float maxPos = 0;
-			float maxPosY = 0;
+		internal::writeQuadVertices(vertices + count * 4, transforms, colors, origin, rotation, textureCoords);
+		quads[count] = {id, false, texture.opaque && internal::opaqueVertices(vertices + count * 4)};
 
-			for (int i = 0; i < text_length; i++)
-			{
-				if (text[i] == '\n')
-				{
-					rectangle.x = position.x;
-					linePositionY += (font.max_height + line_space) * size;
-				}
-				else if (text[i] == '\t')
-				{
-					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-					(font, '_');
-					auto x = quad.x1 - quad.x0;
+		if (sortKeys)
+		{
+			sortKeys[count] = sortKey | ((unsigned long long)(id & 0xFFFF) << 24) |
+				((firstQuad + count) & internal::sortIndexMask);
+		}
 
-					rectangle.x += x * size * 3 + spacing * size;
-				}
-				else if (text[i] == ' ')
-				{
-					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-					(font, '_');
-					auto x = quad.x1 - quad.x0;
+		count++;
+	}
 
-					rectangle.x += x * size + spacing * size;
-				}
-				else if (text[i] >= ' ' && text[i] <= '~')
-				{
-					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-					(font, text[i]);
+	void QuadWriter::writeQuad(const glm::vec2 corners[4], const Texture texture, const Color4f color, const glm::vec4 textureCoords)
+	{
+		Texture t = texture;
+		if (t.id == 0)
+		{
+			errorFunc("Invalid texture", userDefinedData);
+			t = white1pxSquareTexture;
+		}
 
-					rectangle.z = quad.x1 - quad.x0;
-					rectangle.w = quad.y1 - quad.y0;
+		const GLubyte c[4] = {internal::packColorComponent(color.r), internal::packColorComponent(color.g),
+			internal::packColorComponent(color.b), internal::packColorComponent(color.a)};
+		const GLushort tc[4] = {internal::packTextureCoord(textureCoords.x), internal::packTextureCoord(textureCoords.y),
+			internal::packTextureCoord(textureCoords.z), internal::packTextureCoord(textureCoords.w)};
 
-					rectangle.z *= size;
-					rectangle.w *= size;
+		internal::writeCorners(*this, corners, t, c, tc);
+	}
 
-					rectangle.y = linePositionY + quad.y0 * size;
+	void QuadWriter::writeLine(const glm::vec2 start, const glm::vec2 end, const Color4f color, const float width)
+	{
+		const glm::vec2 points[2] = {start, end};
+		writePolyline(points, 2, color, width);
+	}
 
+	void QuadWriter::writePolyline(const glm::vec2 *points, size_t count, const Color4f color, const float width,
+		const bool closed, const LineJoin join, const LineCap cap)
+	{
+		internal::writePath(*this, [points](size_t i) { return points[i]; }, count, color, width, closed, join, cap);
+	}
 
-					rectangle.x += rectangle.z + spacing * size;
-					maxPos = std::max(maxPos, rectangle.x);
-					maxPosY = std::max(maxPosY, rectangle.y);
-				}
+	void QuadWriter::writeBatch(const Rect *rects, const glm::vec2 *origins, const float *rotations, const Color4f *colors,
+		size_t n, const Texture texture, const glm::vec4 textureCoords)
+	{
+		//culling is done for each quad
+		if (recorder && recorder->culling)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				Color4f c[4] = {Colors_White, Colors_White, Colors_White, Colors_White};
+				if (colors) { c[0] = c[1] = c[2] = c[3] = colors[i]; }
+				writeAbsRotation(rects[i], texture, c, origins[i], rotations[i], textureCoords);
+			}
+			return;
+		}
+
+		if (count + n > capacity)
+		{
+			if (!overflow)
+			{
+				errorFunc("QuadWriter overflow, more quads were written than reserved with beginQuads", userDefinedData);
+				overflow = true;
 			}
+			n = capacity - count;
+		}
 
-			float padd = maxPos - position.x;
-			padd /= 2;
-			position.x -= padd;
+		if (n == 0) { return; }
 
-			float paddY = maxPosY - position.y;
-			position.y -= paddY;
+		GLuint id = texture.id;
+		if (id == 0)
+		{
+			errorFunc("Invalid texture", userDefinedData);
+			id = white1pxSquareTexture.id;
 		}
 
-		rectangle = {};
-		rectangle.x = position.x;
+		Renderer2DVertex *v = vertices + count * 4;
+		transformQuads(rects, origins, rotations, n, v);
 
-		//This is the y position we render at because it advances when we encounter newlines
-		linePositionY = position.y;
+		const GLushort u0 = internal::packTextureCoord(textureCoords.x);
+		const GLushort t0 = internal::packTextureCoord(textureCoords.y);
+		const GLushort u1 = internal::packTextureCoord(textureCoords.z);
+		const GLushort t1 = internal::packTextureCoord(textureCoords.w);
 
-		for (int i = 0; i < text_length; i++)
+		GLubyte c[4] = {255, 255, 255, 255};
+		for (size_t i = 0; i < n; i++, v += 4)
 		{
-			if (text[i] == '\n')
+			if (colors)
 			{
-				rectangle.x = position.x;
-				linePositionY += (font.max_height + line_space) * size;
+				c[0] = internal::packColorComponent(colors[i].r);
+				c[1] = internal::packColorComponent(colors[i].g);
+				c[2] = internal::packColorComponent(colors[i].b);
+				c[3] = internal::packColorComponent(colors[i].a);
 			}
-			else if (text[i] == '\t')
-			{
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, '_');
-				auto x = quad.x1 - quad.x0;
 
-				rectangle.x += x * size * 3 + spacing * size;
-			}
-			else if (text[i] == ' ')
+			internal::setVertex(v[0], c, u0, t0);
+			internal::setVertex(v[1], c, u0, t1);
+			internal::setVertex(v[2], c, u1, t1);
+			internal::setVertex(v[3], c, u1, t0);
+
+			quads[count + i] = {id, false, texture.opaque && c[3] == 255};
+		}
+
+		if (sortKeys)
+		{
+			for (size_t i = 0; i < n; i++)
 			{
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, '_');
-				auto x = quad.x1 - quad.x0;
-				rectangle.x += x * size + spacing * size;
+				sortKeys[count + i] = sortKey | ((unsigned long long)(id & 0xFFFF) << 24) |
+					((firstQuad + count + i) & internal::sortIndexMask);
 			}
-			else if (text[i] >= ' ' && text[i] <= '~')
-			{
+		}
 
-				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
-				(font, text[i]);
+		count += n;
+	}
 
-				rectangle.z = quad.x1 - quad.x0;
-				rectangle.w = quad.y1 - quad.y0;
+	void QuadWriter::end()
+	{
+		if (!recorder) { return; }
 
-				rectangle.z *= size;
-				rectangle.w *= size;
+		//give back the quads that were not written
+		recorder->spriteVertices.resize(firstVertex + count * 4);
+		recorder->spriteQuads.resize(firstQuad + count);
+		if (sortKeys) { recorder->sortKeys.resize(firstQuad + count); }
+
+		//don't leave an empty camera batch
+		if (addedCameraBatch && count == 0) { recorder->cameraBatches.pop_back(); }
+
+		*this = {};
+	}
+
+	void CommandRecorder::renderLine(const glm::vec2 position, const float angleDegrees, const float length, const Color4f color, const float width)
+	{
+		//the rotation goes the same way as for rectangles, y goes down
+		const float a = -glm::radians(angleDegrees);
+		renderLine(position, position + glm::vec2(std::cos(a), std::sin(a)) * length, color, width);
+	}
+
+	void CommandRecorder::renderLine(const glm::vec2 start, const glm::vec2 end, const Color4f color, const float width) 
+	{
+		auto writer = beginQuads(1);
+		writer.writeLine(start, end, color, width);
+		writer.end();
+	}
+
+	void CommandRecorder::renderPolyline(const glm::vec2 *points, size_t count, const Color4f color, const float width,
+		const bool closed, const LineJoin join, const LineCap cap)
+	{
+		if (count < 2) { return; }
+
+		auto writer = beginQuads(count * 2);
+		writer.writePolyline(points, count, color, width, closed, join, cap);
+		writer.end();
+	}
+
+	void CommandRecorder::renderRectangleOutline(const glm::vec4 position, const Color4f color, const float width,
+		const glm::vec2 origin, const float rotationDegrees)
+	{
+		glm::vec2 corners[4] =
+		{
+			glm::vec2(position),
+			glm::vec2(position) + glm::vec2(position.z, 0),
+			glm::vec2(position) + glm::vec2(position.z, position.w),
+			glm::vec2(position) + glm::vec2(0, position.w),
+		};
+
+		if (rotationDegrees != 0) 
+		{
+			glm::vec2 o = origin + glm::vec2(position.x, -position.y) + glm::vec2(position.z, -position.w) / 2.f;
+
+			for (auto &c : corners) { c = rotateAroundPoint(c, o, -rotationDegrees); }
+		}
+
+		renderPolyline(corners, 4, color, width, true);
+	}
+
+	void  CommandRecorder::renderCircleOutline(const glm::vec2 position,
+		const float size, const Color4f color,
+		const float width, const unsigned int segments)
+	{
+	
+		auto calcPos = [&](size_t p)
+		{
+			glm::vec2 circle = {size,0};
+
+			float a = 3.1415926 * 2 * ((float)p / segments);
+
+			float c = std::cos(a);
+			float s = std::sin(a);
+
+			circle = {c * circle.x - s * circle.y, s * circle.x + c * circle.y};
+
+			return circle + position;
+		};
+
+		auto writer = beginQuads(segments * 2);
+		internal::writePath(writer, calcPos, segments, color, width, true, lineJoinMiter, lineCapButt);
+		writer.end();
+
+	}
+
+	//the shapes are rectangles with the white texture, the parameter is stored in the texture coordonates
+	void renderShape(CommandRecorder &renderer, const Rect transforms, const Color4f color, const glm::vec2 origin,
+		const float rotation, const GLubyte shape, const float parameter)
+	{
+		const size_t quadCount = renderer.spriteQuads.size();
+
+		renderer.renderRectangle(transforms, white1pxSquareTexture, color, origin, rotation,
+			{parameter, 0, parameter, 0});
+
+		//it was culled
+		if (renderer.spriteQuads.size() == quadCount) { return; }
+
+		//the edge is anti-aliased
+		auto &quad = renderer.spriteQuads.back();
+		quad.opaque = false;
+
+		if (quad.instanced)
+		{
+			renderer.spriteInstances.back().textureSlot = shape;
+		}
+		else
+		{
+			Renderer2DVertex *v = &renderer.spriteVertices[renderer.spriteVertices.size() - 4];
+			v[0].textureSlot = shape;
+			v[1].textureSlot = shape;
+			v[2].textureSlot = shape;
+			v[3].textureSlot = shape;
+		}
+	}
+
+	void CommandRecorder::renderCircle(const glm::vec2 center, const float radius, const Color4f color)
+	{
+		renderShape(*this, {center - glm::vec2(radius), radius * 2, radius * 2}, color, {}, 0,
+			internal::shapeCircle, 0);
+	}
+
+	void CommandRecorder::renderRing(const glm::vec2 center, const float radius, const float width, const Color4f color)
+	{
+		const float outer = radius + width / 2.f;
+		const float inner = std::max(radius - width / 2.f, 0.f);
+		if (outer <= 0) { return; }
+
+		renderShape(*this, {center - glm::vec2(outer), outer * 2, outer * 2}, color, {}, 0,
+			internal::shapeRing, inner / outer);
+	}
+
+	void CommandRecorder::renderRoundedRect(const Rect transforms, const float cornerRadius, const Color4f color,
+		const glm::vec2 origin, const float rotationDegrees)
+	{
+		const float halfSize = std::min(transforms.z, transforms.w) / 2.f;
+		const float parameter = halfSize > 0 ? glm::clamp(cornerRadius / halfSize, 0.f, 1.f) : 0.f;
+
+		renderShape(*this, transforms, color, origin, rotationDegrees, internal::shapeRoundedRect, parameter);
+	}
+
+
+
+	void CommandRecorder::render9Patch(const Rect position, const int borderSize, const Color4f color, const glm::vec2 origin, const float rotation, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords)
+	{
+		glm::vec4 colorData[4] = { color, color, color, color };
+
+		auto writer = beginQuads(9);
+
+		//inner
+		Rect innerPos = position;
+		innerPos.x += borderSize;
+		innerPos.y += borderSize;
+		innerPos.z -= borderSize * 2;
+		innerPos.w -= borderSize * 2;
+		writer.write(innerPos, texture, colorData, Position2D{ 0, 0 }, 0, inner_texture_coords);
+
+		//top
+		Rect topPos = position;
+		topPos.x += borderSize;
+		topPos.z -= (float)borderSize * 2;
+		topPos.w = (float)borderSize;
+		glm::vec4 upperTexPos;
+		upperTexPos.x = inner_texture_coords.x;
+		upperTexPos.y = textureCoords.y;
+		upperTexPos.z = inner_texture_coords.z;
+		upperTexPos.w = inner_texture_coords.y;
+		writer.write(topPos, texture, colorData, Position2D{ 0, 0 }, 0, upperTexPos);
+
+		//bottom
+		Rect bottom = position;
+		bottom.x += (float)borderSize;
+		bottom.y += (float)position.w - borderSize;
+		bottom.z -= (float)borderSize * 2;
+		bottom.w = (float)borderSize;
+		glm::vec4 bottomTexPos;
+		bottomTexPos.x = inner_texture_coords.x;
+		bottomTexPos.y = inner_texture_coords.w;
+		bottomTexPos.z = inner_texture_coords.z;
+		bottomTexPos.w = textureCoords.w;
+		writer.write(bottom, texture, colorData, Position2D{ 0, 0 }, 0, bottomTexPos);
+
+		//left
+		Rect left = position;
+		left.y += borderSize;
+		left.z = (float)borderSize;
+		left.w -= (float)borderSize * 2;
+		glm::vec4 leftTexPos;
+		leftTexPos.x = textureCoords.x;
+		leftTexPos.y = inner_texture_coords.y;
+		leftTexPos.z = inner_texture_coords.x;
+		leftTexPos.w = inner_texture_coords.w;
+		writer.write(left, texture, colorData, Position2D{ 0, 0 }, 0, leftTexPos);
+
+		//right
+		Rect right = position;
+		right.x += position.z - borderSize;
+		right.y += borderSize;
+		right.z = (float)borderSize;
+		right.w -= (float)borderSize * 2;
+		glm::vec4 rightTexPos;
+		rightTexPos.x = inner_texture_coords.z;
+		rightTexPos.y = inner_texture_coords.y;
+		rightTexPos.z = textureCoords.z;
+		rightTexPos.w = inner_texture_coords.w;
+		writer.write(right, texture, colorData, Position2D{ 0, 0 }, 0, rightTexPos);
+
+		//topleft
+		Rect topleft = position;
+		topleft.z = (float)borderSize;
+		topleft.w = (float)borderSize;
+		glm::vec4 topleftTexPos;
+		topleftTexPos.x = textureCoords.x;
+		topleftTexPos.y = textureCoords.y;
+		topleftTexPos.z = inner_texture_coords.x;
+		topleftTexPos.w = inner_texture_coords.y;
+		writer.write(topleft, texture, colorData, Position2D{ 0, 0 }, 0, topleftTexPos);
+
+		//topright
+		Rect topright = position;
+		topright.x += position.z - borderSize;
+		topright.z = (float)borderSize;
+		topright.w = (float)borderSize;
+		glm::vec4 toprightTexPos;
+		toprightTexPos.x = inner_texture_coords.z;
+		toprightTexPos.y = textureCoords.y;
+		toprightTexPos.z = textureCoords.z;
+		toprightTexPos.w = inner_texture_coords.y;
+		writer.write(topright, texture, colorData, Position2D{ 0, 0 }, 0, toprightTexPos);
+
+		//bottomleft
+		Rect bottomleft = position;
+		bottomleft.y += position.w - borderSize;
+		bottomleft.z = (float)borderSize;
+		bottomleft.w = (float)borderSize;
+		glm::vec4 bottomleftTexPos;
+		bottomleftTexPos.x = textureCoords.x;
+		bottomleftTexPos.y = inner_texture_coords.w;
+		bottomleftTexPos.z = inner_texture_coords.x;
+		bottomleftTexPos.w = textureCoords.w;
+		writer.write(bottomleft, texture, colorData, Position2D{ 0, 0 }, 0, bottomleftTexPos);
+
+		//bottomright
+		Rect bottomright = position;
+		bottomright.y += position.w - borderSize;
+		bottomright.x += position.z - borderSize;
+		bottomright.z = (float)borderSize;
+		bottomright.w = (float)borderSize;
+		glm::vec4 bottomrightTexPos;
+		bottomrightTexPos.x = inner_texture_coords.z;
+		bottomrightTexPos.y = inner_texture_coords.w;
+		bottomrightTexPos.z = textureCoords.z;
+		bottomrightTexPos.w = textureCoords.w;
+		writer.write(bottomright, texture, colorData, Position2D{ 0, 0 }, 0, bottomrightTexPos);
+
+		writer.end();
+	}
+
+	void CommandRecorder::render9Patch2(const Rect position, const Color4f color, const glm::vec2 origin, const float rotation, const Texture texture, const Texture_Coords textureCoords, const Texture_Coords inner_texture_coords)
+	{
+		glm::vec4 colorData[4] = { color, color, color, color };
+
+		auto writer = beginQuads(9);
+
+		float textureSpaceW = textureCoords.z - textureCoords.x;
+		float textureSpaceH = textureCoords.y - textureCoords.w;
+
+		float topBorder = (textureCoords.y - inner_texture_coords.y) / textureSpaceH * position.w;
+		float bottomBorder = (inner_texture_coords.w - textureCoords.w) / textureSpaceH * position.w;
+		float leftBorder = (inner_texture_coords.x - textureCoords.x) / textureSpaceW * position.z;
+		float rightBorder = (textureCoords.z - inner_texture_coords.z) / textureSpaceW * position.z;
+
+		float newAspectRatio = position.z / position.w;
+		
+		if (newAspectRatio < 1.f) 
+		{
+			topBorder *= newAspectRatio;
+			bottomBorder *= newAspectRatio;
+		}
+		else
+		{
+			leftBorder /= newAspectRatio;
+			rightBorder /= newAspectRatio;
+		}
+
+	
+
+		//topBorder = 50;
+		//bottomBorder = -50;
+		//leftBorder = 0;
+		//rightBorder = 0;
+
+
+		//inner
+		Rect innerPos = position;
+		innerPos.x += leftBorder;
+		innerPos.y += topBorder;
+		innerPos.z -= leftBorder + rightBorder;
+		innerPos.w -= topBorder + bottomBorder;
+		writer.write(innerPos, texture, colorData, Position2D{ 0, 0 }, 0, inner_texture_coords);
+
+		//top
+		Rect topPos = position;
+		topPos.x += leftBorder;
+		topPos.z -= leftBorder + rightBorder;
+		topPos.w = topBorder;
+		glm::vec4 upperTexPos;
+		upperTexPos.x = inner_texture_coords.x;
+		upperTexPos.y = textureCoords.y;
+		upperTexPos.z = inner_texture_coords.z;
+		upperTexPos.w = inner_texture_coords.y;
+		writer.write(topPos, texture, colorData, Position2D{ 0, 0 }, 0, upperTexPos);
+
+		//Rect topPos = position;
+		//topPos.x += leftBorder;
+		//topPos.w = topBorder;
+		//topPos.z = topBorder;
+		//float end = rightBorder;
+		//float size = topBorder;
+		//
+		//while(1)
+		//{
+		//	if(topPos.x + size <= end)
+		//	{
+		//
+		//		//draw
+		//		renderRectangle(topPos, colorData, Position2D{ 0, 0 }, 0, texture, upperTexPos);
+		//
+		//		topPos += size;
+		//	}else
+		//	{
+		//		float newW = end - topPos.x;
+		//		if(newW>0)
+		//		{
+		//			topPos.z = newW;
+		//			renderRectangle(topPos, colorData, Position2D{ 0, 0 }, 0, texture, upperTexPos);
+		//		}
+		//		break;
+		//	}
+		//
+		//}
+
+
+		//bottom
+		Rect bottom = position;
+		bottom.x += leftBorder;
+		bottom.y += (float)position.w - bottomBorder;
+		bottom.z -= leftBorder + rightBorder;
+		bottom.w = bottomBorder;
+		glm::vec4 bottomTexPos;
+		bottomTexPos.x = inner_texture_coords.x;
+		bottomTexPos.y = inner_texture_coords.w;
+		bottomTexPos.z = inner_texture_coords.z;
+		bottomTexPos.w = textureCoords.w;
+		writer.write(bottom, texture, colorData, Position2D{ 0, 0 }, 0, bottomTexPos);
+
+		//left
+		Rect left = position;
+		left.y += topBorder;
+		left.z = leftBorder;
+		left.w -= topBorder + bottomBorder;
+		glm::vec4 leftTexPos;
+		leftTexPos.x = textureCoords.x;
+		leftTexPos.y = inner_texture_coords.y;
+		leftTexPos.z = inner_texture_coords.x;
+		leftTexPos.w = inner_texture_coords.w;
+		writer.write(left, texture, colorData, Position2D{ 0, 0 }, 0, leftTexPos);
+
+		//right
+		Rect right = position;
+		right.x += position.z - rightBorder;
+		right.y += topBorder;
+		right.z = rightBorder;
+		right.w -= topBorder + bottomBorder;
+		glm::vec4 rightTexPos;
+		rightTexPos.x = inner_texture_coords.z;
+		rightTexPos.y = inner_texture_coords.y;
+		rightTexPos.z = textureCoords.z;
+		rightTexPos.w = inner_texture_coords.w;
+		writer.write(right, texture, colorData, Position2D{ 0, 0 }, 0, rightTexPos);
+
+		//topleft
+		Rect topleft = position;
+		topleft.z = leftBorder;
+		topleft.w = topBorder;
+		glm::vec4 topleftTexPos;
+		topleftTexPos.x = textureCoords.x;
+		topleftTexPos.y = textureCoords.y;
+		topleftTexPos.z = inner_texture_coords.x;
+		topleftTexPos.w = inner_texture_coords.y;
+		writer.write(topleft, texture, colorData, Position2D{ 0, 0 }, 0, topleftTexPos);
+		//repair here?
+
+
+		//topright
+		Rect topright = position;
+		topright.x += position.z - rightBorder;
+		topright.z = rightBorder;
+		topright.w = topBorder;
+		glm::vec4 toprightTexPos;
+		toprightTexPos.x = inner_texture_coords.z;
+		toprightTexPos.y = textureCoords.y;
+		toprightTexPos.z = textureCoords.z;
+		toprightTexPos.w = inner_texture_coords.y;
+		writer.write(topright, texture, colorData, Position2D{ 0, 0 }, 0, toprightTexPos);
+
+		//bottomleft
+		Rect bottomleft = position;
+		bottomleft.y += position.w - bottomBorder;
+		bottomleft.z = leftBorder;
+		bottomleft.w = bottomBorder;
+		glm::vec4 bottomleftTexPos;
+		bottomleftTexPos.x = textureCoords.x;
+		bottomleftTexPos.y = inner_texture_coords.w;
+		bottomleftTexPos.z = inner_texture_coords.x;
+		bottomleftTexPos.w = textureCoords.w;
+		writer.write(bottomleft, texture, colorData, Position2D{ 0, 0 }, 0, bottomleftTexPos);
+
+		//bottomright
+		Rect bottomright = position;
+		bottomright.y += position.w - bottomBorder;
+		bottomright.x += position.z - rightBorder;
+		bottomright.z = rightBorder;
+		bottomright.w = bottomBorder;
+		glm::vec4 bottomrightTexPos;
+		bottomrightTexPos.x = inner_texture_coords.z;
+		bottomrightTexPos.y = inner_texture_coords.w;
+		bottomrightTexPos.z = textureCoords.z;
+		bottomrightTexPos.w = textureCoords.w;
+		writer.write(bottomright, texture, colorData, Position2D{ 0, 0 }, 0, bottomrightTexPos);
+
+		writer.end();
+	}
+
+	void Renderer2D::create(GLuint fbo, size_t quadCount)
+	{
+		if (!hasInitialized)
+		{
+			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
+		}
+
+		defaultFBO = fbo;
+
+		clearDrawData();
+		spriteVertices.reserve(quadCount * 4);
+		spriteInstances.reserve(quadCount);
+		spriteQuads.reserve(quadCount);
+
+		this->resetCameraAndShader();
+
+		glGenVertexArrays(1, &vao);
+		internal::bindVertexArray(vao);
+
+		glGenBuffers(Renderer2DBufferType::bufferSize, buffers);
+
+		//enough space for a few flushes at the reserved capacity
+		streamBuffer.create(std::max<size_t>(quadCount * 4 * sizeof(Renderer2DVertex) * 4, 1024 * 1024));
+
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glEnableVertexAttribArray(8);
+		glEnableVertexAttribArray(10);
+		setVertexAttributes(streamBuffer.buffer, 0);
+
+		indexBufferQuadCapacity = 0;
+		ensureIndexBufferCapacity(*this, std::max<size_t>(quadCount, 1));
+
+		//the instances don't have per vertex attributes,
+		//the corner is computed from gl_VertexID
+		glGenVertexArrays(1, &instanceVao);
+		internal::bindVertexArray(instanceVao);
+
+		for (int i = 3; i <= 11; i++)
+		{
+			if (i == 8 || i == 10) { continue; } //quad_textureSlot and quad_depth are per vertex
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+		setInstanceAttributes(streamBuffer.buffer, 0);
+
+		internal::bindVertexArray(0);
+	}
+
+	void Renderer2D::cleanup()
+	{
+		internal::forgetVertexArray(vao);
+		internal::forgetVertexArray(instanceVao);
+		glDeleteVertexArrays(1, &vao);
+		glDeleteVertexArrays(1, &instanceVao);
+		glDeleteBuffers(Renderer2DBufferType::bufferSize, buffers);
+		streamBuffer.cleanup();
+		indexBufferQuadCapacity = 0;
+
+		postProcessFbo1.cleanup();
+		postProcessFbo2.cleanup();
+		internalPostProcessFlip = 0;
+	}
+
+	void CommandRecorder::copySettings(const CommandRecorder &other)
+	{
+		instancedRendering = other.instancedRendering;
+		culling = other.culling;
+		deferredSorting = other.deferredSorting;
+		windowW = other.windowW;
+		windowH = other.windowH;
+		currentCamera = other.currentCamera;
+		currentShader = other.currentShader;
+		currentLayer = other.currentLayer;
+	}
+
+	void Renderer2D::submit(CommandRecorder &recorder)
+	{
+		if (&recorder == this) { return; }
+
+		if (deferredSorting != recorder.deferredSorting)
+		{
+			errorFunc("The CommandRecorder and the Renderer2D don't have the same deferredSorting setting, use copySettings", userDefinedData);
+		}
+
+		const size_t firstQuad = spriteQuads.size();
+		const bool sortKeysValid = sortKeys.size() == spriteQuads.size() &&
+			recorder.sortKeys.size() == recorder.spriteQuads.size();
+
+		spriteVertices.insert(spriteVertices.end(), recorder.spriteVertices.begin(), recorder.spriteVertices.end());
+		spriteInstances.insert(spriteInstances.end(), recorder.spriteInstances.begin(), recorder.spriteInstances.end());
+		spriteQuads.insert(spriteQuads.end(), recorder.spriteQuads.begin(), recorder.spriteQuads.end());
+
+		//the submission time starts with the first quad recorded by any of the recorders
+		if (recorder.recordingStart && (!recordingStart || recorder.recordingStart < recordingStart))
+		{
+			recordingStart = recorder.recordingStart;
+		}
+
+		for (auto batch : recorder.cameraBatches)
+		{
+			batch.firstQuad += firstQuad;
+
+			//the quads are contiguous so the batch can continue the last one if nothing changed
+			if (!cameraBatches.empty() && internal::sameCamera(cameraBatches.back().camera, batch.camera) &&
+				cameraBatches.back().windowW == batch.windowW && cameraBatches.back().windowH == batch.windowH)
+			{
+				continue;
+			}
+
+			cameraBatches.push_back(batch);
+		}
+
+		if (deferredSorting && sortKeysValid)
+		{
+			//the shader bits are an index in the sortShaders of the recorder
+			int shaderRemap[256] = {};
+			for (size_t i = 0; i < recorder.sortShaders.size(); i++)
+			{
+				int shader = -1;
+				for (int j = 0; j < (int)sortShaders.size(); j++)
+				{
+					if (sortShaders[j].id == recorder.sortShaders[i].id) { shader = j; break; }
+				}
+
+				if (shader < 0)
+				{
+					if (sortShaders.size() >= 256)
+					{
+						errorFunc("More than 256 shaders used in one flush with deferredSorting", userDefinedData);
+						shader = 255;
+					}
+					else
+					{
+						shader = (int)sortShaders.size();
+						sortShaders.push_back(recorder.sortShaders[i]);
+					}
+				}
+
+				shaderRemap[i] = shader;
+			}
+
+			sortKeys.reserve(sortKeys.size() + recorder.sortKeys.size());
+			for (size_t i = 0; i < recorder.sortKeys.size(); i++)
+			{
+				const unsigned long long key = recorder.sortKeys[i];
+				const unsigned long long layerAndTexture = key & ~((0xFFull << 40) | internal::sortIndexMask);
+
+				sortKeys.push_back(layerAndTexture |
+					((unsigned long long)shaderRemap[internal::sortKeyShader(key)] << 40) |
+					((firstQuad + i) & internal::sortIndexMask));
+			}
+		}
+
+		recorder.clearDrawData();
+	}
+
+	void Renderer2D::endFrameStats()
+	{
+		if (statsHistory.empty())
+		{
+			statsHistory.resize(120);
+		}
+
+		statsHistory[statsHistoryNext] = stats;
+		statsHistoryNext = (statsHistoryNext + 1) % statsHistory.size();
+		statsHistoryCount = std::min(statsHistoryCount + 1, statsHistory.size());
+
+		stats = {};
+	}
+
+	Renderer2D::Stats Renderer2D::getFrameStats(size_t framesAgo)
+	{
+		if (framesAgo >= statsHistoryCount)
+		{
+			return {};
+		}
+
+		return statsHistory[(statsHistoryNext + statsHistory.size() - 1 - framesAgo) % statsHistory.size()];
+	}
+
+	void Renderer2D::setStatsHistorySize(size_t frames)
+	{
+		statsHistory.clear();
+		statsHistory.resize(std::max<size_t>(frames, 1));
+		statsHistoryNext = 0;
+		statsHistoryCount = 0;
+	}
+
+	bool Renderer2D::dumpStatsCSV(const char *fileName)
+	{
+		std::ofstream file(fileName);
+
+		if (!file.is_open())
+		{
+			std::string e = "error openning: "; e += fileName;
+			errorFunc(e.c_str(), userDefinedData);
+			return false;
+		}
+
+		file << "frame,flushes,drawCalls,quads,vertices,bytesUploaded,textureBinds,shaderChanges,postProcessPasses,"
+			"opaqueQuads,submissionMs,flushMs,breakTextureSlots,breakShader,breakCamera,breakInstancing,breakFlush,"
+			"breakFrameBuffer,breakFullScreen,breakOpaquePass\n";
+
+		for (size_t i = 0; i < statsHistoryCount; i++)
+		{
+			auto s = getFrameStats(statsHistoryCount - 1 - i);
+
+			file << i << ',' << s.flushes << ',' << s.drawCalls << ',' << s.quads << ',' << s.vertices << ','
+				<< s.bytesUploaded << ',' << s.textureBinds << ',' << s.shaderChanges << ','
+				<< s.postProcessPasses << ',' << s.opaqueQuads << ',' << s.submissionMs << ',' << s.flushMs;
+
+			for (int b = 0; b < Stats::batchBreakCount; b++)
+			{
+				file << ',' << s.batchBreaks[b];
+			}
+
+			file << '\n';
+		}
+
+		return (bool)file;
+	}
+
+	void CommandRecorder::pushShader(ShaderProgram s)
+	{
+		shaderPushPop.push_back(currentShader);
+		currentShader = s;
+	}
+
+	void CommandRecorder::popShader()
+	{
+		if (shaderPushPop.empty())
+		{
+			errorFunc("Pop on an empty stack on popShader", userDefinedData);
+		}
+		else
+		{
+			currentShader = shaderPushPop.back();
+			shaderPushPop.pop_back();
+		}
+	}
+
+	void CommandRecorder::pushLayer(int layer)
+	{
+		layerPushPop.push_back(currentLayer);
+		currentLayer = layer;
+	}
+
+	void CommandRecorder::popLayer()
+	{
+		if (layerPushPop.empty())
+		{
+			errorFunc("Pop on an empty stack on popLayer", userDefinedData);
+		}
+		else
+		{
+			currentLayer = layerPushPop.back();
+			layerPushPop.pop_back();
+		}
+	}
+
+	void CommandRecorder::pushCamera(Camera c)
+	{
+		cameraPushPop.push_back(currentCamera);
+		currentCamera = c;
+	}
+
+	void CommandRecorder::popCamera()
+	{
+		if (cameraPushPop.empty())
+		{
+			errorFunc("Pop on an empty stack on popCamera", userDefinedData);
+		}
+		else
+		{
+			currentCamera = cameraPushPop.back();
+			cameraPushPop.pop_back();
+		}
+	}
+
+	glm::vec4 CommandRecorder::getViewRect()
+	{
+		auto rect = glm::vec4{0, 0, windowW, windowH};
+
+		glm::mat3 mat = 
+		{1.f, 0, currentCamera.position.x ,
+		 0, 1.f, currentCamera.position.y,
+		 0, 0, 1.f};
+		mat = glm::transpose(mat);
+
+		glm::vec3 pos1 = {rect.x, rect.y, 1.f};
+		glm::vec3 pos2 = {rect.z + rect.x, rect.w + rect.y, 1.f};
+
+		pos1 = mat * pos1;
+		pos2 = mat * pos2;
+		
+		glm::vec2 point((pos1.x + pos2.x) / 2.f, (pos1.y + pos2.y) / 2.f);
+
+		pos1 = glm::vec3(scaleAroundPoint(pos1, point, 1.f/currentCamera.zoom), 1.f);
+		pos2 = glm::vec3(scaleAroundPoint(pos2, point, 1.f/currentCamera.zoom), 1.f);
+
+		rect = {pos1.x, pos1.y, pos2.x - pos1.x, pos2.y - pos1.y};
+
+		return rect;
+	}
+
+	glm::vec4 CommandRecorder::getViewBounds()
+	{
+		return internal::computeViewBounds(currentCamera, windowW, windowH);
+	}
+
+	glm::vec4 CommandRecorder::toScreen(const glm::vec4& transform)
+	{
+		//We need to flip texture_transforms.y
+		const float transformsY = transform.y * -1;
+
+		glm::vec2 v1 = { transform.x,				  transformsY };
+		glm::vec2 v2 = { transform.x,				  transformsY - transform.w };
+		glm::vec2 v3 = { transform.x + transform.z, transformsY - transform.w };
+		glm::vec2 v4 = { transform.x + transform.z, transformsY };
+
+		//Apply camera transformations
+		v1.x -= currentCamera.position.x;
+		v1.y += currentCamera.position.y;
+		v2.x -= currentCamera.position.x;
+		v2.y += currentCamera.position.y;
+		v3.x -= currentCamera.position.x;
+		v3.y += currentCamera.position.y;
+		v4.x -= currentCamera.position.x;
+		v4.y += currentCamera.position.y;
+
+		//Apply camera zoom
+		//if(renderer->currentCamera.zoom != 1)
+		{
+
+			glm::vec2 cameraCenter;
+			cameraCenter.x = windowW / 2.0f;
+			cameraCenter.y = -windowH / 2.0f;
+
+			v1 = scaleAroundPoint(v1, cameraCenter, currentCamera.zoom);
+			v3 = scaleAroundPoint(v3, cameraCenter, currentCamera.zoom);
+		}
+
+		v1.x = internal::positionToScreenCoordsX(v1.x, (float)windowW);
+		v3.x = internal::positionToScreenCoordsX(v3.x, (float)windowW);
+		v1.y = internal::positionToScreenCoordsY(v1.y, (float)windowH);
+		v3.y = internal::positionToScreenCoordsY(v3.y, (float)windowH);
+
+		return glm::vec4(v1.x, v1.y, v3.x, v3.y);
+	}
+
+	glm::vec2 CommandRecorder::getTextSize(const char *text, const Font font,
+		const float size, const float spacing, const float line_space)
+	{
+		if (font.texture.id == 0)
+		{
+			errorFunc("Missing font", userDefinedData);
+			return {};
+		}
+
+		glm::vec2 position = {};
+
+		const int text_length = (int)strlen(text);
+		Rect rectangle = {};
+		rectangle.x = position.x;
+		float linePositionY = position.y;
+
+		//This is the y position we render at because it advances when we encounter newlines
+		float maxPos = 0;
+		float maxPosY = 0;
+		float bonusY = 0;
+
+		for (int i = 0; i < text_length; i++)
+		{
+			if (text[i] == '\n')
+			{
+				rectangle.x = position.x;
+				linePositionY += (font.max_height + line_space) * size;
+				bonusY += (font.max_height + line_space) * size;
+				maxPosY = 0;
+			}
+			else if (text[i] == '\t')
+			{
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, '_');
+				auto x = quad.x1 - quad.x0;
+
+				rectangle.x += x * size * 3 + spacing * size;
+			}
+			else if (text[i] == ' ')
+			{
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, '_');
+				auto x = quad.x1 - quad.x0;
+
+				rectangle.x += x * size + spacing * size;
+			}
+			else if (text[i] >= ' ' && text[i] <= '~')
+			{
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, text[i]);
+
+				rectangle.z = quad.x1 - quad.x0;
+				rectangle.w = quad.y1 - quad.y0;
+
+				rectangle.z *= size;
+				rectangle.w *= size;
+
+				rectangle.y = linePositionY + quad.y0 * size;
+
+				rectangle.x += rectangle.z + spacing * size;
+
+				maxPosY = std::max(maxPosY, rectangle.y);
+				maxPos = std::max(maxPos, rectangle.x);
+			}
+		}
+
+		maxPos = std::max(maxPos, rectangle.x);
+		maxPosY = std::max(maxPosY, rectangle.y);
+
+		float paddX = maxPos;
+
+		float paddY = maxPosY;
+
+		paddY += font.max_height * size + bonusY;
+
+		return glm::vec2{paddX, paddY};
+
+	}
+
+	float CommandRecorder::determineTextRescaleFitSmaller(const std::string &str,
+		gl2d::Font &f, glm::vec4 transform, float maxSize)
+	{
+		auto s = getTextSize(str.c_str(), f, maxSize);
+
+		float ratioX = transform.z / s.x;
+		float ratioY = transform.w / s.y;
+
+
+		if (ratioX > 1 && ratioY > 1)
+		{
+			return maxSize;
+		}
+		else
+		{
+			if (ratioX < ratioY)
+			{
+				return maxSize*ratioX;
+			}
+			else
+			{
+				return maxSize * ratioY;
+			}
+		}
+	}
+
+
+	float CommandRecorder::determineTextRescaleFitBigger(const std::string &str,
+		gl2d::Font &f, glm::vec4 transform, float minSize)
+	{
+		auto s = getTextSize(str.c_str(), f, minSize);
+
+		float ratioX = transform.z / s.x;
+		float ratioY = transform.w / s.y;
+
+
+		if (ratioX > 1 && ratioY > 1)
+		{
+			if (ratioX > ratioY)
+			{
+				return minSize * ratioY;
+			}
+			else
+			{
+				return minSize * ratioX;
+			}
+		}
+		else
+		{
+			
+		}
+
+		return minSize;
+	
+	}
+
+	float CommandRecorder::determineTextRescaleFit(const std::string &str,
+		gl2d::Font &f, glm::vec4 transform)
+	{
+		float ret = 1;
+
+		auto s = getTextSize(str.c_str(), f, ret);
+
+		float ratioX = transform.z / s.x;
+		float ratioY = transform.w / s.y;
+
+
+		if (ratioX > 1 && ratioY > 1)
+		{
+			if (ratioX > ratioY)
+			{
+				return ret * ratioY;
+			}
+			else
+			{
+				return ret * ratioX;
+			}
+		}
+		else
+		{
+			if (ratioX < ratioY)
+			{
+				return ret * ratioX;
+			}
+			else
+			{
+				return ret * ratioY;
+			}
+		}
+
+		return ret;
+	}
+
+	int  CommandRecorder::wrap(const std::string &in, gl2d::Font &f,
+		float baseSize, float maxDimension, std::string *outRez)
+	{
+		if (outRez)
+		{
+			*outRez = "";
+			outRez->reserve(in.size() + 10);
+		}
+
+		std::string word = "";
+		std::string currentLine = "";
+		currentLine.reserve(in.size() + 10);
+
+		bool wrap = 0;
+		bool newLine = 1;
+		int newLineCounter = 0;
+
+		for (int i = 0; i < in.size(); i++)
+		{
+			word.push_back(in[i]);
+			currentLine.push_back(in[i]);
+
+			if (in[i] == ' ')
+			{
+				if (wrap)
+				{
+					if (outRez)
+					{
+						outRez->push_back('\n'); currentLine = "";
+					}
+					newLineCounter++;
+
+				}
+
+				if (outRez)
+				{
+					*outRez += word;
+				}
+				word = "";
+				wrap = 0;
+				newLine = false;
+			}
+			else if (in[i] == '\n')
+			{
+				if (wrap)
+				{
+					if (outRez)
+					{
+						outRez->push_back('\n');
+					}
+					newLineCounter++;
+				}
+
+				currentLine = "";
+
+				if (outRez)
+				{
+					*outRez += word;
+				}
+				word = "";
+				wrap = 0;
+				newLine = true;
+			}
+			else
+			{
+				//let's check, only if needed
+				if (!wrap && !newLine)
+				{
+					float size = baseSize;
+					auto textSize = getTextSize(currentLine.c_str(), f, size);
+
+					if (textSize.x >= maxDimension && !newLine)
+					{
+						//wrap last word
+						wrap = 1;
+					}
+				};
+			}
+
+		}
+
+		{
+			if (wrap) { if (outRez)outRez->push_back('\n'); newLineCounter++; }
+
+			if (outRez)
+			{
+				*outRez += word;
+			}
+		}
+
+		return newLineCounter + 1;
+	}
+
+	void CommandRecorder::renderText(glm::vec2 position, const char *text, const Font font,
+		const Color4f color, const float size, const float spacing, const float line_space, bool showInCenter,
+		const Color4f ShadowColor
+		, const Color4f LightColor
+	)
+	{
+		if (font.texture.id == 0)
+		{
+			errorFunc("Missing font", userDefinedData);
+			return;
+		}
+
+		const int text_length = (int)strlen(text);
+		Rect rectangle;
+		rectangle.x = position.x;
+		float linePositionY = position.y;
+
+		if (showInCenter)
+		{
+			auto textSize = this->getTextSize(text, font, size, spacing, line_space);
+
+			position.x -= textSize.x / 2.f;
+			position.y += textSize.y / 2.f;
+		}
+
+		if (0)
+		{
+			//This is the y position we render at because it advances when we encounter newlines
+
+			float maxPos = 0;
+			float maxPosY = 0;
+
+			for (int i = 0; i < text_length; i++)
+			{
+				if (text[i] == '\n')
+				{
+					rectangle.x = position.x;
+					linePositionY += (font.max_height + line_space) * size;
+				}
+				else if (text[i] == '\t')
+				{
+					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+					(font, '_');
+					auto x = quad.x1 - quad.x0;
+
+					rectangle.x += x * size * 3 + spacing * size;
+				}
+				else if (text[i] == ' ')
+				{
+					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+					(font, '_');
+					auto x = quad.x1 - quad.x0;
+
+					rectangle.x += x * size + spacing * size;
+				}
+				else if (text[i] >= ' ' && text[i] <= '~')
+				{
+					const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+					(font, text[i]);
+
+					rectangle.z = quad.x1 - quad.x0;
+					rectangle.w = quad.y1 - quad.y0;
+
+					rectangle.z *= size;
+					rectangle.w *= size;
+
+					rectangle.y = linePositionY + quad.y0 * size;
+
+
+					rectangle.x += rectangle.z + spacing * size;
+					maxPos = std::max(maxPos, rectangle.x);
+					maxPosY = std::max(maxPosY, rectangle.y);
+				}
+			}
+
+			float padd = maxPos - position.x;
+			padd /= 2;
+			position.x -= padd;
+
+			float paddY = maxPosY - position.y;
+			position.y -= paddY;
+		}
+
+		rectangle = {};
+		rectangle.x = position.x;
+
+		auto writer = beginQuads(text_length * (1 + (ShadowColor.w != 0) + (LightColor.w != 0)));
+
+		//This is the y position we render at because it advances when we encounter newlines
+		linePositionY = position.y;
+
+		for (int i = 0; i < text_length; i++)
+		{
+			if (text[i] == '\n')
+			{
+				rectangle.x = position.x;
+				linePositionY += (font.max_height + line_space) * size;
+			}
+			else if (text[i] == '\t')
+			{
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, '_');
+				auto x = quad.x1 - quad.x0;
+
+				rectangle.x += x * size * 3 + spacing * size;
+			}
+			else if (text[i] == ' ')
+			{
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, '_');
+				auto x = quad.x1 - quad.x0;
+				rectangle.x += x * size + spacing * size;
+			}
+			else if (text[i] >= ' ' && text[i] <= '~')
+			{
+
+				const stbtt_aligned_quad quad = internal::fontGetGlyphQuad
+				(font, text[i]);
+
+				rectangle.z = quad.x1 - quad.x0;
+				rectangle.w = quad.y1 - quad.y0;
+
+				rectangle.z *= size;
+				rectangle.w *= size;
 
 				//rectangle.y = linePositionY - rectangle.w;
 				rectangle.y = linePositionY + quad.y0 * size;
 
-				glm::vec4 colorData[4] = {color, color, color, color};
+				glm::vec4 colorData[4] = {color, color, color, color};
+
+				if (ShadowColor.w)
+				{
+					glm::vec2 pos = {-5, 3};
+					pos *= size;
+					writer.write({rectangle.x + pos.x, rectangle.y + pos.y,  rectangle.z, rectangle.w},
+						font.texture, ShadowColor, glm::vec2{0, 0}, 0,
+						glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+
+				}
+
+				writer.write(rectangle, font.texture, colorData, glm::vec2{0, 0}, 0,
+					glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+
+				if (LightColor.w)
+				{
+					glm::vec2 pos = {-2, 1};
+					pos *= size;
+					writer.write({rectangle.x + pos.x, rectangle.y + pos.y,  rectangle.z, rectangle.w},
+						font.texture,
+						LightColor, glm::vec2{0, 0}, 0,
+						glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+
+				}
+
+
+				rectangle.x += rectangle.z + spacing * size;
+			}
+		}
+
+		writer.end();
+	}
+
+	void CommandRecorder::renderTextWrapped(const std::string &text,
+		gl2d::Font f, glm::vec4 textPos, glm::vec4 color, float baseSize,
+		float spacing, float lineSpacing,
+		bool showInCenter, glm::vec4 shadowColor, glm::vec4 lightColor)
+	{
+		std::string newText;
+		wrap(text, f, baseSize, textPos.z, &newText);
+		renderText(textPos,
+			newText.c_str(), f, color, baseSize, spacing, lineSpacing, showInCenter,
+			shadowColor, lightColor);
+	}
+
+	glm::vec2 CommandRecorder::getTextSizeWrapped(const std::string &text,
+		gl2d::Font f, float maxTextLenght, float baseSize, float spacing, float lineSpacing)
+	{
+		std::string newText;
+		wrap(text, f, baseSize, maxTextLenght, &newText);
+		auto rez = getTextSize(
+			newText.c_str(), f, baseSize, spacing, lineSpacing);
+
+		return rez;
+	}
+
+	void Renderer2D::clearScreen(const Color4f color)
+	{
+		if (capture) { addCaptureCommand(*this, FrameCapture::commandClear, defaultFBO).color = color; }
+
+		internal::bindFrameBuffer(defaultFBO);
+	
+		#if GL2D_USE_OPENGL_130
+			GLfloat oldColor[4];
+			glGetFloatv(GL_COLOR_CLEAR_VALUE, oldColor);
+
+			glClearColor(color.r, color.g, color.b, color.a);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glClearColor(oldColor[0], oldColor[1], oldColor[2], oldColor[3]);
+		#else
+			glClearBufferfv(GL_COLOR, 0, &color[0]);
+		#endif
+
+	}
+
+	void CommandRecorder::setShaderProgram(const ShaderProgram shader)
+	{
+		currentShader = shader;
+	}
+
+	void CommandRecorder::setCamera(const Camera camera)
+	{
+		currentCamera = camera;
+	}
+
+	void CommandRecorder::resetCameraAndShader()
+	{
+		currentCamera = defaultCamera;
+		currentShader = defaultShader;
+	}
+
+	void Renderer2D::renderPostProcess(ShaderProgram shader, 
+		Texture input, FrameBuffer result)
+	{
+		GLuint target = result.fbo ? result.fbo : defaultFBO;
+		internal::bindFrameBuffer(target);
+
+		enableNecessaryGLFeatures();
+
+		if (!hasInitialized)
+		{
+			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
+			return;
+		}
+
+		if (!vao)
+		{
+			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
+			return;
+		}
+
+		if (!shader.id)
+		{
+			errorFunc("Post Process Shader not created.", userDefinedData);
+			return;
+		}
+
+		auto size = input.GetSize();
+
+		if (size.x == 0 || size.y == 0)
+		{
+			return;
+		}
+
+		GL2D_GPU_ZONE("gl2d post process pass");
+
+		if (capture)
+		{
+			auto &command = addCaptureCommand(*this, FrameCapture::commandPostProcess, target);
+			command.shader = capture->addShader(shader.id);
+			command.texture = capture->addTexture(input.id);
+		}
+
+		internal::setViewport(0, 0, size.x, size.y);
+
+		internal::useProgram(shader.id);
+		internal::setSamplerUniform(shader);
+
+		input.bind();
+
+		stats.postProcessPasses++;
+		renderQuadToScreenInternal(*this, target);
+	}
+
+#pragma endregion
+
+#pragma region GpuProfiler
+
+	GpuProfiler &getGpuProfiler()
+	{
+		static GpuProfiler profiler;
+		return profiler;
+	}
+
+	int GpuProfiler::findZone(const char *name)
+	{
+		for (int i = 0; i < (int)zones.size(); i++)
+		{
+			if (zones[i].name == name) { return i; }
+		}
+
+		Zone zone;
+		zone.name = name;
+		zones.push_back(std::move(zone));
+		return (int)zones.size() - 1;
+	}
+
+	GLuint GpuProfiler::getQuery()
+	{
+		if (freeQueries.empty())
+		{
+			GLuint query = 0;
+			glGenQueries(1, &query);
+			return query;
+		}
+
+		GLuint query = freeQueries.back();
+		freeQueries.pop_back();
+		return query;
+	}
+
+	bool GpuProfiler::beginZone(const char *name)
+	{
+		if (!enabled || !glQueryCounter)
+		{
+			return false;
+		}
+
+		PendingZone zone;
+		zone.zone = findZone(name);
+		zone.begin = getQuery();
+		glQueryCounter(zone.begin, GL_TIMESTAMP);
+
+		openZones.push_back((int)frames[currentFrame].size());
+		frames[currentFrame].push_back(zone);
+
+		return true;
+	}
+
+	void GpuProfiler::endZone()
+	{
+		//the zones left open by endFrame were already closed
+		if (openZones.empty())
+		{
+			return;
+		}
+
+		auto &zone = frames[currentFrame][openZones.back()];
+		openZones.pop_back();
+
+		zone.end = getQuery();
+		glQueryCounter(zone.end, GL_TIMESTAMP);
+	}
+
+	void GpuProfiler::endFrame()
+	{
+		if (!openZones.empty())
+		{
+			errorFunc("GpuProfiler::endFrame called inside a zone, the zone ends here", userDefinedData);
+
+			while (!openZones.empty())
+			{
+				endZone();
+			}
+		}
+
+		//the oldest frame is read before it is reused
+		currentFrame = (currentFrame + 1) % latency;
+		readFrame(currentFrame);
+	}
+
+	void GpuProfiler::readFrame(int frame)
+	{
+		auto &pending = frames[frame];
+
+		if (pending.empty())
+		{
+			return;
+		}
+
+		bool ready = true;
+		for (auto &p : pending)
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(p.end, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) { ready = false; break; }
+		}
+
+		if (ready)
+		{
+			std::vector<float> frameMs(zones.size(), 0.f);
+			std::vector<unsigned short> frameCalls(zones.size(), 0);
+
+			for (auto &p : pending)
+			{
+				GLuint64 begin = 0;
+				GLuint64 end = 0;
+				glGetQueryObjectui64v(p.begin, GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(p.end, GL_QUERY_RESULT, &end);
+
+				frameMs[p.zone] += end > begin ? (end - begin) / 1'000'000.f : 0.f;
+				frameCalls[p.zone]++;
+			}
+
+			for (size_t i = 0; i < zones.size(); i++)
+			{
+				if (!frameCalls[i]) { continue; }
+
+				auto &zone = zones[i];
+				const size_t size = std::max<size_t>(historySize, 1);
+
+				if (zone.framesMs.size() != size)
+				{
+					zone.framesMs.assign(size, 0.f);
+					zone.framesCalls.assign(size, 0);
+					zone.next = 0;
+					zone.count = 0;
+				}
+
+				zone.framesMs[zone.next] = frameMs[i];
+				zone.framesCalls[zone.next] = frameCalls[i];
+				zone.next = (zone.next + 1) % size;
+				zone.count = std::min(zone.count + 1, size);
+			}
+		}
+		else
+		{
+			droppedFrames++;
+		}
+
+		for (auto &p : pending)
+		{
+			freeQueries.push_back(p.begin);
+			freeQueries.push_back(p.end);
+		}
+		pending.clear();
+	}
+
+	std::vector<GpuProfiler::ZoneStats> GpuProfiler::getZoneStats()
+	{
+		std::vector<ZoneStats> stats;
+		stats.reserve(zones.size());
+
+		for (auto &z : zones)
+		{
+			stats.push_back(getZoneStats(z.name.c_str()));
+		}
+
+		return stats;
+	}
+
+	GpuProfiler::ZoneStats GpuProfiler::getZoneStats(const char *name)
+	{
+		ZoneStats stats;
+
+		for (auto &zone : zones)
+		{
+			if (zone.name != name) { continue; }
+
+			stats.name = zone.name;
+			stats.frames = zone.count;
+
+			if (!zone.count) { return stats; }
+
+			std::vector<float> sorted(zone.framesMs.begin(), zone.framesMs.begin() + zone.count);
+			std::sort(sorted.begin(), sorted.end());
+
+			double sumMs = 0;
+			double sumCalls = 0;
+			for (size_t i = 0; i < zone.count; i++)
+			{
+				sumMs += zone.framesMs[i];
+				sumCalls += zone.framesCalls[i];
+			}
+
+			auto percentile = [&](float p) { return sorted[(size_t)(p * (zone.count - 1) + 0.5f)]; };
+
+			stats.averageMs = (float)(sumMs / zone.count);
+			stats.averageCalls = (float)(sumCalls / zone.count);
+			stats.minMs = sorted.front();
+			stats.maxMs = sorted.back();
+			stats.p50Ms = percentile(0.50f);
+			stats.p95Ms = percentile(0.95f);
+			stats.p99Ms = percentile(0.99f);
+
+			return stats;
+		}
+
+		return stats;
+	}
+
+	void GpuProfiler::reset()
+	{
+		for (auto &zone : zones)
+		{
+			zone.next = 0;
+			zone.count = 0;
+		}
+
+		droppedFrames = 0;
+	}
+
+	void GpuProfiler::cleanup()
+	{
+		for (auto &frame : frames)
+		{
+			for (auto &p : frame)
+			{
+				freeQueries.push_back(p.begin);
+				if (p.end) { freeQueries.push_back(p.end); }
+			}
+			frame.clear();
+		}
+
+		if (!freeQueries.empty() && glDeleteQueries)
+		{
+			glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+		}
+
+		freeQueries.clear();
+		openZones.clear();
+		zones.clear();
+		currentFrame = 0;
+		droppedFrames = 0;
+	}
+
+#pragma endregion
+
+#pragma region FrameCapture
+
+	//the texture content and the sampling mode, the hash is computed from the content and the size
+	FrameCapture::CapturedTexture captureTextureContent(GLuint id)
+	{
+		FrameCapture::CapturedTexture texture;
+
+		Texture t;
+		t.id = id;
+		glm::ivec2 size = {};
+		texture.data = t.readTextureData(0, &size);
+		texture.width = size.x;
+		texture.height = size.y;
+
+		GLint magFilter = 0;
+		GLint minFilter = 0;
+		internal::bindTexture(0, id);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+		texture.pixelated = magFilter == GL_NEAREST;
+		texture.mipMaps = minFilter != GL_NEAREST && minFilter != GL_LINEAR;
+
+		//fnv-1a
+		unsigned long long hash = 14695981039346656037ull;
+		auto hashBytes = [&](const void *data, size_t size)
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= ((const unsigned char *)data)[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		hashBytes(&texture.width, sizeof(texture.width));
+		hashBytes(&texture.height, sizeof(texture.height));
+		hashBytes(texture.data.data(), texture.data.size());
+		texture.hash = hash;
+
+		return texture;
+	}
+
+	int FrameCapture::addTexture(GLuint id)
+	{
+		for (auto &t : textureIds)
+		{
+			if (t.first == id) { return t.second; }
+		}
+
+		auto texture = captureTextureContent(id);
+
+		//textures with the same content are stored once
+		int index = -1;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			auto &other = textures[i];
+			if (other.frameBuffer < 0 && other.hash == texture.hash && other.width == texture.width &&
+				other.height == texture.height && other.pixelated == texture.pixelated &&
+				other.mipMaps == texture.mipMaps && other.data == texture.data)
+			{
+				index = (int)i;
+				break;
+			}
+		}
+
+		if (index < 0)
+		{
+			index = (int)textures.size();
+			textures.push_back(std::move(texture));
+		}
+
+		textureIds.push_back({id, index});
+		return index;
+	}
+
+	int FrameCapture::addFrameBuffer(GLuint fbo)
+	{
+		if (!renderer || fbo == renderer->defaultFBO) { return -1; }
+
+		for (size_t i = 0; i < frameBuffers.size(); i++)
+		{
+			if (frameBuffers[i].capturedId == fbo) { return (int)i; }
+		}
+
+		GLint textureId = 0;
+		internal::bindFrameBuffer(fbo);
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &textureId);
+
+		const int index = (int)frameBuffers.size();
+
+		//the content it has before the renderer draws into it, every replay starts with it
+		auto texture = captureTextureContent(textureId);
+		texture.frameBuffer = index;
+
+		CapturedFrameBuffer frameBuffer;
+		frameBuffer.capturedId = fbo;
+		frameBuffer.texture = (int)textures.size();
+		frameBuffers.push_back(frameBuffer);
+		textures.push_back(std::move(texture));
+
+		//if the texture was used before, the old commands keep the copy, it has the same content
+		bool found = false;
+		for (auto &t : textureIds)
+		{
+			if (t.first == (GLuint)textureId) { t.second = frameBuffer.texture; found = true; }
+		}
+		if (!found) { textureIds.push_back({(GLuint)textureId, frameBuffer.texture}); }
+
+		return index;
+	}
+
+	int FrameCapture::addShader(GLuint id)
+	{
+		if (!id) { return -1; }
+
+		for (size_t i = 0; i < shaders.size(); i++)
+		{
+			if (shaders[i].capturedId == id) { return (int)i; }
+		}
+
+		CapturedShader shader;
+		shader.capturedId = id;
+
+		//the shaders are deleted after linking but they stay attached to the program
+		GLuint attached[2] = {};
+		GLsizei count = 0;
+		glGetAttachedShaders(id, 2, &count, attached);
+		for (int i = 0; i < count; i++)
+		{
+			GLint type = 0;
+			GLint length = 0;
+			glGetShaderiv(attached[i], GL_SHADER_TYPE, &type);
+			glGetShaderiv(attached[i], GL_SHADER_SOURCE_LENGTH, &length);
+			if (length <= 0) { continue; }
+
+			std::string source(length, 0);
+			glGetShaderSource(attached[i], length, &length, &source[0]);
+			source.resize(length);
+
+			if (type == GL_VERTEX_SHADER) { shader.vertex = std::move(source); }
+			else if (type == GL_FRAGMENT_SHADER) { shader.fragment = std::move(source); }
+		}
+
+		if (shader.vertex.empty() || shader.fragment.empty())
+		{
+			errorFunc("FrameCapture couldn't read the source of a shader, the default shader will be used when replaying", userDefinedData);
+		}
+
+		shaders.push_back(std::move(shader));
+		return (int)shaders.size() - 1;
+	}
+
+	void FrameCapture::begin(Renderer2D &renderer)
+	{
+		if (renderer.capture)
+		{
+			errorFunc("The renderer is already captured", userDefinedData);
+			return;
+		}
+
+		cleanup();
+
+		this->renderer = &renderer;
+		renderer.capture = this;
+		windowW = renderer.windowW;
+		windowH = renderer.windowH;
+	}
+
+	bool FrameCapture::end(Renderer2D &renderer, const char *fileName)
+	{
+		if (this->renderer != &renderer)
+		{
+			errorFunc("FrameCapture::end called without begin", userDefinedData);
+			return false;
+		}
+
+		renderer.capture = nullptr;
+		this->renderer = nullptr;
+		textureIds.clear();
+
+		if (fileName) { return writeToFile(fileName); }
+		return true;
+	}
+
+	static const char captureMagic[8] = {'G', 'L', '2', 'D', 'C', 'A', 'P', 'T'};
+	static const unsigned int captureVersion = 2;
+
+	//the values are written as they are in memory
+	struct CaptureWriter
+	{
+		std::vector<char> data;
+
+		template<class T>
+		void write(const T &value)
+		{
+			data.insert(data.end(), (const char *)&value, (const char *)&value + sizeof(T));
+		}
+
+		template<class T>
+		void writeArray(const std::vector<T> &v)
+		{
+			write<unsigned long long>(v.size());
+			data.insert(data.end(), (const char *)v.data(), (const char *)(v.data() + v.size()));
+		}
+
+		void writeString(const std::string &s)
+		{
+			write<unsigned long long>(s.size());
+			data.insert(data.end(), s.begin(), s.end());
+		}
+
+		void writeCamera(const Camera &c)
+		{
+			write(c.position); write(c.rotation); write(c.zoom);
+		}
+
+		//RGBA pixels with run length encoding, most textures (fonts, frame buffers) have large areas of one color.
+		//Every packet starts with a count, if the high bit is set the next pixel is repeated else count pixels follow
+		void writePixels(const std::vector<unsigned char> &pixels)
+		{
+			const unsigned int *p = (const unsigned int *)pixels.data();
+			const size_t n = pixels.size() / 4;
+
+			write<unsigned long long>(n);
+
+			size_t i = 0;
+			while (i < n)
+			{
+				size_t run = 1;
+				while (i + run < n && p[i + run] == p[i] && run < 0x7FFFFFFF) { run++; }
+
+				if (run >= 3)
+				{
+					write<unsigned int>((unsigned int)run | 0x80000000);
+					write(p[i]);
+					i += run;
+					continue;
+				}
+
+				//literals until the next run of 3 pixels
+				size_t end = i + 1;
+				while (end < n && end - i < 0x7FFFFFFF &&
+					!(end + 2 < n && p[end] == p[end + 1] && p[end] == p[end + 2]))
+				{
+					end++;
+				}
+
+				write<unsigned int>((unsigned int)(end - i));
+				data.insert(data.end(), (const char *)(p + i), (const char *)(p + end));
+				i = end;
+			}
+		}
+	};
+
+	struct CaptureReader
+	{
+		const char *data = nullptr;
+		size_t size = 0;
+		size_t cursor = 0;
+		bool failed = false;
+
+		bool readBytes(void *out, size_t count)
+		{
+			if (failed || count > size - cursor) { failed = true; return false; }
+			if (!count) { return true; }
+			memcpy(out, data + cursor, count);
+			cursor += count;
+			return true;
+		}
+
+		template<class T>
+		T read()
+		{
+			T value = {};
+			readBytes(&value, sizeof(T));
+			return value;
+		}
+
+		//the count is checked against the remaining bytes so a bad file can't allocate too much
+		size_t readCount(size_t elementSize)
+		{
+			auto count = read<unsigned long long>();
+			if (failed || (elementSize && count > (size - cursor) / elementSize)) { failed = true; return 0; }
+			return (size_t)count;
+		}
+
+		template<class T>
+		void readArray(std::vector<T> &v)
+		{
+			v.resize(readCount(sizeof(T)));
+			readBytes(v.data(), v.size() * sizeof(T));
+		}
+
+		void readString(std::string &s)
+		{
+			s.resize(readCount(1));
+			readBytes(&s[0], s.size());
+		}
+
+		Camera readCamera()
+		{
+			Camera c;
+			c.position = read<glm::vec2>(); c.rotation = read<float>(); c.zoom = read<float>();
+			return c;
+		}
+
+		void readPixels(std::vector<unsigned char> &pixels, size_t expectedCount)
+		{
+			const auto n = read<unsigned long long>();
+			if (failed || n != expectedCount) { failed = true; return; }
+
+			pixels.resize(expectedCount * 4);
+			unsigned int *p = (unsigned int *)pixels.data();
+
+			size_t i = 0;
+			while (i < n && !failed)
+			{
+				const unsigned int packet = read<unsigned int>();
+				const size_t count = packet & 0x7FFFFFFF;
+				if (count == 0 || count > n - i) { failed = true; return; }
+
+				if (packet & 0x80000000)
+				{
+					const unsigned int pixel = read<unsigned int>();
+					std::fill(p + i, p + i + count, pixel);
+				}
+				else
+				{
+					readBytes(p + i, count * 4);
+				}
+				i += count;
+			}
+		}
+	};
+
+	bool FrameCapture::writeToFile(const char *fileName)
+	{
+		CaptureWriter w;
+		w.data.insert(w.data.end(), captureMagic, captureMagic + sizeof(captureMagic));
+		w.write(captureVersion);
+		w.write(windowW);
+		w.write(windowH);
+
+		w.write<unsigned long long>(shaders.size());
+		for (auto &s : shaders)
+		{
+			w.writeString(s.vertex);
+			w.writeString(s.fragment);
+		}
+
+		w.write<unsigned long long>(textures.size());
+		for (auto &t : textures)
+		{
+			w.write(t.hash);
+			w.write(t.width);
+			w.write(t.height);
+			w.write<char>(t.pixelated);
+			w.write<char>(t.mipMaps);
+			w.write(t.frameBuffer);
+			w.writePixels(t.data);
+		}
+
+		w.write<unsigned long long>(frameBuffers.size());
+		for (auto &f : frameBuffers) { w.write(f.texture); }
+
+		w.write<unsigned long long>(commands.size());
+		for (auto &c : commands)
+		{
+			w.write(c.type);
+			w.write(c.frameBuffer);
+			w.write(c.shader);
+			w.write(c.texture);
+			w.write(c.color);
+			w.write(c.windowW);
+			w.write(c.windowH);
+
+			if (c.type != commandQuads) { continue; }
+
+			w.write<char>(c.hasOverrideCamera);
+			w.writeCamera(c.overrideCamera);
+			w.writeArray(c.vertices);
+			w.writeArray(c.instances);
+
+			w.write<unsigned long long>(c.quads.size());
+			for (auto &q : c.quads) { w.write<unsigned int>(q.texture); w.write<char>(q.instanced); }
+
+			w.write<unsigned long long>(c.cameraBatches.size());
+			for (auto &b : c.cameraBatches)
+			{
+				w.writeCamera(b.camera);
+				w.write(b.windowW);
+				w.write(b.windowH);
+				w.write<unsigned long long>(b.firstQuad);
+			}
+
+			w.write<unsigned long long>(c.textureBatches.size());
+			for (auto &b : c.textureBatches)
+			{
+				w.write<unsigned long long>(b.firstQuad);
+				w.write<unsigned long long>(b.firstTexture);
+				w.write(b.textureCount);
+				w.write(b.shader);
+			}
+
+			w.writeArray(c.batchTextures);
+			w.writeArray(c.shaders);
+			w.write<unsigned long long>(c.opaqueQuads);
+		}
+
+		std::ofstream file(fileName, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::string e = "error openning: "; e += fileName;
+			errorFunc(e.c_str(), userDefinedData);
+			return false;
+		}
+
+		file.write(w.data.data(), w.data.size());
+		return (bool)file;
+	}
+
+	bool FrameCapture::loadFromFile(const char *fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::string e = "error openning: "; e += fileName;
+			errorFunc(e.c_str(), userDefinedData);
+			return false;
+		}
+
+		std::vector<char> fileData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		file.close();
+
+		cleanup();
+
+		CaptureReader r;
+		r.data = fileData.data();
+		r.size = fileData.size();
+
+		char magic[sizeof(captureMagic)] = {};
+		r.readBytes(magic, sizeof(magic));
+		if (r.failed || memcmp(magic, captureMagic, sizeof(magic)) || r.read<unsigned int>() != captureVersion)
+		{
+			std::string e = "not a frame capture or another version: "; e += fileName;
+			errorFunc(e.c_str(), userDefinedData);
+			return false;
+		}
+
+		windowW = r.read<int>();
+		windowH = r.read<int>();
+
+		shaders.resize(r.readCount(16));
+		for (auto &s : shaders)
+		{
+			r.readString(s.vertex);
+			r.readString(s.fragment);
+		}
+
+		textures.resize(r.readCount(32));
+		for (auto &t : textures)
+		{
+			t.hash = r.read<unsigned long long>();
+			t.width = r.read<int>();
+			t.height = r.read<int>();
+			t.pixelated = r.read<char>();
+			t.mipMaps = r.read<char>();
+			t.frameBuffer = r.read<int>();
+
+			if (t.width < 0 || t.height < 0 || t.width > 16384 || t.height > 16384) { r.failed = true; break; }
+			r.readPixels(t.data, (size_t)t.width * t.height);
+		}
+
+		frameBuffers.resize(r.readCount(4));
+		for (auto &f : frameBuffers)
+		{
+			f.texture = r.read<int>();
+			if (f.texture < 0 || f.texture >= (int)textures.size()) { r.failed = true; }
+		}
+
+		auto validIndex = [&](int i, size_t size) { if (i < -1 || i >= (int)size) { r.failed = true; } };
+
+		commands.resize(r.readCount(32));
+		for (auto &c : commands)
+		{
+			c.type = r.read<int>();
+			c.frameBuffer = r.read<int>();
+			c.shader = r.read<int>();
+			c.texture = r.read<int>();
+			c.color = r.read<glm::vec4>();
+			c.windowW = r.read<int>();
+			c.windowH = r.read<int>();
+
+			validIndex(c.frameBuffer, frameBuffers.size());
+			validIndex(c.shader, shaders.size());
+			validIndex(c.texture, textures.size());
+
+			if (c.type != commandQuads) { continue; }
+
+			c.hasOverrideCamera = r.read<char>();
+			c.overrideCamera = r.readCamera();
+			r.readArray(c.vertices);
+			r.readArray(c.instances);
+
+			c.quads.resize(r.readCount(5));
+			size_t instances = 0;
+			for (auto &q : c.quads)
+			{
+				q.texture = r.read<unsigned int>();
+				q.instanced = r.read<char>();
+				instances += q.instanced;
+			}
+
+			c.cameraBatches.resize(r.readCount(32));
+			for (auto &b : c.cameraBatches)
+			{
+				b.camera = r.readCamera();
+				b.windowW = r.read<int>();
+				b.windowH = r.read<int>();
+				b.firstQuad = (size_t)r.read<unsigned long long>();
+			}
+
+			c.textureBatches.resize(r.readCount(24));
+			for (auto &b : c.textureBatches)
+			{
+				b.firstQuad = (size_t)r.read<unsigned long long>();
+				b.firstTexture = (size_t)r.read<unsigned long long>();
+				b.textureCount = r.read<int>();
+				b.shader = r.read<int>();
+			}
+
+			r.readArray(c.batchTextures);
+			r.readArray(c.shaders);
+			c.opaqueQuads = (size_t)r.read<unsigned long long>();
+
+			//the indexes are used without checks when replaying
+			if (c.instances.size() != instances || c.vertices.size() != (c.quads.size() - instances) * 4 ||
+				c.cameraBatches.empty() || c.textureBatches.empty() || c.opaqueQuads > c.quads.size())
+			{
+				r.failed = true;
+			}
+			for (auto &t : c.batchTextures) { validIndex((int)t, textures.size()); }
+			for (auto &s : c.shaders) { validIndex(s, shaders.size()); }
+			for (auto &b : c.textureBatches)
+			{
+				if (b.firstQuad >= c.quads.size() || b.textureCount < 0 ||
+					b.firstTexture + b.textureCount > c.batchTextures.size() || b.shader >= (int)c.shaders.size())
+				{
+					r.failed = true;
+				}
+			}
+		}
+
+		if (r.failed)
+		{
+			std::string e = "the frame capture is corrupted: "; e += fileName;
+			errorFunc(e.c_str(), userDefinedData);
+			cleanup();
+			return false;
+		}
+
+		return true;
+	}
+
+	void FrameCapture::createReplayResources()
+	{
+		for (auto &s : shaders)
+		{
+			if (s.vertex.empty() || s.fragment.empty())
+			{
+				s.replayShader = defaultShader;
+			}
+			else
+			{
+				s.replayShader = createShaderProgram(s.vertex.c_str(), s.fragment.c_str());
+			}
+		}
+
+		for (auto &f : frameBuffers)
+		{
+			auto &t = textures[f.texture];
+			f.replayFrameBuffer.create(t.width, t.height, true); //in case it is drawn to with the opaque pass
+			t.replayTexture = f.replayFrameBuffer.texture;
+
+			if (t.pixelated)
+			{
+				internal::bindTexture(0, t.replayTexture.id);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			}
+		}
+
+		for (auto &t : textures)
+		{
+			if (t.frameBuffer >= 0 || t.data.empty()) { continue; }
+			t.replayTexture.createFromBuffer((const char *)t.data.data(), t.width, t.height, t.pixelated, t.mipMaps);
+		}
+
+		auto getShader = [&](int i) { return i >= 0 ? shaders[i].replayShader : defaultShader; };
+
+		for (auto &c : commands)
+		{
+			c.replayBatchTextures.clear();
+			for (auto t : c.batchTextures) { c.replayBatchTextures.push_back(textures[t].replayTexture.id); }
+
+			c.replayShaders.clear();
+			for (auto s : c.shaders) { c.replayShaders.push_back(getShader(s)); }
+		}
+
+		replayResourcesCreated = true;
+	}
+
+	void replayCapturedQuads(Renderer2D &renderer, const FrameCapture::Command &command, GLuint frameBuffer)
+	{
+		renderer.stats.flushes++;
+
+		enableNecessaryGLFeatures();
+		internal::bindFrameBuffer(frameBuffer);
+		internal::setViewport(0, 0, renderer.windowW, renderer.windowH);
+		internal::bindVertexArray(renderer.vao);
+		ensureIndexBufferCapacity(renderer, command.vertices.size() / 4);
+
+		const size_t verticesSize = command.vertices.size() * sizeof(Renderer2DVertex);
+		const size_t instancesSize = command.instances.size() * sizeof(Renderer2DInstance);
+		size_t verticesOffset = 0;
+		size_t instancesOffset = 0;
+		uploadQuadData(renderer, command.vertices, command.instances, verticesOffset, instancesOffset);
+
+		QuadDrawData data;
+		data.buffer = renderer.streamBuffer.buffer;
+		data.verticesOffset = verticesOffset;
+		data.instancesOffset = instancesOffset;
+		data.quads = &command.quads;
+		data.cameraBatches = &command.cameraBatches;
+		data.textureBatches = &command.textureBatches;
+		data.batchTextures = &command.replayBatchTextures;
+		data.shaders = &command.replayShaders;
+		data.frameBuffer = frameBuffer;
+		data.opaqueQuads = command.opaqueQuads;
+
+		drawQuadBatches(renderer, data, command.hasOverrideCamera ? &command.overrideCamera : nullptr);
+
+		renderer.streamBuffer.lockRegion(verticesOffset, verticesSize);
+		renderer.streamBuffer.lockRegion(instancesOffset, instancesSize);
+	}
+
+	void FrameCapture::replay(Renderer2D &renderer)
+	{
+		if (capturing() || renderer.capture)
+		{
+			errorFunc("FrameCapture::replay called while capturing", userDefinedData);
+			return;
+		}
+
+		if (!renderer.vao)
+		{
+			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
+			return;
+		}
+
+		if (!replayResourcesCreated) { createReplayResources(); }
+
+		//every replay starts with the frame buffers as they were captured
+		for (auto &f : frameBuffers)
+		{
+			auto &t = textures[f.texture];
+			if (t.data.empty()) { continue; }
+
+			internal::bindTexture(0, t.replayTexture.id);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, t.width, t.height, GL_RGBA, GL_UNSIGNED_BYTE, t.data.data());
+		}
+
+		const int oldW = renderer.windowW;
+		const int oldH = renderer.windowH;
+		const ShaderProgram oldShader = renderer.currentShader;
+
+		auto getFrameBuffer = [&](int i) { return i >= 0 ? frameBuffers[i].replayFrameBuffer : FrameBuffer{}; };
+		auto getTexture = [&](int i) { return i >= 0 ? textures[i].replayTexture : Texture{}; };
+		auto getShader = [&](int i) { return i >= 0 ? shaders[i].replayShader : defaultShader; };
+
+		for (auto &c : commands)
+		{
+			renderer.windowW = c.windowW;
+			renderer.windowH = c.windowH;
+			const FrameBuffer frameBuffer = getFrameBuffer(c.frameBuffer);
+
+			switch (c.type)
+			{
+			case commandClear:
+			internal::bindFrameBuffer(frameBuffer.fbo ? frameBuffer.fbo : renderer.defaultFBO);
+			glClearBufferfv(GL_COLOR, 0, &c.color[0]);
+			break;
+
+			case commandQuads:
+			renderer.currentShader = getShader(c.shader);
+			replayCapturedQuads(renderer, c, frameBuffer.fbo ? frameBuffer.fbo : renderer.defaultFBO);
+			break;
+
+			case commandPostProcess:
+			renderer.renderPostProcess(getShader(c.shader), getTexture(c.texture), frameBuffer);
+			break;
+
+			case commandTextureToScreen:
+			renderer.currentShader = getShader(c.shader);
+			renderer.renderTextureToTheEntireScreen(getTexture(c.texture), frameBuffer);
+			break;
+
+			default:
+			break;
+			}
+		}
+
+		renderer.windowW = oldW;
+		renderer.windowH = oldH;
+		renderer.currentShader = oldShader;
+	}
+
+	void FrameCapture::cleanup()
+	{
+		if (renderer)
+		{
+			renderer->capture = nullptr;
+			renderer = nullptr;
+		}
+
+		if (replayResourcesCreated)
+		{
+			for (auto &s : shaders)
+			{
+				if (s.replayShader.id && s.replayShader.id != defaultShader.id) { s.replayShader.clear(); }
+			}
+
+			for (auto &t : textures)
+			{
+				if (t.frameBuffer < 0) { t.replayTexture.cleanup(); }
+			}
+
+			for (auto &f : frameBuffers) { f.replayFrameBuffer.cleanup(); }
+		}
+
+		replayResourcesCreated = false;
+		windowW = 0;
+		windowH = 0;
+		commands.clear();
+		textures.clear();
+		frameBuffers.clear();
+		shaders.clear();
+		textureIds.clear();
+	}
+
+#pragma endregion
+
+	glm::ivec2 Texture::GetSize()
+	{
+		if (width || !id)
+		{
+			return {width, height};
+		}
+
+		glm::ivec2 s;
+		internal::bindTexture(0, id);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &s.x);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &s.y);
+		return s;
+	}
+
+	void Texture::setMetadata(int width, int height, GLenum internalFormat, bool mipMaps)
+	{
+		this->width = width;
+		this->height = height;
+		this->internalFormat = internalFormat;
+
+		//all the formats used by the library are 4 bytes per pixel
+		mipLevels = 0;
+		gpuMemorySize = 0;
+		int w = width;
+		int h = height;
+		while (w > 0 && h > 0)
+		{
+			mipLevels++;
+			gpuMemorySize += (size_t)w * h * 4;
+
+			if (!mipMaps || (w == 1 && h == 1)) { break; }
+
+			w = std::max(w / 2, 1);
+			h = std::max(h / 2, 1);
+		}
+	}
+
+	void Texture::createFromBuffer(const char* image_data, const int width, const int height
+		,bool pixelated, bool useMipMaps)
+	{
+		GLuint id = 0;
+
+		glGenTextures(1, &id);
+		internal::bindTexture(0, id);
+
+		if (pixelated)
+		{
+			if (useMipMaps)
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+			}
+			else 
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+		else 
+		{
+			if (useMipMaps)
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			}
+			else
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+
+		this->id = id;
+
+		//the mip levels are generated even if they are not used
+		setMetadata(width, height, GL_RGBA8, true);
+
+		opaque = image_data != nullptr;
+		for (size_t i = 3; opaque && i < (size_t)width * height * 4; i += 4)
+		{
+			opaque = (unsigned char)image_data[i] == 255;
+		}
+	}
+
+	void Texture::create1PxSquare(const char* b)
+	{
+		if (b == nullptr)
+		{
+			const unsigned char buff[] =
+			{
+				0xff,
+				0xff,
+				0xff,
+				0xff
+			};
+
+			createFromBuffer((char*)buff, 1, 1);
+		}
+		else
+		{
+			createFromBuffer(b, 1, 1);
+		}
+
+	}
+
+	void Texture::createFromFileData(const unsigned char* image_file_data, const size_t image_file_size
+		,bool pixelated, bool useMipMaps)
+	{
+		stbi_set_flip_vertically_on_load(true);
+
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+
+		const unsigned char* decodedImage = stbi_load_from_memory(image_file_data, (int)image_file_size, &width, &height, &channels, 4);
+
+		createFromBuffer((const char*)decodedImage, width, height, pixelated, useMipMaps);
+
+		STBI_FREE(decodedImage);
+	}
+
+	void Texture::createFromFileDataWithPixelPadding(const unsigned char* image_file_data, const size_t image_file_size, int blockSize,
+		bool pixelated, bool useMipMaps)
+	{
+		stbi_set_flip_vertically_on_load(true);
+
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+
+		const unsigned char* decodedImage = stbi_load_from_memory(image_file_data, (int)image_file_size, &width, &height, &channels, 4);
+
+		int newW = width + ((width * 2) / blockSize);
+		int newH = height + ((height * 2) / blockSize);
+
+		auto getOld = [decodedImage, width](int x, int y, int c)->const unsigned char
+		{
+			return decodedImage[4 * (x + (y * width)) + c];
+		};
+
+
+		unsigned char* newData = new unsigned char[newW * newH * 4]{};
+
+		auto getNew = [newData, newW](int x, int y, int c)
+		{
+			return &newData[4 * (x + (y * newW)) + c];
+		};
+
+		int newDataCursor = 0;
+		int dataCursor = 0;
+
+		//first copy data
+		for (int y = 0; y < newH; y++)
+		{
+			int yNo = 0;
+			if ((y == 0 || y == newH - 1
+				|| ((y) % (blockSize + 2)) == 0 ||
+				((y + 1) % (blockSize + 2)) == 0
+				))
+			{
+				yNo = 1;
+			}
+
+			for (int x = 0; x < newW; x++)
+			{
+				if (
+					yNo ||
+
+					((
+						x == 0 || x == newW - 1
+						|| (x % (blockSize + 2)) == 0 ||
+						((x + 1) % (blockSize + 2)) == 0
+						)
+						)
+
+					)
+				{
+					newData[newDataCursor++] = 0;
+					newData[newDataCursor++] = 0;
+					newData[newDataCursor++] = 0;
+					newData[newDataCursor++] = 0;
+				}
+				else
+				{
+					newData[newDataCursor++] = decodedImage[dataCursor++];
+					newData[newDataCursor++] = decodedImage[dataCursor++];
+					newData[newDataCursor++] = decodedImage[dataCursor++];
+					newData[newDataCursor++] = decodedImage[dataCursor++];
+				}
+
+			}
+
+		}
+
+		//then add margins
+
+
+		for (int x = 1; x < newW - 1; x++)
+		{
+			//copy on left
+			if (x == 1 ||
+				(x % (blockSize + 2)) == 1
+				)
+			{
+				for (int y = 0; y < newH; y++)
+				{
+					*getNew(x - 1, y, 0) = *getNew(x, y, 0);
+					*getNew(x - 1, y, 1) = *getNew(x, y, 1);
+					*getNew(x - 1, y, 2) = *getNew(x, y, 2);
+					*getNew(x - 1, y, 3) = *getNew(x, y, 3);
+				}
+
+			}
+			else //copy on rigght
+				if (x == newW - 2 ||
+					(x % (blockSize + 2)) == blockSize
+					)
+				{
+					for (int y = 0; y < newH; y++)
+					{
+						*getNew(x + 1, y, 0) = *getNew(x, y, 0);
+						*getNew(x + 1, y, 1) = *getNew(x, y, 1);
+						*getNew(x + 1, y, 2) = *getNew(x, y, 2);
+						*getNew(x + 1, y, 3) = *getNew(x, y, 3);
+					}
+				}
+		}
+
+		for (int y = 1; y < newH - 1; y++)
+		{
+			if (y == 1 ||
+				(y % (blockSize + 2)) == 1
+				)
+			{
+				for (int x = 0; x < newW; x++)
+				{
+					*getNew(x, y - 1, 0) = *getNew(x, y, 0);
+					*getNew(x, y - 1, 1) = *getNew(x, y, 1);
+					*getNew(x, y - 1, 2) = *getNew(x, y, 2);
+					*getNew(x, y - 1, 3) = *getNew(x, y, 3);
+				}
+			}
+			else
+				if (y == newH - 2 ||
+					(y % (blockSize + 2)) == blockSize
+					)
+				{
+					for (int x = 0; x < newW; x++)
+					{
+						*getNew(x, y + 1, 0) = *getNew(x, y, 0);
+						*getNew(x, y + 1, 1) = *getNew(x, y, 1);
+						*getNew(x, y + 1, 2) = *getNew(x, y, 2);
+						*getNew(x, y + 1, 3) = *getNew(x, y, 3);
+					}
+				}
+
+		}
+
+		createFromBuffer((const char*)newData, newW, newH, pixelated, useMipMaps);
+
+		STBI_FREE(decodedImage);
+		delete[] newData;
+	}
+
+	void Texture::loadFromFile(const char* fileName, bool pixelated, bool useMipMaps)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+
+		if (!file.is_open())
+		{
+			char c[300] = { 0 };
+			strcat(c, "error openning: ");
+			strcat(c + strlen(c), fileName);
+			errorFunc(c, userDefinedData);
+			return;
+		}
+
+		int fileSize = 0;
+		file.seekg(0, std::ios::end);
+		fileSize = (int)file.tellg();
+		file.seekg(0, std::ios::beg);
+		unsigned char* fileData = new unsigned char[fileSize];
+		file.read((char*)fileData, fileSize);
+		file.close();
+
+		createFromFileData(fileData, fileSize, pixelated, useMipMaps);
+
+		delete[] fileData;
+
+	}
+
+	void Texture::loadFromFileWithPixelPadding(const char* fileName, int blockSize,
+		bool pixelated, bool useMipMaps)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+
+		if (!file.is_open())
+		{
+			char c[300] = { 0 };
+			strcat(c, "error openning: ");
+			strcat(c + strlen(c), fileName);
+			errorFunc(c, userDefinedData);
+			return;
+		}
 
-				if (ShadowColor.w)
-				{
-					glm::vec2 pos = {-5, 3};
-					pos *= size;
-					renderRectangle({rectangle.x + pos.x, rectangle.y + pos.y,  rectangle.z, rectangle.w},
-						font.texture, ShadowColor, glm::vec2{0, 0}, 0,
-						glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+		int fileSize = 0;
+		file.seekg(0, std::ios::end);
+		fileSize = (int)file.tellg();
+		file.seekg(0, std::ios::beg);
+		unsigned char* fileData = new unsigned char[fileSize];
+		file.read((char*)fileData, fileSize);
+		file.close();
 
-				}
+		createFromFileDataWithPixelPadding(fileData, fileSize, blockSize, pixelated, useMipMaps);
 
-				renderRectangle(rectangle, font.texture, colorData, glm::vec2{0, 0}, 0,
-					glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+		delete[] fileData;
 
-				if (LightColor.w)
-				{
-					glm::vec2 pos = {-2, 1};
-					pos *= size;
-					renderRectangle({rectangle.x + pos.x, rectangle.y + pos.y,  rectangle.z, rectangle.w},
-						font.texture,
-						LightColor, glm::vec2{0, 0}, 0,
-						glm::vec4{quad.s0, quad.t0, quad.s1, quad.t1});
+	}
 
-				}
+	size_t Texture::getMemorySize(int mipLevel, glm::ivec2 *outSize)
+	{
+		glm::ivec2 stub = {};
 
+		if (!outSize)
+		{
+			outSize = &stub;
+		}
 
-				rectangle.x += rectangle.z + spacing * size;
+		if (width)
+		{
+			if (mipLevel < 0 || mipLevel >= mipLevels)
+			{
+				*outSize = {};
+				return 0;
 			}
+
+			*outSize = {std::max(width >> mipLevel, 1), std::max(height >> mipLevel, 1)};
+			return outSize->x * outSize->y * 4;
 		}
+
+		internal::bindTexture(0, id);
+
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_WIDTH, &outSize->x);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_HEIGHT, &outSize->y);
+		
+		internal::bindTexture(0, 0);
+
+		return outSize->x * outSize->y * 4;
 	}
 
-	void Renderer2D::renderTextWrapped(const std::string &text,
-		gl2d::Font f, glm::vec4 textPos, glm::vec4 color, float baseSize,
-		float spacing, float lineSpacing,
-		bool showInCenter, glm::vec4 shadowColor, glm::vec4 lightColor)
+	void Texture::readTextureData(void *buffer, int mipLevel)
 	{
-		std::string newText;
-		wrap(text, f, baseSize, textPos.z, &newText);
-		renderText(textPos,
-			newText.c_str(), f, color, baseSize, spacing, lineSpacing, showInCenter,
-			shadowColor, lightColor);
+		internal::bindTexture(0, id);
+		glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 	}
 
-	glm::vec2 Renderer2D::getTextSizeWrapped(const std::string &text,
-		gl2d::Font f, float maxTextLenght, float baseSize, float spacing, float lineSpacing)
+	std::vector<unsigned char> Texture::readTextureData(int mipLevel, glm::ivec2 *outSize)
 	{
-		std::string newText;
-		wrap(text, f, baseSize, maxTextLenght, &newText);
-		auto rez = getTextSize(
-			newText.c_str(), f, baseSize, spacing, lineSpacing);
+		internal::bindTexture(0, id);
 
-		return rez;
+		glm::ivec2 stub = {};
+
+		if (!outSize)
+		{
+			outSize = &stub;
+		}
+
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_WIDTH, &outSize->x);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_HEIGHT, &outSize->y);
+
+		std::vector<unsigned char> data;
+		data.resize(outSize->x * outSize->y * 4);
+		glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+
+		internal::bindTexture(0, 0);
+
+		return data;
 	}
 
-	void Renderer2D::clearScreen(const Color4f color)
+	void Texture::bind(const unsigned int sample)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, defaultFBO);
-	
-		#if GL2D_USE_OPENGL_130
-			GLfloat oldColor[4];
-			glGetFloatv(GL_COLOR_CLEAR_VALUE, oldColor);
+		internal::bindTexture(sample, id);
+	}
 
-			glClearColor(color.r, color.g, color.b, color.a);
-			glClear(GL_COLOR_BUFFER_BIT);
-			glClearColor(oldColor[0], oldColor[1], oldColor[2], oldColor[3]);
-		#else
-			glClearBufferfv(GL_COLOR, 0, &color[0]);
-		#endif
+	void Texture::unbind()
+	{
+		internal::bindTexture(std::max(internal::glState.activeTextureUnit, 0), 0);
+	}
 
+	void Texture::cleanup()
+	{
+		internal::forgetTexture(id);
+		glDeleteTextures(1, &id);
+		*this = {};
 	}
 
-	void Renderer2D::setShaderProgram(const ShaderProgram shader)
+	//glm::mat3 Camera::getMatrix()
+	//{
+	//	glm::mat3 m;
+	//	m = { zoom, 0, position.x ,
+	//		 0, zoom, position.y,
+	//		0, 0, 1,
+	//	};
+	//	m = glm::transpose(m);
+	//	return m; //todo not tested, add rotation
+	//}
+
+	void Camera::follow(glm::vec2 pos, float speed, float min, float max, float w, float h)
 	{
-		currentShader = shader;
+		pos.x -= w / 2.f;
+		pos.y -= h / 2.f;
+
+		glm::vec2 delta = pos - position;
+		bool signX = delta.x >= 0;
+		bool signY = delta.y >= 0;
+
+		float len = glm::length(delta);
+
+		delta = glm::normalize(delta);
+
+		if (len < min * 2)
+		{
+			speed /= 4.f;
+		}
+		else if (len < min * 4)
+		{
+			speed /= 2.f;
+		}
+
+		if (len > min)
+		{
+			if (len > max)
+			{
+				len = max;
+				position = pos - (max * delta);
+				//osition += delta * speed;
+			}
+			else
+			{
+				position += delta * speed;
+
+
+			}
+
+			glm::vec2 delta2 = pos - position;
+			bool signX2 = delta.x >= 0;
+			bool signY2 = delta.y >= 0;
+			if (signX2 != signX || signY2 != signY || glm::length(delta2) > len)
+			{
+				//position = pos;
+			}
+		}
 	}
 
-	void Renderer2D::setCamera(const Camera camera)
+	glm::vec2 internal::convertPoint(const Camera &camera, const glm::vec2& p, float windowW, float windowH)
 	{
-		currentCamera = camera;
+		glm::vec2 r = p;
+
+
+		//Apply camera transformations
+		r.x += camera.position.x;
+		r.y += camera.position.y;
+
+		{
+			glm::vec2 cameraCenter = { camera.position.x + windowW / 2, -camera.position.y - windowH / 2 };
+
+			r = rotateAroundPoint(r,
+				cameraCenter,
+				camera.rotation);
+		}
+
+		{
+			glm::vec2 cameraCenter = { camera.position.x + windowW / 2, camera.position.y + windowH / 2 };
+
+			r = scaleAroundPoint(r,
+				cameraCenter,
+				1.f / camera.zoom);
+		}
+
+		//if (this->rotation != 0)
+		//{
+		//	glm::vec2 cameraCenter;
+		//
+		//	cameraCenter.x = windowW / 2.0f;
+		//	cameraCenter.y = windowH / 2.0f;
+		//
+		//	r = rotateAroundPoint(r, cameraCenter, this->rotation);
+		//
+		//}
+
+		//{
+		//	glm::vec2 cameraCenter;
+		//	cameraCenter.x = windowW / 2.0f;
+		//	cameraCenter.y = -windowH / 2.0f;
+		//
+		//	r = scaleAroundPoint(r, cameraCenter, this->zoom);
+		//
+		//}
+
+		return r;
 	}
 
-	void Renderer2D::resetCameraAndShader()
+	void FrameBuffer::create(unsigned int w, unsigned int h, bool depth)
 	{
-		currentCamera = defaultCamera;
-		currentShader = defaultShader;
+		glGenFramebuffers(1, &fbo);
+		internal::forgetFrameBuffer(fbo); //gl can reuse the name of a deleted frame buffer
+		internal::bindFrameBuffer(fbo);
+
+		glGenTextures(1, &texture.id);
+		internal::bindTexture(0, texture.id);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		texture.setMetadata(w, h, GL_RGBA8, false);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.id, 0);
+
+		//glDrawBuffer(GL_COLOR_ATTACHMENT0); //todo why is this commented out ?
+
+		if (depth)
+		{
+			glGenTextures(1, &depthTexture);
+			internal::bindTexture(0, depthTexture);
+
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		}
+
+		internal::bindTexture(0, 0);
+		internal::bindFrameBuffer(0);
+
 	}
 
-	void Renderer2D::renderPostProcess(ShaderProgram shader, 
-		Texture input, FrameBuffer result)
+	void FrameBuffer::resize(unsigned int w, unsigned int h)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, result.fbo);
+		internal::bindTexture(0, texture.id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		texture.setMetadata(w, h, GL_RGBA8, false);
 
-		enableNecessaryGLFeatures();
+		if (depthTexture)
+		{
+			internal::bindTexture(0, depthTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		}
+	}
 
-		if (!hasInitialized)
+	void FrameBuffer::cleanup()
+	{
+		if (fbo)
 		{
-			errorFunc("Library not initialized. Have you forgotten to call gl2d::init() ?", userDefinedData);
-			return;
+			internal::forgetFrameBuffer(fbo);
+			glDeleteFramebuffers(1, &fbo);
+			fbo = 0;
+		}
+
+		if (texture.id)
+		{
+			internal::forgetTexture(texture.id);
+			glDeleteTextures(1, &texture.id);
+			texture = {};
 		}
 
-		if (!vao)
-		{
-			errorFunc("Renderer not initialized. Have you forgotten to call gl2d::Renderer2D::create() ?", userDefinedData);
-			return;
-		}
+		if (depthTexture)
+		{
+			internal::forgetTexture(depthTexture);
+			glDeleteTextures(1, &depthTexture);
+			depthTexture = 0;
+		}
+	}
+
+	void FrameBuffer::clear()
+	{
+		internal::bindFrameBuffer(fbo);
+		//glClearColor(1, 1, 1, 0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		//glClearColor(0, 0, 0, 0);
+	}
+
+
+	glm::vec4 computeTextureAtlas(int xCount, int yCount, int x, int y, bool flip)
+	{
+		float xSize = 1.f / xCount;
+		float ySize = 1.f / yCount;
 
-		if (!shader.id)
+		if (flip)
 		{
-			errorFunc("Post Process Shader not created.", userDefinedData);
-			return;
+			return { (x + 1) * xSize, 1 - (y * ySize), (x)*xSize, 1.f - ((y + 1) * ySize) };
 		}
-
-		auto size = input.GetSize();
-
-		if (size.x == 0 || size.y == 0)
+		else
 		{
-			return;
+			return { x * xSize, 1 - (y * ySize), (x + 1) * xSize, 1.f - ((y + 1) * ySize) };
 		}
 
-		glViewport(0, 0, size.x, size.y);
+	}
 
-		glUseProgram(shader.id);
-		glUniform1i(shader.u_sampler, 0);
+	glm::vec4 computeTextureAtlasWithPadding(int mapXsize, int mapYsize,
+		int xCount, int yCount, int x, int y, bool flip)
+	{
+		float xSize = 1.f / xCount;
+		float ySize = 1.f / yCount;
 
-		input.bind();
+		float Xpadding = 1.f / mapXsize;
+		float Ypadding = 1.f / mapYsize;
 
-		renderQuadToScreenInternal(*this);
+		glm::vec4 noFlip = { x * xSize + Xpadding, 1 - (y * ySize) - Ypadding, (x + 1) * xSize - Xpadding, 1.f - ((y + 1) * ySize) + Ypadding };
 
-		glBindVertexArray(0);
+		if (flip)
+		{
+			glm::vec4 flip = { noFlip.z, noFlip.y, noFlip.x, noFlip.w };
 
-	
+			return flip;
+		}
+		else
+		{
+			return noFlip;
+		}
 	}
 
-#pragma endregion
-
-	glm::ivec2 Texture::GetSize()
+	void DynamicAtlas::create(int pageSize, int maxPageSize, int extrude, bool pixelated, bool useMipMaps)
 	{
-		glm::ivec2 s;
-		glBindTexture(GL_TEXTURE_2D, id);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &s.x);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &s.y);
-		return s;
+		cleanup();
+
+		this->pageSize = std::max(pageSize, 1);
+		this->maxPageSize = std::max(maxPageSize, this->pageSize);
+		this->extrude = std::max(extrude, 0);
+		this->pixelated = pixelated;
+		this->useMipMaps = useMipMaps;
 	}
 
-	void Texture::createFromBuffer(const char* image_data, const int width, const int height
-		,bool pixelated, bool useMipMaps)
+	namespace internal
 	{
-		GLuint id = 0;
-
-		glActiveTexture(GL_TEXTURE0);
+		//skyline bottom left, returns the y position or -1 if it doesn't fit at this node
+		int skylineFit(const DynamicAtlas::Page &page, size_t index, int w, int h)
+		{
+			const int x = page.skyline[index].x;
+			if (x + w > page.size.x) { return -1; }
 
-		glGenTextures(1, &id);
-		glBindTexture(GL_TEXTURE_2D, id);
+			int y = page.skyline[index].y;
+			int widthLeft = w;
 
-		if (pixelated)
-		{
-			if (useMipMaps)
-			{
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-			}
-			else 
+			for (size_t i = index; widthLeft > 0; i++)
 			{
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				y = std::max(y, page.skyline[i].y);
+				if (y + h > page.size.y) { return -1; }
+				widthLeft -= page.skyline[i].w;
 			}
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+			return y;
 		}
-		else 
+
+		bool skylinePack(DynamicAtlas::Page &page, int w, int h, glm::ivec2 &outPos)
 		{
-			if (useMipMaps)
+			int bestIndex = -1;
+			int bestTop = 0;
+			int bestWidth = 0;
+
+			for (size_t i = 0; i < page.skyline.size(); i++)
 			{
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				const int y = skylineFit(page, i, w, h);
+				if (y < 0) { continue; }
+
+				if (bestIndex < 0 || y + h < bestTop || (y + h == bestTop && page.skyline[i].w < bestWidth))
+				{
+					bestIndex = (int)i;
+					bestTop = y + h;
+					bestWidth = page.skyline[i].w;
+					outPos = {page.skyline[i].x, y};
+				}
 			}
-			else
+
+			if (bestIndex < 0) { return false; }
+
+			DynamicAtlas::SkylineNode node;
+			node.x = outPos.x;
+			node.y = outPos.y + h;
+			node.w = w;
+			page.skyline.insert(page.skyline.begin() + bestIndex, node);
+
+			//cut the nodes that are now under the new one
+			for (size_t i = bestIndex + 1; i < page.skyline.size(); i++)
 			{
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			}
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		}
+				auto &prev = page.skyline[i - 1];
+				auto &n = page.skyline[i];
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				if (n.x >= prev.x + prev.w) { break; }
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+				const int shrink = prev.x + prev.w - n.x;
+				n.x += shrink;
+				n.w -= shrink;
 
+				if (n.w > 0) { break; }
 
-		this->id = id;
-	}
+				page.skyline.erase(page.skyline.begin() + i);
+				i--;
+			}
 
-	void Texture::create1PxSquare(const char* b)
-	{
-		if (b == nullptr)
-		{
-			const unsigned char buff[] =
+			for (size_t i = 0; i + 1 < page.skyline.size();)
 			{
-				0xff,
-				0xff,
-				0xff,
-				0xff
-			};
+				if (page.skyline[i].y == page.skyline[i + 1].y)
+				{
+					page.skyline[i].w += page.skyline[i + 1].w;
+					page.skyline.erase(page.skyline.begin() + i + 1);
+				}
+				else
+				{
+					i++;
+				}
+			}
 
-			createFromBuffer((char*)buff, 1, 1);
-		}
-		else
-		{
-			createFromBuffer(b, 1, 1);
+			return true;
 		}
 
-	}
-
-	void Texture::createFromFileData(const unsigned char* image_file_data, const size_t image_file_size
-		,bool pixelated, bool useMipMaps)
-	{
-		stbi_set_flip_vertically_on_load(true);
+		//doubles the smaller side, keeps the pixels and the skyline
+		bool growPage(DynamicAtlas::Page &page, int maxPageSize)
+		{
+			glm::ivec2 newSize = page.size;
 
-		int width = 0;
-		int height = 0;
-		int channels = 0;
+			if (newSize.x <= newSize.y && newSize.x < maxPageSize)
+			{
+				newSize.x = std::min(newSize.x * 2, maxPageSize);
+			}
+			else if (newSize.y < maxPageSize)
+			{
+				newSize.y = std::min(newSize.y * 2, maxPageSize);
+			}
+			else
+			{
+				return false;
+			}
 
-		const unsigned char* decodedImage = stbi_load_from_memory(image_file_data, (int)image_file_size, &width, &height, &channels, 4);
+			std::vector<unsigned char> pixels(newSize.x * newSize.y * 4);
+			for (int y = 0; y < page.size.y; y++)
+			{
+				memcpy(&pixels[y * newSize.x * 4], &page.pixels[y * page.size.x * 4], page.size.x * 4);
+			}
+			page.pixels.swap(pixels);
 
-		createFromBuffer((const char*)decodedImage, width, height, pixelated, useMipMaps);
+			if (newSize.x > page.size.x)
+			{
+				DynamicAtlas::SkylineNode node;
+				node.x = page.size.x;
+				node.w = newSize.x - page.size.x;
+				page.skyline.push_back(node);
+			}
 
-		STBI_FREE(decodedImage);
+			page.size = newSize;
+			return true;
+		}
 	}
 
-	void Texture::createFromFileDataWithPixelPadding(const unsigned char* image_file_data, const size_t image_file_size, int blockSize,
-		bool pixelated, bool useMipMaps)
+	int DynamicAtlas::addFromBuffer(const char *image_data, const int width, const int height)
 	{
-		stbi_set_flip_vertically_on_load(true);
-
-		int width = 0;
-		int height = 0;
-		int channels = 0;
-
-		const unsigned char* decodedImage = stbi_load_from_memory(image_file_data, (int)image_file_size, &width, &height, &channels, 4);
-
-		int newW = width + ((width * 2) / blockSize);
-		int newH = height + ((height * 2) / blockSize);
-
-		auto getOld = [decodedImage, width](int x, int y, int c)->const unsigned char
+		if (!image_data || width <= 0 || height <= 0)
 		{
-			return decodedImage[4 * (x + (y * width)) + c];
-		};
-
+			errorFunc("Invalid image added to the atlas", userDefinedData);
+			return -1;
+		}
 
-		unsigned char* newData = new unsigned char[newW * newH * 4]{};
+		const int w = width + extrude * 2;
+		const int h = height + extrude * 2;
 
-		auto getNew = [newData, newW](int x, int y, int c)
+		if (w > maxPageSize || h > maxPageSize)
 		{
-			return &newData[4 * (x + (y * newW)) + c];
-		};
+			errorFunc("Image too big for the atlas maxPageSize", userDefinedData);
+			return -1;
+		}
 
-		int newDataCursor = 0;
-		int dataCursor = 0;
+		//try the existing pages, growing them if needed, than add a new page
+		int pageIndex = -1;
+		glm::ivec2 pos = {};
 
-		//first copy data
-		for (int y = 0; y < newH; y++)
+		for (int i = 0; i < (int)pages.size() && pageIndex < 0; i++)
 		{
-			int yNo = 0;
-			if ((y == 0 || y == newH - 1
-				|| ((y) % (blockSize + 2)) == 0 ||
-				((y + 1) % (blockSize + 2)) == 0
-				))
+			while (true)
 			{
-				yNo = 1;
+				if (internal::skylinePack(pages[i], w, h, pos)) { pageIndex = i; break; }
+				if (!internal::growPage(pages[i], maxPageSize)) { break; }
 			}
+		}
 
-			for (int x = 0; x < newW; x++)
-			{
-				if (
-					yNo ||
-
-					((
-						x == 0 || x == newW - 1
-						|| (x % (blockSize + 2)) == 0 ||
-						((x + 1) % (blockSize + 2)) == 0
-						)
-						)
+		if (pageIndex < 0)
+		{
+			Page page;
+			page.size = {pageSize, pageSize};
+			page.pixels.resize(pageSize * pageSize * 4);
+			SkylineNode node;
+			node.w = pageSize;
+			page.skyline.push_back(node);
+			pages.push_back(std::move(page));
 
-					)
-				{
-					newData[newDataCursor++] = 0;
-					newData[newDataCursor++] = 0;
-					newData[newDataCursor++] = 0;
-					newData[newDataCursor++] = 0;
-				}
-				else
-				{
-					newData[newDataCursor++] = decodedImage[dataCursor++];
-					newData[newDataCursor++] = decodedImage[dataCursor++];
-					newData[newDataCursor++] = decodedImage[dataCursor++];
-					newData[newDataCursor++] = decodedImage[dataCursor++];
-				}
+			pageIndex = (int)pages.size() - 1;
 
+			while (!internal::skylinePack(pages[pageIndex], w, h, pos))
+			{
+				internal::growPage(pages[pageIndex], maxPageSize);
 			}
-
 		}
 
-		//then add margins
+		Page &page = pages[pageIndex];
 
+		//copy the image and extrude the edges
+		auto pixel = [&](int x, int y) { return &page.pixels[4 * (x + y * page.size.x)]; };
 
-		for (int x = 1; x < newW - 1; x++)
+		for (int y = 0; y < height; y++)
 		{
-			//copy on left
-			if (x == 1 ||
-				(x % (blockSize + 2)) == 1
-				)
-			{
-				for (int y = 0; y < newH; y++)
-				{
-					*getNew(x - 1, y, 0) = *getNew(x, y, 0);
-					*getNew(x - 1, y, 1) = *getNew(x, y, 1);
-					*getNew(x - 1, y, 2) = *getNew(x, y, 2);
-					*getNew(x - 1, y, 3) = *getNew(x, y, 3);
-				}
+			memcpy(pixel(pos.x + extrude, pos.y + extrude + y), image_data + y * width * 4, width * 4);
 
+			for (int e = 0; e < extrude; e++)
+			{
+				memcpy(pixel(pos.x + e, pos.y + extrude + y), pixel(pos.x + extrude, pos.y + extrude + y), 4);
+				memcpy(pixel(pos.x + extrude + width + e, pos.y + extrude + y), pixel(pos.x + extrude + width - 1, pos.y + extrude + y), 4);
 			}
-			else //copy on rigght
-				if (x == newW - 2 ||
-					(x % (blockSize + 2)) == blockSize
-					)
-				{
-					for (int y = 0; y < newH; y++)
-					{
-						*getNew(x + 1, y, 0) = *getNew(x, y, 0);
-						*getNew(x + 1, y, 1) = *getNew(x, y, 1);
-						*getNew(x + 1, y, 2) = *getNew(x, y, 2);
-						*getNew(x + 1, y, 3) = *getNew(x, y, 3);
-					}
-				}
 		}
 
-		for (int y = 1; y < newH - 1; y++)
+		for (int e = 0; e < extrude; e++)
 		{
-			if (y == 1 ||
-				(y % (blockSize + 2)) == 1
-				)
+			memcpy(pixel(pos.x, pos.y + e), pixel(pos.x, pos.y + extrude), w * 4);
+			memcpy(pixel(pos.x, pos.y + extrude + height + e), pixel(pos.x, pos.y + extrude + height - 1), w * 4);
+		}
+
+		//upload, the pages that grew are uploaded again with the same texture id
+		for (auto &p : pages)
+		{
+			if (!p.texture.id)
 			{
-				for (int x = 0; x < newW; x++)
+				p.texture.createFromBuffer((const char *)p.pixels.data(), p.size.x, p.size.y, pixelated, useMipMaps);
+				p.textureSize = p.size;
+			}
+			else if (p.textureSize != p.size || &p == &page)
+			{
+				internal::bindTexture(0, p.texture.id);
+
+				if (p.textureSize != p.size)
 				{
-					*getNew(x, y - 1, 0) = *getNew(x, y, 0);
-					*getNew(x, y - 1, 1) = *getNew(x, y, 1);
-					*getNew(x, y - 1, 2) = *getNew(x, y, 2);
-					*getNew(x, y - 1, 3) = *getNew(x, y, 3);
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, p.size.x, p.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, p.pixels.data());
+					p.textureSize = p.size;
+					p.texture.setMetadata(p.size.x, p.size.y, GL_RGBA8, useMipMaps);
 				}
-			}
-			else
-				if (y == newH - 2 ||
-					(y % (blockSize + 2)) == blockSize
-					)
+				else
 				{
-					for (int x = 0; x < newW; x++)
-					{
-						*getNew(x, y + 1, 0) = *getNew(x, y, 0);
-						*getNew(x, y + 1, 1) = *getNew(x, y, 1);
-						*getNew(x, y + 1, 2) = *getNew(x, y, 2);
-						*getNew(x, y + 1, 3) = *getNew(x, y, 3);
-					}
+					glPixelStorei(GL_UNPACK_ROW_LENGTH, p.size.x);
+					glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixel(pos.x, pos.y));
+					glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+				}
+
+				if (useMipMaps)
+				{
+					glGenerateMipmap(GL_TEXTURE_2D);
 				}
-
+			}
 		}
 
-		createFromBuffer((const char*)newData, newW, newH, pixelated, useMipMaps);
+		Entry entry;
+		entry.page = pageIndex;
+		entry.rect = {pos.x + extrude, pos.y + extrude, width, height};
+		entries.push_back(entry);
 
-		STBI_FREE(decodedImage);
-		delete[] newData;
+		return (int)entries.size() - 1;
 	}
 
-	void Texture::loadFromFile(const char* fileName, bool pixelated, bool useMipMaps)
+	int DynamicAtlas::addFromFileData(const unsigned char *image_file_data, const size_t image_file_size)
 	{
-		std::ifstream file(fileName, std::ios::binary);
+		stbi_set_flip_vertically_on_load(true);
 
-		if (!file.is_open())
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+
+		const unsigned char *decodedImage = stbi_load_from_memory(image_file_data, (int)image_file_size, &width, &height, &channels, 4);
+
+		if (!decodedImage)
 		{
-			char c[300] = { 0 };
-			strcat(c, "error openning: ");
-			strcat(c + strlen(c), fileName);
-			errorFunc(c, userDefinedData);
-			return;
+			errorFunc("Couldn't decode the image added to the atlas", userDefinedData);
+			return -1;
 		}
 
-		int fileSize = 0;
-		file.seekg(0, std::ios::end);
-		fileSize = (int)file.tellg();
-		file.seekg(0, std::ios::beg);
-		unsigned char* fileData = new unsigned char[fileSize];
-		file.read((char*)fileData, fileSize);
-		file.close();
-
-		createFromFileData(fileData, fileSize, pixelated, useMipMaps);
+		const int id = addFromBuffer((const char *)decodedImage, width, height);
 
-		delete[] fileData;
+		STBI_FREE(decodedImage);
 
+		return id;
 	}
 
-	void Texture::loadFromFileWithPixelPadding(const char* fileName, int blockSize,
-		bool pixelated, bool useMipMaps)
+	int DynamicAtlas::addFromFile(const char *fileName)
 	{
 		std::ifstream file(fileName, std::ios::binary);
 
@@ -2377,301 +6746,254 @@ or gladLoadGLLoader() or glewInit()?", userDefinedData);
 			strcat(c, "error openning: ");
 			strcat(c + strlen(c), fileName);
 			errorFunc(c, userDefinedData);
-			return;
+			return -1;
 		}
 
 		int fileSize = 0;
 		file.seekg(0, std::ios::end);
 		fileSize = (int)file.tellg();
 		file.seekg(0, std::ios::beg);
-		unsigned char* fileData = new unsigned char[fileSize];
-		file.read((char*)fileData, fileSize);
+		unsigned char *fileData = new unsigned char[fileSize];
+		file.read((char *)fileData, fileSize);
 		file.close();
 
-		createFromFileDataWithPixelPadding(fileData, fileSize, blockSize, pixelated, useMipMaps);
+		const int id = addFromFileData(fileData, fileSize);
 
 		delete[] fileData;
 
+		return id;
 	}
 
-	size_t Texture::getMemorySize(int mipLevel, glm::ivec2 *outSize)
+	Sprite DynamicAtlas::get(int id)
 	{
-		glBindTexture(GL_TEXTURE_2D, id);
-
-		glm::ivec2 stub = {};
-
-		if (!outSize)
+		if (id < 0 || id >= (int)entries.size())
 		{
-			outSize = &stub;
+			errorFunc("Invalid atlas sprite id", userDefinedData);
+			return {white1pxSquareTexture};
 		}
 
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_WIDTH, &outSize->x);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_HEIGHT, &outSize->y);
-		
-		glBindTexture(GL_TEXTURE_2D, 0);
+		const Entry &e = entries[id];
+		const Page &page = pages[e.page];
 
-		return outSize->x * outSize->y * 4;
-	}
+		Sprite sprite;
+		sprite.texture = page.texture;
+		sprite.textureCoords = {
+			(float)e.rect.x / page.size.x,
+			(float)(e.rect.y + e.rect.w) / page.size.y,
+			(float)(e.rect.x + e.rect.z) / page.size.x,
+			(float)e.rect.y / page.size.y,
+		};
 
-	void Texture::readTextureData(void *buffer, int mipLevel)
-	{
-		glBindTexture(GL_TEXTURE_2D, id);
-		glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+		return sprite;
 	}
 
-	std::vector<unsigned char> Texture::readTextureData(int mipLevel, glm::ivec2 *outSize)
+	void DynamicAtlas::cleanup()
 	{
-		glBindTexture(GL_TEXTURE_2D, id);
-
-		glm::ivec2 stub = {};
-
-		if (!outSize)
+		for (auto &p : pages)
 		{
-			outSize = &stub;
+			p.texture.cleanup();
 		}
 
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_WIDTH, &outSize->x);
-		glGetTexLevelParameteriv(GL_TEXTURE_2D, mipLevel, GL_TEXTURE_HEIGHT, &outSize->y);
-
-		std::vector<unsigned char> data;
-		data.resize(outSize->x * outSize->y * 4);
-		glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return data;
+		pages.clear();
+		entries.clear();
 	}
 
-	void Texture::bind(const unsigned int sample)
+	int TextureManager::addFromFile(const char *fileName, const char *category, bool pixelated, bool useMipMaps)
 	{
-		glActiveTexture(GL_TEXTURE0 + sample);
-		glBindTexture(GL_TEXTURE_2D, id);
+		Entry entry;
+		entry.fileName = fileName;
+		entry.category = category;
+		entry.pixelated = pixelated;
+		entry.useMipMaps = useMipMaps;
+		entries.push_back(std::move(entry));
+
+		return (int)entries.size() - 1;
 	}
 
-	void Texture::unbind()
+	int TextureManager::addFromGenerator(std::function<Texture()> generator, const char *category)
 	{
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
+		Entry entry;
+		entry.generator = std::move(generator);
+		entry.category = category;
+		entries.push_back(std::move(entry));
 
-	void Texture::cleanup()
-	{
-		glDeleteTextures(1, &id);
-		*this = {};
+		return (int)entries.size() - 1;
 	}
 
-	//glm::mat3 Camera::getMatrix()
-	//{
-	//	glm::mat3 m;
-	//	m = { zoom, 0, position.x ,
-	//		 0, zoom, position.y,
-	//		0, 0, 1,
-	//	};
-	//	m = glm::transpose(m);
-	//	return m; //todo not tested, add rotation
-	//}
-
-	void Camera::follow(glm::vec2 pos, float speed, float min, float max, float w, float h)
+	Texture TextureManager::get(int id)
 	{
-		pos.x -= w / 2.f;
-		pos.y -= h / 2.f;
-
-		glm::vec2 delta = pos - position;
-		bool signX = delta.x >= 0;
-		bool signY = delta.y >= 0;
-
-		float len = glm::length(delta);
-
-		delta = glm::normalize(delta);
-
-		if (len < min * 2)
+		if (id < 0 || id >= (int)entries.size())
 		{
-			speed /= 4.f;
+			errorFunc("Invalid texture manager id", userDefinedData);
+			return placeholder.id ? placeholder : white1pxSquareTexture;
 		}
-		else if (len < min * 4)
+
+		auto &e = entries[id];
+		e.lastUsedFrame = frame;
+
+		if (e.texture.id)
 		{
-			speed /= 2.f;
+			return e.texture;
 		}
 
-		if (len > min)
+		if (!e.queued && !e.failed)
 		{
-			if (len > max)
-			{
-				len = max;
-				position = pos - (max * delta);
-				//osition += delta * speed;
-			}
-			else
-			{
-				position += delta * speed;
-
-
-			}
-
-			glm::vec2 delta2 = pos - position;
-			bool signX2 = delta.x >= 0;
-			bool signY2 = delta.y >= 0;
-			if (signX2 != signX || signY2 != signY || glm::length(delta2) > len)
-			{
-				//position = pos;
-			}
+			e.queued = true;
+			loadQueue.push_back(id);
 		}
+
+		return placeholder.id ? placeholder : white1pxSquareTexture;
 	}
 
-	glm::vec2 internal::convertPoint(const Camera &camera, const glm::vec2& p, float windowW, float windowH)
+	void TextureManager::load(int id)
 	{
-		glm::vec2 r = p;
-
+		if (id < 0 || id >= (int)entries.size())
+		{
+			errorFunc("Invalid texture manager id", userDefinedData);
+			return;
+		}
 
-		//Apply camera transformations
-		r.x += camera.position.x;
-		r.y += camera.position.y;
+		auto &e = entries[id];
 
+		if (e.texture.id || e.failed)
 		{
-			glm::vec2 cameraCenter = { camera.position.x + windowW / 2, -camera.position.y - windowH / 2 };
-
-			r = rotateAroundPoint(r,
-				cameraCenter,
-				camera.rotation);
+			return;
 		}
 
+		if (e.generator)
 		{
-			glm::vec2 cameraCenter = { camera.position.x + windowW / 2, camera.position.y + windowH / 2 };
-
-			r = scaleAroundPoint(r,
-				cameraCenter,
-				1.f / camera.zoom);
+			e.texture = e.generator();
+		}
+		else
+		{
+			e.texture.loadFromFile(e.fileName.c_str(), e.pixelated, e.useMipMaps);
 		}
 
-		//if (this->rotation != 0)
-		//{
-		//	glm::vec2 cameraCenter;
-		//
-		//	cameraCenter.x = windowW / 2.0f;
-		//	cameraCenter.y = windowH / 2.0f;
-		//
-		//	r = rotateAroundPoint(r, cameraCenter, this->rotation);
-		//
-		//}
+		if (!e.texture.id)
+		{
+			e.failed = true;
+			return;
+		}
 
-		//{
-		//	glm::vec2 cameraCenter;
-		//	cameraCenter.x = windowW / 2.0f;
-		//	cameraCenter.y = -windowH / 2.0f;
-		//
-		//	r = scaleAroundPoint(r, cameraCenter, this->zoom);
-		//
-		//}
+		//the generator could have set the id by hand
+		if (!e.texture.gpuMemorySize)
+		{
+			const glm::ivec2 size = e.texture.GetSize();
+			e.texture.setMetadata(size.x, size.y, GL_RGBA8, false);
+		}
 
-		return r;
+		usedMemory += e.texture.gpuMemorySize;
 	}
 
-	void FrameBuffer::create(unsigned int w, unsigned int h)
+	void TextureManager::unload(int id)
 	{
-		glGenFramebuffers(1, &fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-		glGenTextures(1, &texture.id);
-		glBindTexture(GL_TEXTURE_2D, texture.id);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.id, 0);
-
-		//glDrawBuffer(GL_COLOR_ATTACHMENT0); //todo why is this commented out ?
-
-		//glGenTextures(1, &depthtTexture);
-		//glBindTexture(GL_TEXTURE_2D, depthtTexture);
-
-		//glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, NULL);
-
-		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (id < 0 || id >= (int)entries.size())
+		{
+			errorFunc("Invalid texture manager id", userDefinedData);
+			return;
+		}
 
-		//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthtTexture, 0);
+		auto &e = entries[id];
 
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (!e.texture.id)
+		{
+			return;
+		}
 
+		usedMemory -= e.texture.gpuMemorySize;
+		e.texture.cleanup();
 	}
 
-	void FrameBuffer::resize(unsigned int w, unsigned int h)
+	bool TextureManager::isLoaded(int id)
 	{
-		glBindTexture(GL_TEXTURE_2D, texture.id);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-		//glBindTexture(GL_TEXTURE_2D, depthtTexture);
-		//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
+		return id >= 0 && id < (int)entries.size() && entries[id].texture.id != 0;
 	}
 
-	void FrameBuffer::cleanup()
+	void TextureManager::update()
 	{
-		if (fbo)
+		//the queue is in the order the textures were first used
+		size_t loaded = 0;
+		for (; loaded < loadQueue.size(); loaded++)
 		{
-			glDeleteFramebuffers(1, &fbo);
-			fbo = 0;
-		}
+			if (loadsPerFrame > 0 && loaded >= (size_t)loadsPerFrame) { break; }
 
-		if (texture.id)
-		{
-			glDeleteTextures(1, &texture.id);
-			texture = {};
+			entries[loadQueue[loaded]].queued = false;
+			load(loadQueue[loaded]);
 		}
+		loadQueue.erase(loadQueue.begin(), loadQueue.begin() + loaded);
 
-		//glDeleteTextures(1, &depthtTexture);
-		//depthtTexture = 0;
-	}
+		while (usedMemory > budget)
+		{
+			int oldest = -1;
 
-	void FrameBuffer::clear()
-	{
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		//glClearColor(1, 1, 1, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//glClearColor(0, 0, 0, 0);
+			for (int i = 0; i < (int)entries.size(); i++)
+			{
+				auto &e = entries[i];
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	}
+				//the textures used in this frame could still be drawn
+				if (!e.texture.id || e.lastUsedFrame == frame) { continue; }
 
+				if (oldest < 0 || e.lastUsedFrame < entries[oldest].lastUsedFrame)
+				{
+					oldest = i;
+				}
+			}
 
-	glm::vec4 computeTextureAtlas(int xCount, int yCount, int x, int y, bool flip)
-	{
-		float xSize = 1.f / xCount;
-		float ySize = 1.f / yCount;
+			if (oldest < 0) { break; }
 
-		if (flip)
-		{
-			return { (x + 1) * xSize, 1 - (y * ySize), (x)*xSize, 1.f - ((y + 1) * ySize) };
-		}
-		else
-		{
-			return { x * xSize, 1 - (y * ySize), (x + 1) * xSize, 1.f - ((y + 1) * ySize) };
+			unload(oldest);
 		}
 
+		frame++;
 	}
 
-	glm::vec4 computeTextureAtlasWithPadding(int mapXsize, int mapYsize,
-		int xCount, int yCount, int x, int y, bool flip)
+	size_t TextureManager::getUsedMemory()
 	{
-		float xSize = 1.f / xCount;
-		float ySize = 1.f / yCount;
-
-		float Xpadding = 1.f / mapXsize;
-		float Ypadding = 1.f / mapYsize;
+		return usedMemory;
+	}
 
-		glm::vec4 noFlip = { x * xSize + Xpadding, 1 - (y * ySize) - Ypadding, (x + 1) * xSize - Xpadding, 1.f - ((y + 1) * ySize) + Ypadding };
+	std::vector<TextureManager::CategoryUsage> TextureManager::getCategoryUsage()
+	{
+		std::vector<CategoryUsage> usage;
 
-		if (flip)
+		for (auto &e : entries)
 		{
-			glm::vec4 flip = { noFlip.z, noFlip.y, noFlip.x, noFlip.w };
+			CategoryUsage *category = nullptr;
+			for (auto &c : usage)
+			{
+				if (c.name == e.category) { category = &c; break; }
+			}
 
-			return flip;
+			if (!category)
+			{
+				usage.push_back({});
+				category = &usage.back();
+				category->name = e.category;
+			}
+
+			category->count++;
+
+			if (e.texture.id)
+			{
+				category->loaded++;
+				category->bytes += e.texture.gpuMemorySize;
+			}
 		}
-		else
+
+		return usage;
+	}
+
+	void TextureManager::cleanup()
+	{
+		for (auto &e : entries)
 		{
-			return noFlip;
+			if (e.texture.id) { e.texture.cleanup(); }
 		}
+
+		entries.clear();
+		loadQueue.clear();
+		usedMemory = 0;
+		frame = 1;
 	}
 
 	
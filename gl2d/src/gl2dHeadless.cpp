@@ -0,0 +1,161 @@
+#include <gl2d/gl2dHeadless.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+namespace gl2d
+{
+
+	static EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+	static EGLContext headlessContext = EGL_NO_CONTEXT;
+
+	static bool hasExtension(const char *extensions, const char *name)
+	{
+		if (!extensions) { return false; }
+
+		const size_t size = strlen(name);
+		for (const char *c = strstr(extensions, name); c; c = strstr(c + 1, name))
+		{
+			if ((c == extensions || c[-1] == ' ') && (c[size] == ' ' || c[size] == 0))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static bool headlessFail(const char **error, const char *message)
+	{
+		if (error) { *error = message; }
+		destroyHeadlessContext();
+		return false;
+	}
+
+	bool createHeadlessContext(const char **error, int glMajor, int glMinor)
+	{
+		//the context that already exists is still used so it isn't destroyed
+		if (headlessContext != EGL_NO_CONTEXT)
+		{
+			if (error) { *error = "The headless context was already created"; }
+			return false;
+		}
+
+		//the surfaceless platform doesn't need a display server or a gpu
+		const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+		{
+			auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay)
+			{
+				headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			}
+		}
+
+		if (headlessDisplay == EGL_NO_DISPLAY)
+		{
+			headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+
+		EGLint major = 0;
+		EGLint minor = 0;
+		if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, &major, &minor))
+		{
+			return headlessFail(error, "Couldn't initialize an EGL display");
+		}
+
+		const char *displayExtensions = eglQueryString(headlessDisplay, EGL_EXTENSIONS);
+		if (!hasExtension(displayExtensions, "EGL_KHR_surfaceless_context"))
+		{
+			return headlessFail(error, "The EGL display doesn't support EGL_KHR_surfaceless_context");
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			return headlessFail(error, "The EGL display doesn't support desktop opengl");
+		}
+
+		EGLConfig config = EGL_NO_CONFIG_KHR;
+		if (!hasExtension(displayExtensions, "EGL_KHR_no_config_context"))
+		{
+			const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+			EGLint count = 0;
+			if (!eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &count) || count == 0)
+			{
+				return headlessFail(error, "Couldn't find an EGL config for opengl");
+			}
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, glMajor,
+			EGL_CONTEXT_MINOR_VERSION, glMinor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+
+		headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+		if (headlessContext == EGL_NO_CONTEXT)
+		{
+			return headlessFail(error, "Couldn't create the opengl context");
+		}
+
+		if (!eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext))
+		{
+			return headlessFail(error, "Couldn't make the opengl context current");
+		}
+
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			return headlessFail(error, "Couldn't load opengl with glad");
+		}
+
+		return true;
+	}
+
+	void destroyHeadlessContext()
+	{
+		if (headlessDisplay == EGL_NO_DISPLAY)
+		{
+			return;
+		}
+
+		eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+		if (headlessContext != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(headlessDisplay, headlessContext);
+			headlessContext = EGL_NO_CONTEXT;
+		}
+
+		eglTerminate(headlessDisplay);
+		headlessDisplay = EGL_NO_DISPLAY;
+
+		//the state cache would remember objects from the destroyed context
+		invalidateGLStateCache();
+	}
+
+	void createHeadlessRenderer(Renderer2D &renderer, FrameBuffer &frameBuffer, int w, int h, size_t quadCount, bool depth)
+	{
+		frameBuffer.create(w, h, depth);
+		renderer.create(frameBuffer.fbo, quadCount);
+		renderer.updateWindowMetrics(w, h);
+	}
+
+	std::vector<unsigned char> readHeadlessFrameBuffer(FrameBuffer &frameBuffer)
+	{
+		glm::ivec2 size = {};
+		auto data = frameBuffer.texture.readTextureData(0, &size);
+
+		//gl stores the rows from bottom to top
+		const size_t row = (size_t)size.x * 4;
+		for (int y = 0; y < size.y / 2; y++)
+		{
+			std::swap_ranges(data.begin() + y * row, data.begin() + (y + 1) * row,
+				data.begin() + (size.y - 1 - y) * row);
+		}
+
+		return data;
+	}
+
+};
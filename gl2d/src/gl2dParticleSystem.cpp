@@ -5,21 +5,6 @@ namespace gl2d
 
 	static ShaderProgram defaultParticleShader = {};
 
-	static const char *defaultParticleVertexShader =
-		GL2D_OPNEGL_SHADER_VERSION "\n"
-		GL2D_OPNEGL_SHADER_PRECISION "\n"
-		"in vec2 quad_positions;\n"
-		"in vec4 quad_colors;\n"
-		"in vec2 texturePositions;\n"
-		"out vec4 v_color;\n"
-		"out vec2 v_texture;\n"
-		"void main()\n"
-		"{\n"
-		"	gl_Position = vec4(quad_positions, 0, 1);\n"
-		"	v_color = quad_colors;\n"
-		"	v_texture = texturePositions;\n"
-		"}\n";
-
 	static const char *defaultParcileFragmentShader =
 		GL2D_OPNEGL_SHADER_VERSION "\n"
 		GL2D_OPNEGL_SHADER_PRECISION "\n"
@@ -121,25 +106,10 @@ void ParticleSystem::initParticleSystem(int size)
 
 #if GL2D_SIMD != 0
 
-#if defined(_MSC_VER)
-/* Microsoft C/C++-compatible compiler */
-#include <intrin.h>
-#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
-/* GCC-compatible compiler, targeting x86/x86-64 */
-#include <x86intrin.h>
-#elif defined(__GNUC__) && defined(__ARM_NEON__)
-/* GCC-compatible compiler, targeting ARM with NEON */
-#include <arm_neon.h>
-#elif defined(__GNUC__) && defined(__IWMMXT__)
-/* GCC-compatible compiler, targeting ARM with WMMX */
-#include <mmintrin.h>
-#elif (defined(__GNUC__) || defined(__xlC__)) && (defined(__VEC__) || defined(__ALTIVEC__))
-/* XLC or GCC-compatible compiler, targeting PowerPC with VMX/VSX */
-#include <altivec.h>
-#elif defined(__GNUC__) && defined(__SPE__)
-/* GCC-compatible compiler, targeting PowerPC with SPE */
-#include <spe.h>
-#elif
+//the particles use sse, the other platforms use the scalar code
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__)
+#include <immintrin.h>
+#else
 #undef GL2D_SIMD
 #define GL2D_SIMD 0
 #endif
@@ -226,7 +196,9 @@ void ParticleSystem::applyMovement(float deltaTime)
 
 	}
 
+#if GL2D_SIMD != 0
 	__m128 _deltaTime = _mm_set1_ps(deltaTime);
+#endif
 
 #pragma region applyDrag
 
@@ -256,30 +228,30 @@ void ParticleSystem::applyMovement(float deltaTime)
 	{
 		//directionX[i] += deltaTime * dragX[i];
 
-		__m128 *dir = (__m128 *) & (directionX[i]);
-		__m128 *drag = (__m128 *) & (dragX[i]);
+		__m128 dir = _mm_loadu_ps(&directionX[i]);
+		__m128 drag = _mm_loadu_ps(&dragX[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&directionX[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 
 	for (int i = 0; i < size; i += 4)
 	{
 		//directionY[i] += deltaTime * dragY[i];
 
-		__m128 *dir = (__m128 *) & (directionY[i]);
-		__m128 *drag = (__m128 *) & (dragY[i]);
+		__m128 dir = _mm_loadu_ps(&directionY[i]);
+		__m128 drag = _mm_loadu_ps(&dragY[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&directionY[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 
 	for (int i = 0; i < size; i += 4)
 	{
 		//rotationSpeed[i] += deltaTime * rotationDrag[i];
 
-		__m128 *dir = (__m128 *) & (rotationSpeed[i]);
-		__m128 *drag = (__m128 *) & (rotationDrag[i]);
+		__m128 dir = _mm_loadu_ps(&rotationSpeed[i]);
+		__m128 drag = _mm_loadu_ps(&rotationDrag[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&rotationSpeed[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 #endif
 
@@ -317,29 +289,29 @@ void ParticleSystem::applyMovement(float deltaTime)
 	for (int i = 0; i < size; i += 4)
 	{
 		//posX[i] += deltaTime * directionX[i];
-		__m128 *dir = (__m128 *) & (posX[i]);
-		__m128 *drag = (__m128 *) & (directionX[i]);
+		__m128 dir = _mm_loadu_ps(&posX[i]);
+		__m128 drag = _mm_loadu_ps(&directionX[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&posX[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 
 
-	for (int i = 0; i < size; i++)
+	for (int i = 0; i < size; i += 4)
 	{
 		//posY[i] += deltaTime * directionY[i];
-		__m128 *dir = (__m128 *) & (posY[i]);
-		__m128 *drag = (__m128 *) & (directionY[i]);
+		__m128 dir = _mm_loadu_ps(&posY[i]);
+		__m128 drag = _mm_loadu_ps(&directionY[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&posY[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 
-	for (int i = 0; i < size; i++)
+	for (int i = 0; i < size; i += 4)
 	{
 		//rotation[i] += deltaTime * rotationSpeed[i];
-		__m128 *dir = (__m128 *) & (rotation[i]);
-		__m128 *drag = (__m128 *) & (rotationSpeed[i]);
+		__m128 dir = _mm_loadu_ps(&rotation[i]);
+		__m128 drag = _mm_loadu_ps(&rotationSpeed[i]);
 
-		*dir = _mm_fmadd_ps(_deltaTime, *drag, *dir);
+		_mm_storeu_ps(&rotation[i], _mm_add_ps(_mm_mul_ps(_deltaTime, drag), dir));
 	}
 
 #endif
@@ -477,6 +449,8 @@ void ParticleSystem::draw(Renderer2D &r)
 
 	}
 
+	//without post processing the particles are only recorded and drawn by the next flush
+	GL2D_GPU_ZONE("gl2d particles");
 
 	for (int i = 0; i < size; i++)
 	{
@@ -631,7 +605,8 @@ float ParticleSystem::rand(glm::vec2 v)
 
 void initgl2dParticleSystem()
 {
-	defaultParticleShader = createShaderProgram(defaultParticleVertexShader, defaultParcileFragmentShader);
+	//uses the default vertex shader so it works with every renderer mode
+	defaultParticleShader = createShader(defaultParcileFragmentShader);
 }
 
 void cleanupgl2dParticleSystem()
@@ -1519,9 +1519,6 @@ gl2d::Texture heartTexture;
 // Add global texture for lock icon
 gl2d::Texture lockTexture;
 
-// Add global texture for snow map background
-gl2d::Texture backgroundSnowTexture;
-
 // Function to create simple colored texture if it doesn't exist
 void createSimpleTexture(const std::string &filename, const Color &color)
 {
@@ -1593,18 +1590,29 @@ void createEnemyTextures()
     createSimpleTexture("resources/ghost.png", getEnemyColor(EnemyType::GHOST));
 }
 
-std::map<char, gl2d::Texture> alphabetTextures;
+// All the letters are packed in one atlas so the text is drawn with one texture
+gl2d::DynamicAtlas alphabetAtlas;
+std::map<char, gl2d::Sprite> alphabetSprites;
 
 void loadAlphabetTextures()
 {
+    alphabetAtlas.create(256);
+    std::map<char, int> ids;
     for (char c = 'A'; c <= 'Z'; ++c)
     {
         std::string path = "resources/alphabet/";
         path += c;
         path += ".png";
-        gl2d::Texture tex;
-        tex.loadFromFile(path.c_str());
-        alphabetTextures[c] = tex;
+        ids[c] = alphabetAtlas.addFromFile(path.c_str());
+    }
+
+    // get the sprites after adding everything, the coordinates change if the atlas grows
+    for (auto &id : ids)
+    {
+        if (id.second >= 0)
+        {
+            alphabetSprites[id.first] = alphabetAtlas.get(id.second);
+        }
     }
 }
 
@@ -1621,8 +1629,8 @@ void drawText(gl2d::Renderer2D &renderer, const std::string &text, float x, floa
             continue;
         }
         char upper = std::toupper(static_cast<unsigned char>(c));
-        auto it = alphabetTextures.find(upper);
-        if (it != alphabetTextures.end() && it->second.id != 0)
+        auto it = alphabetSprites.find(upper);
+        if (it != alphabetSprites.end() && it->second.texture.id != 0)
         {
             renderer.renderRectangle(
                 {cursorX, y, scaledSize, scaledSize},
@@ -1651,12 +1659,20 @@ Rectangle exitButton;
 // Placeholder: use a solid color for now
 gl2d::Texture placeholderTexture;
 
-gl2d::Texture backgroundDesertTexture;
+// The map backgrounds are only loaded when they are drawn, only one map is used while playing
+gl2d::TextureManager textureManager;
+int backgroundId = -1;
+int backgroundDesertId = -1;
+int backgroundSnowId = -1;
 
-inline float distance(float x1, float y1, float x2, float y2)
-{
-    return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-}
+// The game background and the UI panel, recorded again when the window size or the map changes
+gl2d::StaticBatch backgroundBatch;
+int backgroundBatchW = 0;
+int backgroundBatchH = 0;
+GLuint backgroundBatchTexture = 0;
+
+// F12 captures everything drawn in the next frame to frame.gl2dcap, replay it with gl2dReplay
+gl2d::FrameCapture frameCapture;
 
 // Helper functions for tutorial persistence
 bool isTutorialComplete()
@@ -1785,7 +1801,8 @@ int main()
         return -1;
     }
 
-    // Create a window
+    // Create a window, the depth buffer is used by the opaque pass of the renderer
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
     GLFWwindow *window = glfwCreateWindow(WIDTH, HEIGHT, "Tower Defense Game", NULL, NULL);
     if (!window)
     {
@@ -1817,13 +1834,15 @@ int main()
     // Create GL2D renderer
     gl2d::Renderer2D renderer;
     renderer.create();
+    // Sprites, towers and projectiles are single colored quads, store them as instances
+    renderer.instancedRendering = true;
+    // The background and the other opaque quads are drawn first so the pixels they cover are skipped
+    renderer.opaquePass = true;
 
     // Load alphabet textures for text rendering
     loadAlphabetTextures();
 
     // Load background texture
-    gl2d::Texture backgroundTexture;
-
     // Check if file exists
     if (!std::filesystem::exists("resources/background.png"))
     {
@@ -1833,9 +1852,13 @@ int main()
         return -1;
     }
 
-    backgroundTexture.loadFromFile("resources/background.png");
+    // The other maps are loaded the first time they are drawn, the two backgrounds that weren't used
+    // for the longest time are freed if the game is over the budget
+    textureManager.budget = 8 * 1024 * 1024;
+    backgroundId = textureManager.addFromFile("resources/background.png", "maps");
+    textureManager.load(backgroundId);
 
-    if (backgroundTexture.id == 0)
+    if (!textureManager.isLoaded(backgroundId))
     {
         std::cerr << "ERROR: Failed to load background texture!" << std::endl;
         std::cout << "Press Enter to exit..." << std::endl;
@@ -1845,23 +1868,21 @@ int main()
 
     std::cout << "Successfully loaded background texture!" << std::endl;
 
-    // Load background desert texture
+    // Add background desert texture
     std::string backgroundDesertPath = "resources/backgroundDesert.png";
-    backgroundDesertTexture.loadFromFile(backgroundDesertPath.c_str());
-    if (backgroundDesertTexture.id == 0)
+    if (!std::filesystem::exists(backgroundDesertPath))
     {
         backgroundDesertPath = "../resources/backgroundDesert.png";
-        backgroundDesertTexture.loadFromFile(backgroundDesertPath.c_str());
     }
+    backgroundDesertId = textureManager.addFromFile(backgroundDesertPath.c_str(), "maps");
 
-    // Load background snow texture
+    // Add background snow texture
     std::string backgroundSnowPath = "resources/backgroundSnow.png";
-    backgroundSnowTexture.loadFromFile(backgroundSnowPath.c_str());
-    if (backgroundSnowTexture.id == 0)
+    if (!std::filesystem::exists(backgroundSnowPath))
     {
         backgroundSnowPath = "../resources/backgroundSnow.png";
-        backgroundSnowTexture.loadFromFile(backgroundSnowPath.c_str());
     }
+    backgroundSnowId = textureManager.addFromFile(backgroundSnowPath.c_str(), "maps");
 
     // Create projectile textures if they don't exist
     createSimpleTexture("resources/apple.png", Color(1.0f, 0.2f, 0.2f, 1.0f));     // Red apple
@@ -2051,6 +2072,30 @@ int main()
     bool tutorialMessageInitialized = false;
     while (!glfwWindowShouldClose(window))
     {
+        // Everything from the last frame was flushed, load the maps that were used and free the old ones
+        textureManager.update();
+
+        // The capture started on the last frame has the whole frame now
+        if (frameCapture.capturing())
+        {
+            if (frameCapture.end(renderer, "frame.gl2dcap"))
+            {
+                std::cout << "Captured the frame to frame.gl2dcap" << std::endl;
+            }
+            frameCapture.cleanup();
+        }
+
+        static bool captureKeyPressed = false;
+        if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS && !captureKeyPressed)
+        {
+            frameCapture.begin(renderer);
+            captureKeyPressed = true;
+        }
+        else if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_RELEASE)
+        {
+            captureKeyPressed = false;
+        }
+
         // Calculate delta time
         float currentTime = (float)glfwGetTime();
         float deltaTime = currentTime - lastTime;
@@ -2081,10 +2126,10 @@ int main()
         float buttonScale = std::min(scaleX, scaleY);
 
         // Select background and waypoints based on current screen
-        gl2d::Texture &currentBg =
-            (selectedMap == MapType::DESERT) ? backgroundDesertTexture : (selectedMap == MapType::SNOW)   ? backgroundSnowTexture
-                                                                     : (selectedMap == MapType::TUTORIAL) ? backgroundTexture // Use background.png for tutorial
-                                                                                                          : backgroundTexture;
+        gl2d::Texture currentBg = textureManager.get(
+            (selectedMap == MapType::DESERT) ? backgroundDesertId : (selectedMap == MapType::SNOW)   ? backgroundSnowId
+                                                                : (selectedMap == MapType::TUTORIAL) ? backgroundId // Use background.png for tutorial
+                                                                                                     : backgroundId);
         std::vector<Point> currentWaypoints =
             (selectedMap == MapType::DESERT) ? desertWaypoints : (selectedMap == MapType::SNOW)   ? snowWaypoints
                                                              : (selectedMap == MapType::TUTORIAL) ? waypoints // Use default waypoints for tutorial for now
@@ -2358,15 +2403,15 @@ int main()
             bool map1Hovered = isPointInRect((float)mouseX, (float)mouseY, scaledMap1);
             bool map2Hovered = desertMapUnlocked && isPointInRect((float)mouseX, (float)mouseY, scaledMap2);
             bool map3Hovered = snowMapUnlocked && isPointInRect((float)mouseX, (float)mouseY, scaledMap3);
-            renderer.renderRectangle({scaledMap1.x, scaledMap1.y, scaledMap1.w, scaledMap1.h}, backgroundTexture, {1, 1, 1, map1Hovered ? 1.0f : 0.8f});
+            renderer.renderRectangle({scaledMap1.x, scaledMap1.y, scaledMap1.w, scaledMap1.h}, textureManager.get(backgroundId), {1, 1, 1, map1Hovered ? 1.0f : 0.8f});
             // Desert map button: gray overlay if locked
             if (desertMapUnlocked)
             {
-                renderer.renderRectangle({scaledMap2.x, scaledMap2.y, scaledMap2.w, scaledMap2.h}, backgroundDesertTexture, {1, 1, 1, map2Hovered ? 1.0f : 0.8f});
+                renderer.renderRectangle({scaledMap2.x, scaledMap2.y, scaledMap2.w, scaledMap2.h}, textureManager.get(backgroundDesertId), {1, 1, 1, map2Hovered ? 1.0f : 0.8f});
             }
             else
             {
-                renderer.renderRectangle({scaledMap2.x, scaledMap2.y, scaledMap2.w, scaledMap2.h}, backgroundDesertTexture, {0.5f, 0.5f, 0.5f, 0.7f});
+                renderer.renderRectangle({scaledMap2.x, scaledMap2.y, scaledMap2.w, scaledMap2.h}, textureManager.get(backgroundDesertId), {0.5f, 0.5f, 0.5f, 0.7f});
                 // Draw lock.png icon centered
                 float lockSize = 48 * scaleY;
                 float lockX = scaledMap2.x + (scaledMap2.w - lockSize) / 2.0f;
@@ -2378,11 +2423,11 @@ int main()
             }
             if (snowMapUnlocked)
             {
-                renderer.renderRectangle({scaledMap3.x, scaledMap3.y, scaledMap3.w, scaledMap3.h}, backgroundSnowTexture, {1, 1, 1, map3Hovered ? 1.0f : 0.8f});
+                renderer.renderRectangle({scaledMap3.x, scaledMap3.y, scaledMap3.w, scaledMap3.h}, textureManager.get(backgroundSnowId), {1, 1, 1, map3Hovered ? 1.0f : 0.8f});
             }
             else
             {
-                renderer.renderRectangle({scaledMap3.x, scaledMap3.y, scaledMap3.w, scaledMap3.h}, backgroundSnowTexture, {0.5f, 0.5f, 0.5f, 0.7f});
+                renderer.renderRectangle({scaledMap3.x, scaledMap3.y, scaledMap3.w, scaledMap3.h}, textureManager.get(backgroundSnowId), {0.5f, 0.5f, 0.5f, 0.7f});
                 // Draw lock.png icon centered
                 float lockSize = 48 * scaleY;
                 float lockX = scaledMap3.x + (scaledMap3.w - lockSize) / 2.0f;
@@ -3289,13 +3334,27 @@ int main()
 
         // Draw background
         renderer.clearScreen({0.1, 0.2, 0.6, 1});
-        // Draw background
-        renderer.renderRectangle({0 * scaleX, 0 * scaleY, GAME_WIDTH * scaleX, HEIGHT * scaleY}, currentBg, {1, 1, 1, 1});
 
-        // Draw UI panel background
-        renderer.renderRectangle(
-            {(float)GAME_WIDTH * scaleX, 0 * scaleY, (float)PANEL_WIDTH * scaleX, (float)HEIGHT * scaleY},
-            {UI_BACKGROUND.r, UI_BACKGROUND.g, UI_BACKGROUND.b, UI_BACKGROUND.a});
+        // The background and the UI panel only change with the window size or the map,
+        // record them once and draw them from the gpu every frame
+        if (backgroundBatch.empty() || backgroundBatchW != w || backgroundBatchH != h || backgroundBatchTexture != currentBg.id)
+        {
+            backgroundBatch.begin(renderer);
+
+            // Draw background
+            renderer.renderRectangle({0 * scaleX, 0 * scaleY, GAME_WIDTH * scaleX, HEIGHT * scaleY}, currentBg, {1, 1, 1, 1});
+
+            // Draw UI panel background
+            renderer.renderRectangle(
+                {(float)GAME_WIDTH * scaleX, 0 * scaleY, (float)PANEL_WIDTH * scaleX, (float)HEIGHT * scaleY},
+                {UI_BACKGROUND.r, UI_BACKGROUND.g, UI_BACKGROUND.b, UI_BACKGROUND.a});
+
+            backgroundBatch.end(renderer);
+            backgroundBatchW = w;
+            backgroundBatchH = h;
+            backgroundBatchTexture = currentBg.id;
+        }
+        backgroundBatch.draw(renderer);
 
         // Draw bean count in top-right corner with larger size and better position
         drawNumber(renderer, beanCount, (GAME_WIDTH - 180) * scaleX, 15 * scaleY, 32.0f * scaleY); // Moved from -120 to -180 to accommodate larger numbers
@@ -4175,39 +4234,9 @@ int main()
             float drawX = towerMenu.selectedTower->pos.x * scaleX;
             float drawY = towerMenu.selectedTower->pos.y * scaleY;
             float drawRange = towerMenu.selectedTower->range * ((scaleX + scaleY) / 2.0f);
-            // Draw a white, semi-transparent ring for range
-            int segments = 64;
-            float angleStep = 2.0f * 3.1415926f / segments;
+            // Draw a white, semi-transparent ring for range, the outer edge is at the range
             float ringThickness = 4.0f * ((scaleX + scaleY) / 2.0f); // Thin ring
-            for (int i = 0; i < segments; ++i)
-            {
-                float angle1 = i * angleStep;
-                float angle2 = (i + 1) * angleStep;
-                float x1_outer = drawX + cos(angle1) * drawRange;
-                float y1_outer = drawY + sin(angle1) * drawRange;
-                float x2_outer = drawX + cos(angle2) * drawRange;
-                float y2_outer = drawY + sin(angle2) * drawRange;
-                float x1_inner = drawX + cos(angle1) * (drawRange - ringThickness);
-                float y1_inner = drawY + sin(angle1) * (drawRange - ringThickness);
-                float x2_inner = drawX + cos(angle2) * (drawRange - ringThickness);
-                float y2_inner = drawY + sin(angle2) * (drawRange - ringThickness);
-                // Draw a thin quad segment for the ring
-                float midAngle = (angle1 + angle2) * 0.5f;
-                float mx = drawX + cos(midAngle) * (drawRange - ringThickness / 2.0f);
-                float my = drawY + sin(midAngle) * (drawRange - ringThickness / 2.0f);
-                float rectW = distance(x1_outer, y1_outer, x2_outer, y2_outer);
-                float rectH = ringThickness;
-
-                // Calculate rotation angle for the rectangle
-                float rotation = midAngle;
-
-                // Draw the rectangle centered at (mx, my), rotated by 'rotation'
-                renderer.renderRectangle(
-                    {mx - rectW / 2, my - rectH / 2, rectW, rectH},
-                    {1.0f, 1.0f, 1.0f, 0.45f},
-                    {0.5f, 0.5f}, // center
-                    rotation);
-            }
+            renderer.renderRing({drawX, drawY}, drawRange - ringThickness / 2.0f, ringThickness, {1.0f, 1.0f, 1.0f, 0.45f});
         }
 
         // Flush renderer (draw everything)
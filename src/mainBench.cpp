@@ -0,0 +1,436 @@
+//measures the renderer throughput (quads per second and ms per frame) for the main workloads
+//and writes the results as json so runs before and after a change can be compared.
+//It uses a headless opengl context so it also runs on a software renderer (mesa llvmpipe).
+//Every frame is finished with glFinish so the gpu time is included in the frame time.
+//
+//usage: gl2dBench [--seconds S] [--out file.json] [--font file.ttf] [--filter text]
+//  --seconds   how long every workload runs, default 1
+//  --out       where the json is written, default stdout
+//  --font      the font used for the text workloads, they are skipped without it
+//  --filter    runs only the workloads that contain the text in their name
+#include "gl2d/gl2dHeadless.h"
+#include "gl2d/gl2dParticleSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef RESOURCES_PATH
+#define RESOURCES_PATH "./resources/"
+#endif
+
+constexpr int BENCH_W = 1280;
+constexpr int BENCH_H = 720;
+constexpr int WARM_UP_FRAMES = 5;
+
+struct Result
+{
+	std::string name;
+	bool skipped = false;
+	int frames = 0;
+	double quadsPerFrame = 0;
+	double drawCallsPerFrame = 0;
+	double msPerFrame = 0;
+	double msPerFrameP50 = 0;
+	double msPerFrameP95 = 0;
+	double quadsPerSecond = 0;
+};
+
+gl2d::Renderer2D renderer;
+gl2d::FrameBuffer output;
+double secondsPerWorkload = 1;
+std::string filter;
+std::vector<Result> results;
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void benchmark(const std::string &name, std::function<void()> renderFrame)
+{
+	if (!filter.empty() && name.find(filter) == std::string::npos) { return; }
+
+	std::fprintf(stderr, "%-40s", name.c_str());
+
+	auto frame = [&]()
+	{
+		double start = now();
+		renderer.clearScreen({0.1f, 0.1f, 0.2f, 1});
+		renderFrame();
+		renderer.flush();
+		glFinish();
+		double ms = (now() - start) * 1000.0;
+
+		renderer.endFrameStats();
+		return ms;
+	};
+
+	for (int i = 0; i < WARM_UP_FRAMES; i++) { frame(); }
+
+	std::vector<double> times;
+	size_t quads = 0;
+	size_t drawCalls = 0;
+	double total = 0;
+	while (total < secondsPerWorkload * 1000.0 || times.size() < 3)
+	{
+		double ms = frame();
+		auto stats = renderer.getFrameStats();
+		quads += stats.quads;
+		drawCalls += stats.drawCalls;
+		times.push_back(ms);
+		total += ms;
+	}
+
+	std::sort(times.begin(), times.end());
+
+	Result r;
+	r.name = name;
+	r.frames = (int)times.size();
+	r.quadsPerFrame = (double)quads / times.size();
+	r.drawCallsPerFrame = (double)drawCalls / times.size();
+	r.msPerFrame = total / times.size();
+	r.msPerFrameP50 = times[times.size() / 2];
+	r.msPerFrameP95 = times[std::min(times.size() - 1, times.size() * 95 / 100)];
+	r.quadsPerSecond = quads / (total / 1000.0);
+	results.push_back(r);
+
+	std::fprintf(stderr, " %9.3f ms/frame %9.2f M quads/s\n", r.msPerFrame, r.quadsPerSecond / 1'000'000.0);
+}
+
+void skip(const std::string &name)
+{
+	if (!filter.empty() && name.find(filter) == std::string::npos) { return; }
+
+	std::fprintf(stderr, "%-40s skipped\n", name.c_str());
+
+	Result r;
+	r.name = name;
+	r.skipped = true;
+	results.push_back(r);
+}
+
+static void writeJson(FILE *f)
+{
+	std::fprintf(f, "{\n");
+	std::fprintf(f, "\t\"renderer\": \"%s\",\n", (const char *)glGetString(GL_RENDERER));
+	std::fprintf(f, "\t\"version\": \"%s\",\n", (const char *)glGetString(GL_VERSION));
+	std::fprintf(f, "\t\"width\": %d,\n", BENCH_W);
+	std::fprintf(f, "\t\"height\": %d,\n", BENCH_H);
+	std::fprintf(f, "\t\"seconds_per_workload\": %g,\n", secondsPerWorkload);
+	std::fprintf(f, "\t\"workloads\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		auto &r = results[i];
+		std::fprintf(f, "\t\t{\"name\": \"%s\", ", r.name.c_str());
+		if (r.skipped)
+		{
+			std::fprintf(f, "\"skipped\": true}");
+		}
+		else
+		{
+			std::fprintf(f, "\"frames\": %d, \"quads_per_frame\": %.1f, \"draw_calls_per_frame\": %.1f, "
+				"\"ms_per_frame\": %.4f, \"ms_per_frame_p50\": %.4f, \"ms_per_frame_p95\": %.4f, \"quads_per_second\": %.0f}",
+				r.frames, r.quadsPerFrame, r.drawCallsPerFrame,
+				r.msPerFrame, r.msPerFrameP50, r.msPerFrameP95, r.quadsPerSecond);
+		}
+		std::fprintf(f, i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	std::fprintf(f, "\t]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *outFile = nullptr;
+	const char *fontFile = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) { secondsPerWorkload = std::atof(argv[++i]); }
+		else if (!std::strcmp(argv[i], "--out") && i + 1 < argc) { outFile = argv[++i]; }
+		else if (!std::strcmp(argv[i], "--font") && i + 1 < argc) { fontFile = argv[++i]; }
+		else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc) { filter = argv[++i]; }
+		else
+		{
+			std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	const char *error = nullptr;
+	if (!gl2d::createHeadlessContext(&error))
+	{
+		std::fprintf(stderr, "couldn't create the headless context: %s\n", error);
+		return 1;
+	}
+
+	gl2d::init();
+	gl2d::initgl2dParticleSystem();
+	gl2d::createHeadlessRenderer(renderer, output, BENCH_W, BENCH_H, 100'000, true);
+
+	gl2d::Texture texture(RESOURCES_PATH "test.jpg");
+	gl2d::Texture zombie(RESOURCES_PATH "zombie.png", true);
+
+	gl2d::Font font;
+	if (fontFile) { font.createFromFile(fontFile); }
+
+#pragma region rectangles
+
+	for (int count : {10'000, 100'000})
+	{
+		std::string suffix = " " + std::to_string(count / 1000) + "k";
+
+		benchmark("renderRectangle plain" + suffix, [&]()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				renderer.renderRectangle({(i % 160) * 8.f, (i / 160 % 90) * 8.f, 8, 8}, Colors_Orange);
+			}
+		});
+
+		benchmark("renderRectangle textured" + suffix, [&]()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				renderer.renderRectangle({(i % 160) * 8.f, (i / 160 % 90) * 8.f, 8, 8}, (i & 1) ? zombie : texture);
+			}
+		});
+
+		benchmark("renderRectangle rotated" + suffix, [&]()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				renderer.renderRectangle({(i % 160) * 8.f, (i / 160 % 90) * 8.f, 8, 8}, zombie, Colors_White, {}, (float)(i % 360));
+			}
+		});
+
+		benchmark("renderRectangle camera rotated" + suffix, [&]()
+		{
+			gl2d::Camera camera;
+			camera.rotation = 30;
+			camera.zoom = 1.2f;
+			renderer.pushCamera(camera);
+			for (int i = 0; i < count; i++)
+			{
+				renderer.renderRectangle({(i % 160) * 8.f, (i / 160 % 90) * 8.f, 8, 8}, zombie);
+			}
+			renderer.popCamera();
+		});
+	}
+
+#pragma endregion
+
+#pragma region text
+
+	const char *line = "The quick brown fox jumps over the lazy dog 0123456789";
+	std::string paragraph;
+	for (int i = 0; i < 8; i++) { paragraph += line; paragraph += ' '; }
+
+	if (fontFile)
+	{
+		benchmark("renderText 100 lines", [&]()
+		{
+			for (int i = 0; i < 100; i++)
+			{
+				renderer.renderText({10, 10 + (i % 40) * 18.f}, line, font, Colors_White, 0.5f, 4, 3, false);
+			}
+		});
+
+		benchmark("renderTextWrapped 20 paragraphs", [&]()
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				renderer.renderTextWrapped(paragraph, font, {(i % 4) * 320.f, (i / 4) * 144.f, 300, 144}, Colors_White, 0.4f, 4, 3, false);
+			}
+		});
+	}
+	else
+	{
+		skip("renderText 100 lines");
+		skip("renderTextWrapped 20 paragraphs");
+	}
+
+#pragma endregion
+
+#pragma region shapes
+
+	benchmark("render9Patch2 2k", [&]()
+	{
+		for (int i = 0; i < 2'000; i++)
+		{
+			renderer.render9Patch2({(i % 40) * 32.f, (i / 40 % 24) * 30.f, 30, 28}, Colors_White, {}, 0,
+				zombie, {0, 1, 1, 0}, {0.2f, 0.8f, 0.8f, 0.2f});
+		}
+	});
+
+	benchmark("renderCircleOutline 1k 32 segments", [&]()
+	{
+		for (int i = 0; i < 1'000; i++)
+		{
+			renderer.renderCircleOutline({(i % 40) * 32.f + 16, (i / 40 % 24) * 30.f + 15}, 12, Colors_Turqoise, 2, 32);
+		}
+	});
+
+	//debug paths, 100 paths of 100 points as separate lines and as polylines
+	std::vector<glm::vec2> path(100 * 100);
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		const float t = (i % 100) / 99.f;
+		path[i] = {20 + t * 1240, (i / 100) * 7.f + 10 + std::sin(t * 40 + i / 100) * 5};
+	}
+
+	benchmark("renderLine 10k", [&]()
+	{
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			if (i % 100 != 99) { renderer.renderLine(path[i], path[i + 1], Colors_Yellow, 2); }
+		}
+	});
+
+	benchmark("renderPolyline 100 x 100 points", [&]()
+	{
+		for (size_t i = 0; i < path.size(); i += 100)
+		{
+			renderer.renderPolyline(&path[i], 100, Colors_Yellow, 2);
+		}
+	});
+
+	benchmark("renderRing 1k", [&]()
+	{
+		for (int i = 0; i < 1'000; i++)
+		{
+			renderer.renderRing({(i % 40) * 32.f + 16, (i / 40 % 24) * 30.f + 15}, 12, 2, Colors_Turqoise);
+		}
+	});
+
+	benchmark("renderCircle and renderRoundedRect 10k", [&]()
+	{
+		for (int i = 0; i < 10'000; i++)
+		{
+			const glm::vec2 p = {(i % 160) * 8.f, (i / 160 % 90) * 8.f};
+			if (i & 1) { renderer.renderCircle(p + glm::vec2(4), 3.5f, Colors_Orange); }
+			else { renderer.renderRoundedRect({p.x, p.y, 8, 8}, 2, Colors_Orange); }
+		}
+	});
+
+#pragma endregion
+
+#pragma region overdraw
+
+	//full screen opaque layers (backgrounds, ui panels) with translucent sprites between them
+	for (bool opaquePass : {false, true})
+	{
+		renderer.opaquePass = opaquePass;
+
+		benchmark(std::string("overdraw 8 layers") + (opaquePass ? " opaque pass" : ""), [&]()
+		{
+			for (int layer = 0; layer < 8; layer++)
+			{
+				renderer.renderRectangle({layer * 16.f, layer * 9.f, BENCH_W, BENCH_H}, texture);
+				for (int i = 0; i < 200; i++)
+				{
+					renderer.renderRectangle({(i % 20) * 64.f, (i / 20) * 72.f, 48, 48}, zombie);
+				}
+			}
+		});
+	}
+
+	renderer.opaquePass = false;
+
+#pragma endregion
+
+#pragma region post process
+
+	gl2d::ShaderProgram postProcess = gl2d::createPostProcessShader(GL2D_OPNEGL_SHADER_VERSION "\n"
+		"out vec4 color; in vec2 v_texture; uniform sampler2D u_sampler;\n"
+		"void main(){ color = vec4(1.0 - texture(u_sampler, v_texture).rgb, 1.0); }");
+
+	for (int passes = 1; passes <= 4; passes++)
+	{
+		std::vector<gl2d::ShaderProgram> chain(passes, postProcess);
+
+		benchmark("flushPostProcess " + std::to_string(passes) + " passes", [&]()
+		{
+			for (int i = 0; i < 1'000; i++)
+			{
+				renderer.renderRectangle({(i % 40) * 32.f, (i / 40 % 24) * 30.f, 30, 28}, zombie);
+			}
+			renderer.flushPostProcess(chain);
+		});
+	}
+
+#pragma endregion
+
+#pragma region particles
+
+	gl2d::ParticleSettings particleSettings;
+	particleSettings.positionX = {-600, 600};
+	particleSettings.positionY = {-340, 340};
+	particleSettings.particleLifeTime = {1'000, 1'000}; //they stay alive for the whole benchmark
+	particleSettings.directionX = {-20, 20};
+	particleSettings.directionY = {-20, 20};
+	particleSettings.rotation = {0, 360};
+	particleSettings.rotationSpeed = {-30, 30};
+	particleSettings.createApearence.size = {4, 8};
+	particleSettings.createApearence.color1 = {1, 0.5f, 0.2f, 1};
+	particleSettings.createApearence.color2 = {1, 0.9f, 0.4f, 1};
+	particleSettings.createEndApearence = particleSettings.createApearence;
+	particleSettings.texturePtr = &zombie;
+
+	for (int count : {1'000, 10'000, 100'000})
+	{
+		for (bool postProcessing : {false, true})
+		{
+			gl2d::ParticleSystem particles;
+			particles.initParticleSystem(count);
+			particles.postProcessing = postProcessing;
+			particleSettings.onCreateCount = count;
+			particles.emitParticleWave(&particleSettings, {BENCH_W / 2, BENCH_H / 2});
+
+			benchmark("ParticleSystem " + std::to_string(count / 1000) + "k" + (postProcessing ? " post process" : ""), [&]()
+			{
+				particles.applyMovement(1 / 60.f);
+				particles.draw(renderer);
+			});
+
+			particles.cleanup();
+		}
+	}
+
+#pragma endregion
+
+	if (outFile)
+	{
+		FILE *f = std::fopen(outFile, "w");
+		if (!f)
+		{
+			std::fprintf(stderr, "couldn't open %s\n", outFile);
+			return 1;
+		}
+		writeJson(f);
+		std::fclose(f);
+	}
+	else
+	{
+		writeJson(stdout);
+	}
+
+	postProcess.clear();
+	font.cleanup();
+	texture.cleanup();
+	zombie.cleanup();
+	output.cleanup();
+	renderer.cleanup();
+	gl2d::cleanupgl2dParticleSystem();
+	gl2d::cleanup();
+	gl2d::destroyHeadlessContext();
+
+	return 0;
+}
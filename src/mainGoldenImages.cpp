@@ -0,0 +1,473 @@
+//renders scripted scenes into a frame buffer using a headless opengl context,
+//reads them back and compares them against golden png images.
+//It works without a window or a gpu (mesa llvmpipe) so it can run on a build machine.
+//
+//usage: gl2dGoldenImages [--update] [--tolerance N] [--bad-pixels F] [--dir path] [scene names...]
+//  --update       writes the golden images instead of comparing
+//  --tolerance    the max difference allowed for a color channel (0-255), default 8
+//  --bad-pixels   the fraction of pixels allowed to be over the tolerance, default 0.001
+//  --dir          where the golden images are
+//The exit code is 0 only if every scene matched. For every failed scene
+//name_actual.png and name_diff.png are written next to the golden image.
+#include "gl2d/gl2dHeadless.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stb_image/stb_image.h>
+#include <string>
+#include <vector>
+
+#ifndef RESOURCES_PATH
+#define RESOURCES_PATH "./resources/"
+#endif
+
+#ifndef GOLDEN_IMAGES_PATH
+#define GOLDEN_IMAGES_PATH "./goldenImages/"
+#endif
+
+constexpr int SCENE_W = 256;
+constexpr int SCENE_H = 192;
+
+#pragma region png
+
+//a minimal png writer, the image data is stored in uncompressed deflate blocks
+//so it doesn't need zlib, the images are small anyway
+static unsigned int crc32(const unsigned char *data, size_t size, unsigned int crc = 0)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+	{
+		crc ^= data[i];
+		for (int k = 0; k < 8; k++) { crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1))); }
+	}
+	return ~crc;
+}
+
+static void pushBigEndian(std::vector<unsigned char> &out, unsigned int v)
+{
+	out.push_back(v >> 24); out.push_back(v >> 16); out.push_back(v >> 8); out.push_back(v);
+}
+
+static void pushChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data)
+{
+	pushBigEndian(out, (unsigned int)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	pushBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+//data is RGBA with the rows from top to bottom
+static bool writePng(const char *fileName, const unsigned char *data, int w, int h)
+{
+	std::vector<unsigned char> raw;
+	raw.reserve((size_t)(w * 4 + 1) * h);
+	for (int y = 0; y < h; y++)
+	{
+		raw.push_back(0); //no filter
+		raw.insert(raw.end(), data + (size_t)y * w * 4, data + (size_t)(y + 1) * w * 4);
+	}
+
+	std::vector<unsigned char> zlib = {0x78, 0x01};
+	for (size_t pos = 0; pos < raw.size() || pos == 0;)
+	{
+		unsigned int size = (unsigned int)std::min<size_t>(raw.size() - pos, 65535);
+		bool last = pos + size == raw.size();
+		zlib.push_back(last);
+		zlib.push_back(size & 0xff); zlib.push_back(size >> 8);
+		zlib.push_back(~size & 0xff); zlib.push_back((~size >> 8) & 0xff);
+		zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+		pos += size;
+		if (last) { break; }
+	}
+
+	unsigned int a = 1, b = 0;
+	for (auto c : raw) { a = (a + c) % 65521; b = (b + a) % 65521; }
+	pushBigEndian(zlib, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	pushBigEndian(header, w);
+	pushBigEndian(header, h);
+	header.insert(header.end(), {8, 6, 0, 0, 0}); //8 bits, RGBA
+
+	std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	pushChunk(png, "IHDR", header);
+	pushChunk(png, "IDAT", zlib);
+	pushChunk(png, "IEND", {});
+
+	FILE *f = std::fopen(fileName, "wb");
+	if (!f) { return false; }
+	bool ok = std::fwrite(png.data(), 1, png.size(), f) == png.size();
+	std::fclose(f);
+	return ok;
+}
+
+#pragma endregion
+
+#pragma region scenes
+
+struct SceneResources
+{
+	gl2d::Texture texture;
+	gl2d::Texture zombie;
+	gl2d::FrameBuffer frameBuffer;
+	gl2d::ShaderProgram postProcess;
+};
+
+static void sceneShapes(gl2d::Renderer2D &r, SceneResources &)
+{
+	r.renderRectangle({8, 8, 40, 30}, Colors_Red);
+	gl2d::Color4f colors[4] = {Colors_Red, Colors_Green, Colors_Blue, Colors_White};
+	r.renderRectangle({60, 8, 60, 40}, colors);
+	r.renderRectangle({130, 8, 40, 40}, {1, 1, 0, 0.5f});
+	r.renderRectangle({150, 28, 40, 40}, {0, 1, 1, 0.5f});
+	r.renderLine({10, 80}, {240, 120}, Colors_Green, 4);
+	r.renderLine({20, 180}, 30, 100, Colors_Orange, 3);
+	r.renderRectangleOutline({140, 100, 60, 40}, Colors_Magenta, 3);
+	r.renderCircleOutline({60, 140}, 30, Colors_Turqoise, 2, 24);
+}
+
+static void sceneRotation(gl2d::Renderer2D &r, SceneResources &res)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		r.renderRectangle({20.f + i * 38, 30, 30, 20}, res.zombie, Colors_White, {}, i * 30.f);
+		r.renderRectangle({20.f + i * 38, 80, 30, 20}, Colors_Blue, {10, 0}, -i * 25.f);
+		r.renderRectangleAbsRotation({20.f + i * 38, 130, 30, 20}, Colors_Yellow, {20.f + i * 38, 130}, i * 15.f);
+	}
+	r.renderRectangleOutline({100, 160, 50, 20}, Colors_Red, 2, {}, 20);
+}
+
+static void sceneCamera(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.renderRectangle({0, 0, SCENE_W, SCENE_H}, res.texture, {1, 1, 1, 0.4f});
+
+	gl2d::Camera camera;
+	camera.position = {-10, -20};
+	camera.zoom = 1.3f;
+	camera.rotation = 15;
+	r.pushCamera(camera);
+	r.renderRectangle({40, 60, 30, 30}, res.zombie);
+	r.renderRectangle({100, 60, 30, 30}, Colors_Magenta, {}, 45);
+	r.popCamera();
+
+	r.renderRectangle({200, 150, 30, 30}, res.zombie);
+}
+
+static void sceneTexture(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.renderRectangle({0, 0, 128, 96}, res.texture);
+	r.renderRectangle({128, 0, 128, 96}, res.texture, Colors_White, {}, 0, {0.25f, 0.75f, 0.75f, 0.25f});
+	r.renderRectangle({0, 96, 128, 96}, res.zombie, {1, 0.5f, 0.5f, 1});
+	r.renderRectangle({128, 96, 128, 96}, res.zombie, Colors_White, {}, 0, {1, 1, 0, 0}); //flipped
+}
+
+static void sceneNinePatch(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.render9Patch2({10, 10, 120, 80}, Colors_White, {}, 0, res.zombie, {0, 1, 1, 0}, {0.2f, 0.8f, 0.8f, 0.2f});
+	r.render9Patch2({140, 20, 100, 150}, {0.5f, 1, 0.5f, 1}, {}, 10, res.zombie, {0, 1, 1, 0}, {0.3f, 0.7f, 0.7f, 0.3f});
+	r.render9Patch({10, 110, 100, 70}, 12, Colors_White, {}, 0, res.texture, {0, 1, 1, 0}, {0.2f, 0.8f, 0.8f, 0.2f});
+}
+
+static void scenePostProcess(gl2d::Renderer2D &r, SceneResources &res)
+{
+	sceneShapes(r, res);
+	r.flushFBO(res.frameBuffer);
+	r.renderRectangle({0, 0, SCENE_W, SCENE_H}, res.frameBuffer.texture);
+	r.renderRectangle({150, 110, 80, 60}, res.frameBuffer.texture, Colors_White, {}, 10);
+
+	//the scene runner flushes to the default fbo, so the post process writes there
+	r.flushPostProcess({res.postProcess});
+}
+
+static void sceneInstancing(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.instancedRendering = true;
+	sceneRotation(r, res);
+	r.flush();
+	r.instancedRendering = false;
+}
+
+static void sceneSorting(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.deferredSorting = true;
+	for (int i = 0; i < 40; i++)
+	{
+		r.pushLayer(i % 3);
+		r.renderRectangle({10.f + (i % 10) * 22, 10.f + (i / 10) * 40, 40, 40},
+			(i & 1) ? res.zombie : res.texture, {1, 1, 1, 0.8f});
+		r.popLayer();
+	}
+	r.pushLayer(5);
+	r.renderRectangle({100, 60, 60, 60}, Colors_Red);
+	r.popLayer();
+	r.flush();
+	r.deferredSorting = false;
+}
+
+static void sceneStaticBatch(gl2d::Renderer2D &r, SceneResources &res)
+{
+	gl2d::StaticBatch batch;
+	batch.begin(r);
+	sceneTexture(r, res);
+	batch.end(r);
+
+	batch.draw(r);
+	r.renderRectangle({100, 70, 60, 50}, Colors_Red, {}, 30);
+	r.flush();
+
+	gl2d::Camera camera;
+	camera.position = {40, 30};
+	camera.zoom = 2;
+	batch.draw(r, &camera);
+
+	batch.cleanup();
+}
+
+static void sceneCulling(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.culling = true;
+
+	gl2d::Camera camera;
+	camera.position = {300, 200};
+	camera.rotation = 20;
+	r.pushCamera(camera);
+	for (int y = 0; y < 30; y++)
+		for (int x = 0; x < 30; x++)
+		{
+			r.renderRectangle({x * 24.f, y * 24.f, 20, 20}, ((x + y) & 1) ? res.zombie : res.texture);
+		}
+	r.popCamera();
+
+	r.flush();
+	r.culling = false;
+}
+
+static void sceneSdfShapes(gl2d::Renderer2D &r, SceneResources &res)
+{
+	r.renderCircle({50, 50}, 40, Colors_Red);
+	r.renderRing({150, 50}, 36, 8, Colors_Green);
+	r.renderRing({215, 40}, 30, 1.5f, Colors_White);
+	r.renderRoundedRect({20, 110, 120, 70}, 16, Colors_Blue);
+	r.renderRoundedRect({160, 130, 80, 40}, 20, {1, 1, 0, 0.6f}, {}, 30);
+
+	//they batch with the sprites
+	r.renderRectangle({100, 20, 40, 40}, res.zombie);
+
+	gl2d::Camera camera;
+	camera.zoom = 2;
+	camera.rotation = 15;
+	r.pushCamera(camera);
+	r.renderCircle({150, 100}, 6, Colors_Magenta);
+	r.renderRing({175, 100}, 8, 2, {1, 1, 1, 0.5f});
+	r.popCamera();
+
+	r.flush();
+}
+
+static void sceneStreamWrap(gl2d::Renderer2D &r, SceneResources &)
+{
+	//fills the stream buffer up to about a fifth so the next flush wraps around,
+	//its vertices and instances must not be written over each other
+	const size_t ring = r.streamBuffer.size;
+	const size_t quadBytes = 4 * sizeof(gl2d::Renderer2DVertex);
+	auto fill = [&](size_t bytes)
+	{
+		for (size_t i = 0; i < bytes / quadBytes; i++) { r.renderRectangle({0, 0, 1, 1}, Colors_Black); }
+		r.flush();
+	};
+	fill(ring - ring / 5);
+	fill(ring / 5 + quadBytes * 4);
+	r.clearScreen({0.1f, 0.1f, 0.2f, 1});
+
+	r.instancedRendering = true;
+
+	//4 colors use the vertices, the quads are small so most of them are visible
+	const int gradients = (int)(ring * 2 / 5 / quadBytes);
+	for (int i = 0; i < gradients; i++)
+	{
+		const float t = (float)i / gradients;
+		const gl2d::Color4f colors[4] = {{t, 0, 0, 1}, {0, t, 0, 1}, {0, 0, t, 1}, {1 - t, 1, t, 1}};
+		r.renderRectangle({(i % 128) * 2.f, ((i / 128) % 48) * 2.f, 2, 2}, colors);
+	}
+
+	//one color uses the instances
+	const int instances = (int)(ring / 2 / sizeof(gl2d::Renderer2DInstance));
+	for (int i = 0; i < instances; i++)
+	{
+		const float t = (float)i / instances;
+		r.renderRectangle({(i % 64) * 4.f, 96 + ((i / 64) % 24) * 4.f, 4, 4}, {t, 1 - t, 0.5f, 1});
+	}
+
+	r.flush();
+	r.instancedRendering = false;
+}
+
+struct Scene
+{
+	const char *name;
+	void (*render)(gl2d::Renderer2D &r, SceneResources &res);
+};
+
+static const Scene scenes[] =
+{
+	{"shapes", sceneShapes},
+	{"rotation", sceneRotation},
+	{"camera", sceneCamera},
+	{"texture", sceneTexture},
+	{"ninePatch", sceneNinePatch},
+	{"postProcess", scenePostProcess},
+	{"instancing", sceneInstancing},
+	{"sorting", sceneSorting},
+	{"staticBatch", sceneStaticBatch},
+	{"culling", sceneCulling},
+	{"sdfShapes", sceneSdfShapes},
+	{"streamWrap", sceneStreamWrap},
+};
+
+#pragma endregion
+
+int main(int argc, char *argv[])
+{
+	bool update = false;
+	int tolerance = 8;
+	double badPixels = 0.001;
+	std::string dir = GOLDEN_IMAGES_PATH;
+	std::vector<std::string> only;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--update")) { update = true; }
+		else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) { tolerance = std::atoi(argv[++i]); }
+		else if (!std::strcmp(argv[i], "--bad-pixels") && i + 1 < argc) { badPixels = std::atof(argv[++i]); }
+		else if (!std::strcmp(argv[i], "--dir") && i + 1 < argc) { dir = argv[++i]; if (!dir.empty() && dir.back() != '/') { dir += '/'; } }
+		else if (!std::strncmp(argv[i], "--", 2))
+		{
+			std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+		else { only.push_back(argv[i]); }
+	}
+
+	//a typo in a scene name would otherwise pass with 0 scenes
+	for (auto &name : only)
+	{
+		if (std::none_of(std::begin(scenes), std::end(scenes), [&](const Scene &s) { return name == s.name; }))
+		{
+			std::fprintf(stderr, "unknown scene %s\n", name.c_str());
+			return 1;
+		}
+	}
+
+	const char *error = nullptr;
+	if (!gl2d::createHeadlessContext(&error))
+	{
+		std::printf("couldn't create the headless context: %s\n", error);
+		return 1;
+	}
+
+	gl2d::init();
+
+	SceneResources res;
+	res.texture.loadFromFile(RESOURCES_PATH "test.jpg");
+	res.zombie.loadFromFile(RESOURCES_PATH "zombie.png", true);
+	res.frameBuffer.create(SCENE_W, SCENE_H);
+	res.postProcess = gl2d::createPostProcessShader(GL2D_OPNEGL_SHADER_VERSION "\n"
+		"out vec4 color; in vec2 v_texture; uniform sampler2D u_sampler;\n"
+		"void main(){ color = vec4(1.0 - texture(u_sampler, v_texture).rgb, 1.0); }");
+
+	gl2d::Renderer2D renderer;
+	gl2d::FrameBuffer output;
+	gl2d::createHeadlessRenderer(renderer, output, SCENE_W, SCENE_H);
+
+	int failed = 0;
+	int ran = 0;
+	for (auto &scene : scenes)
+	{
+		if (!only.empty() && std::find(only.begin(), only.end(), scene.name) == only.end()) { continue; }
+		ran++;
+
+		renderer.clearScreen({0.1f, 0.1f, 0.2f, 1});
+		scene.render(renderer, res);
+		renderer.flush();
+
+		auto actual = gl2d::readHeadlessFrameBuffer(output);
+		std::string golden = dir + scene.name + ".png";
+
+		if (update)
+		{
+			if (!writePng(golden.c_str(), actual.data(), SCENE_W, SCENE_H))
+			{
+				std::printf("%-12s couldn't write %s\n", scene.name, golden.c_str());
+				failed++;
+			}
+			else
+			{
+				std::printf("%-12s updated\n", scene.name);
+			}
+			continue;
+		}
+
+		//the readback has the rows from top to bottom, like the png
+		stbi_set_flip_vertically_on_load(false);
+		int w = 0, h = 0, channels = 0;
+		unsigned char *expected = stbi_load(golden.c_str(), &w, &h, &channels, 4);
+		if (!expected || w != SCENE_W || h != SCENE_H)
+		{
+			std::printf("%-12s FAILED, couldn't load %s or it has another size\n", scene.name, golden.c_str());
+			if (expected) { stbi_image_free(expected); }
+			writePng((dir + scene.name + "_actual.png").c_str(), actual.data(), SCENE_W, SCENE_H);
+			failed++;
+			continue;
+		}
+
+		std::vector<unsigned char> diff(actual.size());
+		int bad = 0;
+		int maxDifference = 0;
+		for (int i = 0; i < SCENE_W * SCENE_H; i++)
+		{
+			int difference = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				difference = std::max(difference, std::abs(actual[i * 4 + c] - expected[i * 4 + c]));
+			}
+			maxDifference = std::max(maxDifference, difference);
+
+			//bad pixels are red, the rest is a dark version of the image
+			bool isBad = difference > tolerance;
+			bad += isBad;
+			diff[i * 4 + 0] = isBad ? 255 : actual[i * 4 + 0] / 4;
+			diff[i * 4 + 1] = isBad ? 0 : actual[i * 4 + 1] / 4;
+			diff[i * 4 + 2] = isBad ? 0 : actual[i * 4 + 2] / 4;
+			diff[i * 4 + 3] = 255;
+		}
+		stbi_image_free(expected);
+
+		double badFraction = (double)bad / (SCENE_W * SCENE_H);
+		if (badFraction > badPixels)
+		{
+			std::printf("%-12s FAILED, %d pixels over the tolerance (%.3f%%), max difference %d\n",
+				scene.name, bad, badFraction * 100, maxDifference);
+			writePng((dir + scene.name + "_actual.png").c_str(), actual.data(), SCENE_W, SCENE_H);
+			writePng((dir + scene.name + "_diff.png").c_str(), diff.data(), SCENE_W, SCENE_H);
+			failed++;
+		}
+		else
+		{
+			std::printf("%-12s ok, %d pixels over the tolerance, max difference %d\n", scene.name, bad, maxDifference);
+		}
+	}
+
+	std::printf("%d of %d scenes %s\n", ran - failed, ran, update ? "updated" : "passed");
+
+	renderer.cleanup();
+	output.cleanup();
+	res.frameBuffer.cleanup();
+	res.texture.cleanup();
+	res.zombie.cleanup();
+	gl2d::cleanup();
+	gl2d::destroyHeadlessContext();
+
+	return failed ? 1 : 0;
+}
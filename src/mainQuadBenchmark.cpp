@@ -0,0 +1,249 @@
+//measures how many quads per second the renderer can record for each quad kernel.
+//It only records into a CommandRecorder so it doesn't need a window or an opengl context.
+//With --verify it instead checks transformQuads at every simd level against the scalar code
+//and returns 1 if any vertex is off by more than the tolerance.
+#include "gl2d/gl2d.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+constexpr int QUADS_PER_FRAME = 100'000;
+constexpr double SECONDS_PER_VARIANT = 0.5;
+
+gl2d::Texture texture;
+std::vector<gl2d::Rect> rects;
+std::vector<glm::vec2> origins;
+std::vector<float> rotations;
+
+template<class F>
+void benchmark(const char *name, gl2d::CommandRecorder &recorder, F renderFrame)
+{
+	recorder.reserveQuads(QUADS_PER_FRAME);
+
+	//warm up
+	renderFrame(recorder);
+	recorder.clearDrawData();
+
+	size_t quads = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	double seconds = 0;
+
+	while (seconds < SECONDS_PER_VARIANT)
+	{
+		renderFrame(recorder);
+		quads += recorder.spriteQuads.size();
+		recorder.clearDrawData();
+
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	std::printf("%-44s %8.2f M quads/s\n", name, quads / seconds / 1'000'000.0);
+}
+
+//how far a simd vertex can be from the scalar one, relative to the size of the coordonates
+constexpr float VERIFY_TOLERANCE = 1e-5f;
+constexpr size_t VERIFY_GUARD_QUADS = 8;
+
+//runs transformQuads for the first n quads at the current simd level and compares it with the scalar level,
+//the vertices after the first n quads are filled with a pattern that must not change
+bool verifyTransform(const char *name, const std::vector<gl2d::Rect> &rects, const std::vector<glm::vec2> &origins,
+	const std::vector<float> &rotations, size_t n)
+{
+	const gl2d::SimdLevel level = gl2d::getSimdLevel();
+
+	std::vector<gl2d::Renderer2DVertex> expected(n * 4);
+	gl2d::setSimdLevel(gl2d::simdScalar);
+	gl2d::transformQuads(rects.data(), origins.data(), rotations.data(), n, expected.data());
+	gl2d::setSimdLevel(level);
+
+	std::vector<gl2d::Renderer2DVertex> result((n + VERIFY_GUARD_QUADS) * 4);
+	std::memset((void *)result.data(), 0xCD, result.size() * sizeof(gl2d::Renderer2DVertex));
+	std::vector<gl2d::Renderer2DVertex> guard(result.begin() + n * 4, result.end());
+
+	gl2d::transformQuads(rects.data(), origins.data(), rotations.data(), n, result.data());
+
+	if (std::memcmp(guard.data(), result.data() + n * 4, guard.size() * sizeof(gl2d::Renderer2DVertex)))
+	{
+		std::printf("FAIL %s: wrote past the %zu quads\n", name, n);
+		return false;
+	}
+
+	for (size_t i = 0; i < n * 4; i++)
+	{
+		const glm::vec2 a = expected[i].position;
+		const glm::vec2 b = result[i].position;
+
+		const gl2d::Rect &r = rects[i / 4];
+		const float scale = 1.f + std::max({std::abs(r.x), std::abs(r.y), std::abs(r.x + r.z), std::abs(r.y + r.w),
+			std::abs(origins[i / 4].x), std::abs(origins[i / 4].y)});
+
+		if (!(std::abs(a.x - b.x) <= VERIFY_TOLERANCE * scale && std::abs(a.y - b.y) <= VERIFY_TOLERANCE * scale))
+		{
+			std::printf("FAIL %s: quad %zu vertex %zu rotation %g, expected (%g, %g) got (%g, %g)\n",
+				name, i / 4, i % 4, rotations[i / 4], a.x, a.y, b.x, b.y);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int verify()
+{
+	constexpr size_t COUNT = 4096;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-2000, 2000);
+	std::uniform_real_distribution<float> size(0, 500);
+	std::uniform_real_distribution<float> smallAngle(-720, 720);
+	std::uniform_real_distribution<float> largeAngle(-1e8f, 1e8f);
+
+	std::vector<gl2d::Rect> rects(COUNT);
+	std::vector<glm::vec2> origins(COUNT);
+	std::vector<float> rotations(COUNT);
+	std::vector<float> largeRotations(COUNT);
+	std::vector<float> mixedRotations(COUNT);
+
+	for (size_t i = 0; i < COUNT; i++)
+	{
+		rects[i] = {position(random), position(random), size(random), size(random)};
+		origins[i] = {position(random), position(random)};
+		rotations[i] = smallAngle(random);
+		largeRotations[i] = largeAngle(random);
+
+		//0 and whole turns have to keep the exact positions, mixed with rotated quads in the same lanes
+		const float special[] = {0.f, -0.f, 360.f, -720.f, 90.f, 180.f, 1e7f, -1e7f};
+		mixedRotations[i] = (i % 3) ? special[random() % 8] : rotations[i];
+	}
+
+	const char *simdNames[] = {"scalar", "sse4.1", "avx2", "neon"};
+	bool passed = true;
+	int levels = 0;
+
+	for (auto level : {gl2d::simdSSE41, gl2d::simdAVX2, gl2d::simdNEON})
+	{
+		if (gl2d::setSimdLevel(level) != level) { continue; }
+		levels++;
+
+		char name[64] = {};
+
+		//every count up to a few full simd blocks so the scalar tails are checked too
+		for (size_t n = 0; n <= 20; n++)
+		{
+			std::snprintf(name, sizeof(name), "%s, %zu quads", simdNames[level], n);
+			passed &= verifyTransform(name, rects, origins, rotations, n);
+		}
+
+		std::snprintf(name, sizeof(name), "%s, random rotations", simdNames[level]);
+		passed &= verifyTransform(name, rects, origins, rotations, COUNT - 3);
+
+		std::snprintf(name, sizeof(name), "%s, large rotations", simdNames[level]);
+		passed &= verifyTransform(name, rects, origins, largeRotations, COUNT);
+
+		std::snprintf(name, sizeof(name), "%s, 0 and whole turns", simdNames[level]);
+		passed &= verifyTransform(name, rects, origins, mixedRotations, COUNT - 1);
+	}
+
+	gl2d::setSimdLevel(gl2d::simdScalar);
+	std::printf("%s, %d simd levels checked against scalar\n", passed ? "passed" : "failed", levels);
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--verify")) { return verify(); }
+		else
+		{
+			std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	//the texture is never drawn, the recorder only needs a valid id
+	texture.id = 1;
+
+	rects.resize(QUADS_PER_FRAME);
+	origins.resize(QUADS_PER_FRAME);
+	rotations.resize(QUADS_PER_FRAME);
+	for (int i = 0; i < QUADS_PER_FRAME; i++)
+	{
+		rects[i] = {(i % 300) * 32.f, (i / 300) * 32.f, 32, 32};
+		origins[i] = glm::vec2(rects[i]) + glm::vec2(16, 16);
+		rotations[i] = (float)(i % 360) + 1;
+	}
+
+	const gl2d::Color4f colors[4] = {Colors_White, Colors_Red, Colors_Green, Colors_Blue};
+	const glm::vec4 atlasCoords = {0.25f, 0.75f, 0.5f, 0.5f};
+
+	gl2d::CommandRecorder recorder;
+	recorder.updateWindowMetrics(1280, 720);
+
+	benchmark("axis aligned, one color, default uvs", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, Colors_White); }
+	});
+
+	benchmark("axis aligned, one color, atlas uvs", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, Colors_White, {}, 0, atlasCoords); }
+	});
+
+	benchmark("axis aligned, 4 colors, default uvs", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, colors); }
+	});
+
+	benchmark("rotated, one color, default uvs", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, Colors_White, {}, rotations[i]); }
+	});
+
+	benchmark("rotated, 4 colors, atlas uvs (general)", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, colors, {}, rotations[i], atlasCoords); }
+	});
+
+	benchmark("QuadWriter, axis aligned, one color", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		auto writer = r.beginQuads(QUADS_PER_FRAME);
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { writer.write(rects[i], texture, Colors_White); }
+		writer.end();
+	});
+
+	benchmark("QuadWriter, rotated, one color", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		auto writer = r.beginQuads(QUADS_PER_FRAME);
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { writer.writeAbsRotation(rects[i], texture, Colors_White, origins[i], rotations[i]); }
+		writer.end();
+	});
+
+	const char *simdNames[] = {"scalar", "sse4.1", "avx2", "neon"};
+	for (auto level : {gl2d::simdScalar, gl2d::simdSSE41, gl2d::simdAVX2, gl2d::simdNEON})
+	{
+		if (gl2d::setSimdLevel(level) != level) { continue; }
+
+		char name[64] = {};
+		std::snprintf(name, sizeof(name), "QuadWriter::writeBatch, rotated, %s", simdNames[level]);
+
+		benchmark(name, recorder, [&](gl2d::CommandRecorder &r)
+		{
+			auto writer = r.beginQuads(QUADS_PER_FRAME);
+			writer.writeBatch(rects.data(), origins.data(), rotations.data(), nullptr, QUADS_PER_FRAME, texture);
+			writer.end();
+		});
+	}
+
+	recorder.instancedRendering = true;
+	benchmark("instanced, rotated, one color", recorder, [&](gl2d::CommandRecorder &r)
+	{
+		for (int i = 0; i < QUADS_PER_FRAME; i++) { r.renderRectangle(rects[i], texture, Colors_White, {}, rotations[i]); }
+	});
+
+	return 0;
+}
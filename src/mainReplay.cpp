@@ -0,0 +1,134 @@
+//replays a frame captured with gl2d::FrameCapture in a loop on a headless opengl context
+//and measures it, so a slow frame of the game can be profiled without running the game.
+//Every frame is finished with glFinish so the gpu time is included in the frame time.
+//
+//usage: gl2dReplay capture.gl2dcap [--frames N] [--seconds S] [--out file.json]
+//  --frames    how many frames are replayed, by default it runs for --seconds
+//  --seconds   how long it runs if --frames is not set, default 5
+//  --out       writes the results as json, like gl2dBench
+#include "gl2d/gl2dHeadless.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const char *captureFile = nullptr;
+	const char *outFile = nullptr;
+	int frames = 0;
+	double seconds = 5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!std::strcmp(argv[i], "--frames") && i + 1 < argc) { frames = std::atoi(argv[++i]); }
+		else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) { seconds = std::atof(argv[++i]); }
+		else if (!std::strcmp(argv[i], "--out") && i + 1 < argc) { outFile = argv[++i]; }
+		else if (!captureFile) { captureFile = argv[i]; }
+		else
+		{
+			std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!captureFile)
+	{
+		std::fprintf(stderr, "usage: gl2dReplay capture.gl2dcap [--frames N] [--seconds S] [--out file.json]\n");
+		return 1;
+	}
+
+	const char *error = nullptr;
+	if (!gl2d::createHeadlessContext(&error))
+	{
+		std::fprintf(stderr, "couldn't create the headless context: %s\n", error);
+		return 1;
+	}
+
+	gl2d::init();
+
+	gl2d::FrameCapture capture;
+	if (!capture.loadFromFile(captureFile))
+	{
+		return 1;
+	}
+
+	size_t quads = 0;
+	for (auto &c : capture.commands) { quads += c.quads.size(); }
+
+	std::fprintf(stderr, "%s: %dx%d, %zu commands, %zu quads, %zu textures, %zu frame buffers, %zu shaders\n",
+		captureFile, capture.windowW, capture.windowH, capture.commands.size(), quads,
+		capture.textures.size(), capture.frameBuffers.size(), capture.shaders.size());
+
+	gl2d::Renderer2D renderer;
+	gl2d::FrameBuffer output;
+	//with a depth buffer in case the frame was captured with the opaque pass
+	gl2d::createHeadlessRenderer(renderer, output, std::max(capture.windowW, 1), std::max(capture.windowH, 1), quads, true);
+
+	//the first replay creates the textures and compiles the shaders
+	capture.replay(renderer);
+	glFinish();
+	renderer.endFrameStats();
+
+	std::vector<double> times;
+	double total = 0;
+	while (frames ? (int)times.size() < frames : (total < seconds * 1000.0 || times.size() < 3))
+	{
+		double start = now();
+		capture.replay(renderer);
+		glFinish();
+		double ms = (now() - start) * 1000.0;
+
+		renderer.endFrameStats();
+		times.push_back(ms);
+		total += ms;
+	}
+
+	auto stats = renderer.getFrameStats();
+
+	std::sort(times.begin(), times.end());
+	const double msPerFrame = total / times.size();
+	const double p50 = times[times.size() / 2];
+	const double p95 = times[std::min(times.size() - 1, times.size() * 95 / 100)];
+
+	std::printf("%zu frames, %.4f ms/frame (min %.4f, p50 %.4f, p95 %.4f, max %.4f), %u draw calls, %u flushes\n",
+		times.size(), msPerFrame, times.front(), p50, p95, times.back(), stats.drawCalls, stats.flushes);
+
+	if (outFile)
+	{
+		FILE *f = std::fopen(outFile, "w");
+		if (!f)
+		{
+			std::fprintf(stderr, "couldn't open %s\n", outFile);
+			return 1;
+		}
+
+		std::fprintf(f, "{\n");
+		std::fprintf(f, "\t\"renderer\": \"%s\",\n", (const char *)glGetString(GL_RENDERER));
+		std::fprintf(f, "\t\"version\": \"%s\",\n", (const char *)glGetString(GL_VERSION));
+		std::fprintf(f, "\t\"width\": %d,\n", capture.windowW);
+		std::fprintf(f, "\t\"height\": %d,\n", capture.windowH);
+		std::fprintf(f, "\t\"workloads\": [\n");
+		std::fprintf(f, "\t\t{\"name\": \"replay %s\", \"frames\": %d, \"quads_per_frame\": %.1f, \"draw_calls_per_frame\": %.1f, "
+			"\"ms_per_frame\": %.4f, \"ms_per_frame_p50\": %.4f, \"ms_per_frame_p95\": %.4f, \"quads_per_second\": %.0f}\n",
+			captureFile, (int)times.size(), (double)stats.quads, (double)stats.drawCalls,
+			msPerFrame, p50, p95, stats.quads / (msPerFrame / 1000.0));
+		std::fprintf(f, "\t]\n}\n");
+		std::fclose(f);
+	}
+
+	capture.cleanup();
+	output.cleanup();
+	renderer.cleanup();
+	gl2d::cleanup();
+	gl2d::destroyHeadlessContext();
+
+	return 0;
+}